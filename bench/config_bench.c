@@ -0,0 +1,112 @@
+/**
+ * @file config_bench.c
+ * @brief Measures the cost of config_get_int() with many interfaces.
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Builds a configuration with N_INTERFACES interface sections, each
+ * overriding a few options, and times config_get_int() for an option
+ * found in the interface section, for one that falls back to the
+ * global section, and for a global lookup.
+ *
+ * The program is built twice. config_bench uses hash.c, and
+ * config_bench_ref uses the chained table that preceded it, kept in
+ * bench/hash_ref.c together with the old way of building the keys.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "config.h"
+#include "print.h"
+
+#define N_INTERFACES	500
+#define ROUNDS		2000
+
+static const char *const section_options[] = {
+	"logAnnounceInterval",
+	"logSyncInterval",
+	"logMinDelayReqInterval",
+	"delay_mechanism",
+};
+
+static char names[N_INTERFACES][16];
+
+/*
+ * Returns the cost of one config_get_int() call in nanoseconds, with
+ * 'option' read for every interface in turn, or from the global
+ * section if 'global' is set.
+ */
+static double measure(struct config *cfg, const char *option, int global)
+{
+	struct timespec start, end;
+	volatile int val;
+	int i, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < ROUNDS; i++) {
+		for (j = 0; j < N_INTERFACES; j++) {
+			val = config_get_int(cfg, global ? NULL : names[j],
+					     option);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	(void)val;
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 +
+		end.tv_nsec - start.tv_nsec) / ROUNDS / N_INTERFACES;
+}
+
+int main(int argc, char *argv[])
+{
+	struct config *cfg;
+	unsigned int j;
+	int i;
+
+	print_set_verbose(0);
+	print_set_syslog(0);
+
+	cfg = config_create();
+	if (!cfg) {
+		return 1;
+	}
+	for (i = 0; i < N_INTERFACES; i++) {
+		snprintf(names[i], sizeof(names[i]), "eth%d", i);
+		if (!config_create_interface(names[i], cfg)) {
+			return 1;
+		}
+		for (j = 0; j < sizeof(section_options) /
+			    sizeof(section_options[0]); j++) {
+			if (config_set_section_int(cfg, names[i],
+						   section_options[j], 0)) {
+				return 1;
+			}
+		}
+	}
+
+	printf("%d interfaces, config_get_int() per call\n", N_INTERFACES);
+	printf("  section hit     %4.0f ns\n",
+	       measure(cfg, "logSyncInterval", 0));
+	printf("  global fallback %4.0f ns\n",
+	       measure(cfg, "announceReceiptTimeout", 0));
+	printf("  global only     %4.0f ns\n",
+	       measure(cfg, "announceReceiptTimeout", 1));
+
+	config_destroy(cfg);
+	return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file linreg_check.c
+ * @brief Checks the running sums of the linear regression servo.
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The servo runs in the loop along every trace, for each supported
+ * linreg_max_size. Before every sample, a copy of its state takes the
+ * same sample with the sums recomputed from the stored points. resum()
+ * adds the points from the newest to the oldest, in the very order of
+ * the regression before the running sums, so the copy produces what
+ * that implementation would have produced from the same points.
+ *
+ * The slopes and intercepts of all sizes must agree within
+ * SLOPE_TOLERANCE and INTERCEPT_TOLERANCE. The program prints the
+ * largest differences seen and exits with status 1 if either limit
+ * is exceeded.
+ */
+#include <stdio.h>
+
+#include "../linreg.c"
+#include "trace.h"
+
+/* In ppb of frequency. */
+#define SLOPE_TOLERANCE		0.001
+/* In nanoseconds, a quarter of the resolution of the time stamps. */
+#define INTERCEPT_TOLERANCE	0.25
+
+static struct linreg_servo copy;
+
+/*
+ * Compares the results of the servo after a sample with those of the
+ * copy taken before the sample, once the copy took it with the sums
+ * recomputed.
+ */
+static void check(struct linreg_servo *s, int64_t offset, uint64_t local_ts,
+		  double max[2])
+{
+	struct result *a, *b;
+	unsigned int size;
+	double d;
+
+	update_reference(&copy, local_ts);
+	add_sample(&copy, offset, 1.0);
+	resum(&copy);
+	regress(&copy);
+
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
+		if (1U << size > s->num_points) {
+			break;
+		}
+		a = &s->results[size - MIN_SIZE];
+		b = &copy.results[size - MIN_SIZE];
+		d = 1e9 * fabs(a->slope - b->slope);
+		max[0] = d > max[0] ? d : max[0];
+		d = fabs(a->intercept - b->intercept);
+		max[1] = d > max[1] ? d : max[1];
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	double adj, max[2], worst[2] = { 0.0, 0.0 };
+	struct linreg_servo *s;
+	enum servo_state state;
+	struct trace_clock c;
+	struct servo *servo;
+	struct config *cfg;
+	int64_t offset;
+	uint64_t ts;
+	int i, j, size;
+
+	print_set_verbose(0);
+	print_set_syslog(0);
+
+	cfg = config_create();
+	if (!cfg) {
+		return 1;
+	}
+
+	printf("%-10s %5s %12s %12s\n", "trace", "size", "slope ppb",
+	       "intercept ns");
+
+	for (i = 0; i < n_traces; i++) {
+		for (size = 6; size <= MAX_SIZE; size += 2) {
+			config_set_int(cfg, "linreg_max_size", size);
+			servo = linreg_servo_create(cfg, 0);
+			if (!servo) {
+				return 1;
+			}
+			servo->max_frequency = 900000000.0;
+			servo_sync_interval(servo, trace_interval(&traces[i]));
+			s = container_of(servo, struct linreg_servo, servo);
+
+			max[0] = max[1] = 0.0;
+			adj = 0.0;
+			trace_clock_init(&c, &traces[i], 0);
+			for (j = 0; j < traces[i].samples; j++) {
+				offset = trace_clock_next(&c, adj, &ts);
+				copy = *s;
+				adj = servo_sample(servo, offset, ts, 1.0,
+						   &state);
+				check(s, offset, ts, max);
+				if (state == SERVO_JUMP) {
+					trace_clock_step(&c, offset);
+				}
+			}
+			servo_destroy(servo);
+
+			printf("%-10s %5d %12.2e %12.2e\n", traces[i].name,
+			       1 << size, max[0], max[1]);
+			worst[0] = max[0] > worst[0] ? max[0] : worst[0];
+			worst[1] = max[1] > worst[1] ? max[1] : worst[1];
+		}
+	}
+	config_destroy(cfg);
+
+	if (worst[0] > SLOPE_TOLERANCE || worst[1] > INTERCEPT_TOLERANCE) {
+		printf("FAILED: tolerance is %.2e ppb and %.2e ns\n",
+		       SLOPE_TOLERANCE, INTERCEPT_TOLERANCE);
+		return 1;
+	}
+	return 0;
+}
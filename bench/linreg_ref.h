@@ -0,0 +1,30 @@
+/**
+ * @file linreg_ref.h
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_LINREG_REF_H
+#define HAVE_LINREG_REF_H
+
+#include "servo.h"
+
+/**
+ * Creates the linear regression servo as it was implemented before it
+ * kept running sums, with a fixed largest size of 64 points.
+ */
+struct servo *linreg_ref_servo_create(int fadj);
+
+#endif
@@ -0,0 +1,180 @@
+/**
+ * @file linreg_replay.c
+ * @brief Replays synthetic traces through the linear regression servo
+ *        and through its previous implementation.
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The previous servo drives a simulated clock along each trace, and
+ * the current servo is fed the very same offsets and time stamps, so
+ * both see one input. The table shows how far their outputs differ,
+ * the RMS offset each servo achieves controlling the clock on its own,
+ * and the cost per sample.
+ *
+ * The outputs start out equal to about 1e-5 ppb, well within the
+ * tolerance enforced by linreg_check. Each servo truncates its
+ * reference to whole nanoseconds, so at some point the last bits round
+ * one of them a nanosecond off the other. From then on they run along
+ * equally valid trajectories, and the choice of the regression size
+ * may also differ now and then. That is why the differences shown here
+ * exceed the noise of the rounding.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "config.h"
+#include "linreg.h"
+#include "linreg_ref.h"
+#include "print.h"
+#include "servo_private.h"
+#include "trace.h"
+
+#define MAX_FREQUENCY 900000000.0
+
+struct sample {
+	int64_t offset;
+	uint64_t local_ts;
+};
+
+static struct sample rec[TRACE_MAX_SAMPLES];
+
+static struct servo *create(struct config *cfg, int ref)
+{
+	struct servo *s;
+
+	s = ref ? linreg_ref_servo_create(0) : linreg_servo_create(cfg, 0);
+	if (!s) {
+		fprintf(stderr, "failed to create servo\n");
+		exit(1);
+	}
+	s->max_frequency = MAX_FREQUENCY;
+	return s;
+}
+
+/*
+ * Runs a servo in the loop along a trace and returns the RMS offset.
+ * With 'cmp', that servo is fed the same samples, and the largest and
+ * mean difference of the outputs are stored in 'diff'.
+ */
+static double run(struct servo *s, struct servo *cmp, const struct trace *t,
+		  double diff[2])
+{
+	double adj = 0.0, d, sq = 0.0;
+	struct trace_clock c;
+	enum servo_state state;
+	int i;
+
+	diff[0] = diff[1] = 0.0;
+	trace_clock_init(&c, t, 0);
+	servo_sync_interval(s, trace_interval(t));
+	if (cmp) {
+		servo_sync_interval(cmp, trace_interval(t));
+	}
+	for (i = 0; i < t->samples; i++) {
+		rec[i].offset = trace_clock_next(&c, adj, &rec[i].local_ts);
+		sq += (double)rec[i].offset * rec[i].offset;
+
+		adj = servo_sample(s, rec[i].offset, rec[i].local_ts, 1.0,
+				   &state);
+		if (state == SERVO_JUMP) {
+			trace_clock_step(&c, rec[i].offset);
+		}
+		if (!cmp) {
+			continue;
+		}
+		d = fabs(servo_sample(cmp, rec[i].offset, rec[i].local_ts,
+				      1.0, &state) - adj);
+		diff[0] = d > diff[0] ? d : diff[0];
+		diff[1] += d / t->samples;
+	}
+	servo_destroy(s);
+	if (cmp) {
+		servo_destroy(cmp);
+	}
+	return sqrt(sq / t->samples);
+}
+
+/*
+ * Feeds the recorded samples to a fresh servo and returns the cost
+ * per sample in nanoseconds.
+ */
+static double measure(struct servo *s, const struct trace *t)
+{
+	struct timespec start, end;
+	enum servo_state state;
+	volatile double adj;
+	int i;
+
+	servo_sync_interval(s, trace_interval(t));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < t->samples; i++) {
+		adj = servo_sample(s, rec[i].offset, rec[i].local_ts, 1.0,
+				   &state);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	(void)adj;
+	servo_destroy(s);
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 +
+		end.tv_nsec - start.tv_nsec) / t->samples;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int sizes[] = { 6, 8, 10 };
+	double cost[4], diff[2], rms[2];
+	struct config *cfg;
+	unsigned int j;
+	int i;
+
+	print_set_verbose(0);
+	print_set_syslog(0);
+
+	cfg = config_create();
+	if (!cfg) {
+		return 1;
+	}
+
+	printf("%-10s %9s %9s %8s %8s %7s %7s %7s %7s\n",
+	       "", "max diff", "mean diff", "rms old", "rms new",
+	       "old", "new", "new", "new");
+	printf("%-10s %9s %9s %8s %8s %7s %7s %7s %7s\n",
+	       "trace", "ppb", "ppb", "ns", "ns",
+	       "64 pts", "64 pts", "256 pts", "1024");
+
+	for (i = 0; i < n_traces; i++) {
+		config_set_int(cfg, "linreg_max_size", 6);
+		rms[1] = run(create(cfg, 0), NULL, &traces[i], diff);
+		rms[0] = run(create(cfg, 1), create(cfg, 0), &traces[i], diff);
+
+		cost[0] = measure(create(cfg, 1), &traces[i]);
+		for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+			config_set_int(cfg, "linreg_max_size", sizes[j]);
+			cost[j + 1] = measure(create(cfg, 0), &traces[i]);
+		}
+
+		printf("%-10s %9.4f %9.4f %8.1f %8.1f %7.0f %7.0f %7.0f %7.0f\n",
+		       traces[i].name, diff[0], diff[1], rms[0], rms[1],
+		       cost[0], cost[1], cost[2], cost[3]);
+	}
+
+	config_destroy(cfg);
+	return 0;
+}
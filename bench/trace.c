@@ -0,0 +1,84 @@
+/**
+ * @file trace.c
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <math.h>
+
+#include "trace.h"
+
+const struct trace traces[] = {
+	{ "quiet",	20000,  0,   10.0,  1000.0, 0.0,  0     },
+	{ "noisy",	50000,  0, 1000.0, -3000.0, 0.0,  5000  },
+	{ "wander",	50000,  0,  200.0,   500.0, 0.05, 0     },
+	{ "fast sync",	50000, -4,  500.0, 20000.0, 0.01, 10000 },
+	{ "slow sync",	 5000,  2, 5000.0,  -800.0, 0.5,  1000  },
+};
+
+const int n_traces = sizeof(traces) / sizeof(traces[0]);
+
+static double uniform(struct trace_clock *c)
+{
+	/* xorshift64*, in the range [-1, 1) */
+	c->rng ^= c->rng >> 12;
+	c->rng ^= c->rng << 25;
+	c->rng ^= c->rng >> 27;
+	return (c->rng * 2685821657736338717ULL >> 11) * 0x1.0p-52 - 1.0;
+}
+
+void trace_clock_init(struct trace_clock *c, const struct trace *t,
+		      uint64_t seed)
+{
+	c->trace = t;
+	c->rng = 0x9e3779b97f4a7c15ULL + seed;
+	c->step = llround(trace_interval(t) * 1e9);
+	c->freq = t->drift;
+	c->phase = 0.0;
+	c->local_ts = 1000000000ULL;
+	c->count = 0;
+}
+
+int64_t trace_clock_next(struct trace_clock *c, double adj,
+			 uint64_t *local_ts)
+{
+	const struct trace *t = c->trace;
+	double drift;
+
+	if (t->drift_period && c->count && !(c->count % t->drift_period)) {
+		c->freq = -c->freq / 2.0;
+	}
+	c->freq += t->wander * uniform(c);
+	c->count++;
+
+	/* The servo returns the negated frequency of the clock. */
+	drift = c->step * (c->freq - adj) / 1e9;
+	c->phase += drift;
+	c->local_ts += c->step + llround(drift);
+	*local_ts = c->local_ts;
+
+	return llround(c->phase + t->noise * uniform(c));
+}
+
+void trace_clock_step(struct trace_clock *c, int64_t offset)
+{
+	c->phase -= offset;
+	c->local_ts -= offset;
+}
+
+double trace_interval(const struct trace *t)
+{
+	return pow(2.0, t->log_interval);
+}
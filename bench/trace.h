@@ -0,0 +1,87 @@
+/**
+ * @file trace.h
+ * @brief Synthetic offset traces for the servo benchmarks.
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_TRACE_H
+#define HAVE_TRACE_H
+
+#include <stdint.h>
+
+struct trace {
+	const char *name;
+	int samples;
+	int log_interval;
+	double noise;		/* peak measurement noise in ns */
+	double drift;		/* initial frequency error in ppb */
+	double wander;		/* random walk of the frequency per sample */
+	int drift_period;	/* samples between frequency steps, or 0 */
+};
+
+extern const struct trace traces[];
+extern const int n_traces;
+
+/* Longest trace, in samples. */
+#define TRACE_MAX_SAMPLES 50000
+
+/*
+ * A clock simulated along a trace. Every instance started with the
+ * same trace and seed produces the same noise.
+ */
+struct trace_clock {
+	const struct trace *trace;
+	uint64_t rng;
+	int64_t step;
+	double freq;
+	double phase;
+	uint64_t local_ts;
+	int count;
+};
+
+/**
+ * Starts a simulated clock.
+ * @param c     The clock to initialize.
+ * @param t     The trace to follow.
+ * @param seed  Seed of the noise.
+ */
+void trace_clock_init(struct trace_clock *c, const struct trace *t,
+		      uint64_t seed);
+
+/**
+ * Advances a simulated clock by one sync interval.
+ * @param c         The clock.
+ * @param adj       Frequency adjustment in ppb, as returned by the
+ *                  servo, which the clock ran with over the interval.
+ * @param local_ts  Returns the local time stamp of the measurement.
+ * @return          The measured offset from the master in ns.
+ */
+int64_t trace_clock_next(struct trace_clock *c, double adj,
+			 uint64_t *local_ts);
+
+/**
+ * Steps a simulated clock, as done on SERVO_JUMP.
+ * @param c       The clock.
+ * @param offset  The offset to remove in ns.
+ */
+void trace_clock_step(struct trace_clock *c, int64_t offset);
+
+/**
+ * Returns the sync interval of a trace in seconds.
+ */
+double trace_interval(const struct trace *t);
+
+#endif
@@ -19,11 +19,13 @@
 #include <errno.h>
 #include <time.h>
 #include <linux/net_tstamp.h>
-#include <poll.h>
+#include <limits.h>
+#include <sys/epoll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/queue.h>
+#include <unistd.h>
 
 #include "address.h"
 #include "bmc.h"
@@ -40,10 +42,12 @@
 #include "stats.h"
 #include "print.h"
 #include "rtnl.h"
+#include "telemetry.h"
 #include "tlv.h"
 #include "tsproc.h"
 #include "uds.h"
 #include "util.h"
+#include "wheel.h"
 
 #define N_CLOCK_PFD (N_POLLFD + 1) /* one extra per port, for the fault timer */
 #define POW2_41 ((double)(1ULL << 41))
@@ -70,13 +74,48 @@ struct clock_stats {
 	unsigned int max_count;
 };
 
+/*
+ * A file descriptor registered with epoll. The address of this
+ * record is the cookie handed back by epoll_wait().
+ */
+struct clock_pfd {
+	struct port *port;
+	int index;
+	int fd;
+};
+
+struct clock_fds {
+	LIST_ENTRY(clock_fds) list;
+	struct clock_pfd pfd[N_POLLFD];
+};
+
+/* Maps an interface index to the port using that interface. */
+struct clock_link {
+	int ifindex;
+	const char *name;
+	struct port *port;
+};
+
+/* A ready descriptor or an expired timer, awaiting dispatch. */
+struct clock_event {
+	struct port *port;
+	int index;
+	uint32_t revents;
+};
+
+/* Timer identifier of subscription expiry, distinct from port timers. */
+#define SUBSCRIBER_TIMER -1
+
 struct clock_subscriber {
 	LIST_ENTRY(clock_subscriber) list;
+	/* Links into the per notification lists selected by events. */
+	LIST_ENTRY(clock_subscriber) by_event[NOTIFY_MAX];
 	uint8_t events[EVENT_BITMASK_CNT];
 	struct PortIdentity targetPortIdentity;
 	struct address addr;
 	UInteger16 sequenceId;
 	time_t expiration;
+	struct wheel_timer *timer;
 };
 
 struct clock {
@@ -96,8 +135,17 @@ struct clock {
 	struct ClockIdentity best_id;
 	LIST_HEAD(ports_head, port) ports;
 	struct port *uds_port;
-	struct pollfd *pollfd;
-	int pollfd_valid;
+	int epfd;
+	struct epoll_event *events;
+	struct clock_event *ready;
+	int nevents;
+	struct wheel *wheel;
+	struct clock_pfd wheel_pfd;
+	int rtnl_fd;
+	struct clock_pfd rtnl_pfd;
+	struct clock_link *links;
+	int nlinks;
+	LIST_HEAD(clock_fds_head, clock_fds) fds;
 	int nports; /* does not include the UDS port */
 	int last_port_number;
 	int sde;
@@ -131,27 +179,71 @@ struct clock {
 	struct clockcheck *sanity_check;
 	struct interface *udsif;
 	LIST_HEAD(clock_subscribers_head, clock_subscriber) subscribers;
+	struct clock_subscribers_head event_subscribers[NOTIFY_MAX];
 	struct monitor *slave_event_monitor;
+	struct telemetry *telemetry;
+	const char *telemetry_source;
 };
 
 struct clock the_clock;
 
 static void handle_state_decision_event(struct clock *c);
-static int clock_resize_pollfd(struct clock *c, int new_nports);
+static int clock_resize_events(struct clock *c, int new_nports);
+static int clock_fds_add(struct clock *c, struct port *p);
+static void clock_fds_remove(struct clock *c, struct port *p);
+static int clock_link_add(struct clock *c, struct port *p, const char *name);
+static void clock_link_remove(struct clock *c, struct port *p);
 static void clock_remove_port(struct clock *c, struct port *p);
 static void clock_stats_display(struct clock_stats *s);
 
+static int subscriber_wants(struct clock_subscriber *s, int event)
+{
+	return s->events[event / 8] & (1 << (event % 8));
+}
+
+static void subscriber_link(struct clock *c, struct clock_subscriber *s)
+{
+	int i;
+
+	for (i = 0; i < NOTIFY_MAX; i++) {
+		if (subscriber_wants(s, i))
+			LIST_INSERT_HEAD(&c->event_subscribers[i], s,
+					 by_event[i]);
+	}
+}
+
+static void subscriber_unlink(struct clock_subscriber *s)
+{
+	int i;
+
+	for (i = 0; i < NOTIFY_MAX; i++) {
+		if (subscriber_wants(s, i))
+			LIST_REMOVE(s, by_event[i]);
+	}
+}
+
 static void remove_subscriber(struct clock_subscriber *s)
 {
+	subscriber_unlink(s);
 	LIST_REMOVE(s, list);
+	wheel_timer_destroy(s->timer);
 	free(s);
 }
 
+static void subscriber_renew(struct clock_subscriber *s, uint16_t duration)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	s->expiration = now.tv_sec + duration;
+	/* A zero duration expires right away, as zero disarms the timer. */
+	wheel_timer_set(s->timer, duration ? duration * NS_PER_SEC : 1);
+}
+
 static void clock_update_subscription(struct clock *c, struct ptp_message *req,
 				      uint8_t *bitmask, uint16_t duration)
 {
 	struct clock_subscriber *s, *tmp;
-	struct timespec now;
 	int i, remove = 1;
 
 	for (i = 0; i < EVENT_BITMASK_CNT; i++) {
@@ -167,9 +259,10 @@ static void clock_update_subscription(struct clock *c, struct ptp_message *req,
 			if (!remove) {
 				/* Update transport address and event mask. */
 				s->addr = req->address;
+				subscriber_unlink(s);
 				memcpy(s->events, bitmask, EVENT_BITMASK_CNT);
-				clock_gettime(CLOCK_MONOTONIC, &now);
-				s->expiration = now.tv_sec + duration;
+				subscriber_link(c, s);
+				subscriber_renew(s, duration);
 			} else {
 				remove_subscriber(s);
 			}
@@ -184,13 +277,19 @@ static void clock_update_subscription(struct clock *c, struct ptp_message *req,
 		pr_err("failed to allocate memory for a subscriber");
 		return;
 	}
+	s->timer = wheel_timer_create(c->wheel, s, SUBSCRIBER_TIMER);
+	if (!s->timer) {
+		pr_err("failed to allocate memory for a subscriber");
+		free(s);
+		return;
+	}
 	s->targetPortIdentity = req->header.sourcePortIdentity;
 	s->addr = req->address;
 	memcpy(s->events, bitmask, EVENT_BITMASK_CNT);
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	s->expiration = now.tv_sec + duration;
 	s->sequenceId = 0;
 	LIST_INSERT_HEAD(&c->subscribers, s, list);
+	subscriber_link(c, s);
+	subscriber_renew(s, duration);
 }
 
 static void clock_get_subscription(struct clock *c, struct ptp_message *req,
@@ -225,42 +324,62 @@ static void clock_flush_subscriptions(struct clock *c)
 	}
 }
 
-static void clock_prune_subscriptions(struct clock *c)
+static void clock_subscriber_expired(struct clock_subscriber *s)
 {
-	struct clock_subscriber *s, *tmp;
-	struct timespec now;
+	pr_info("subscriber %s timed out", pid2str(&s->targetPortIdentity));
+	remove_subscriber(s);
+}
 
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	LIST_FOREACH_SAFE(s, &c->subscribers, list, tmp) {
-		if (s->expiration <= now.tv_sec) {
-			pr_info("subscriber %s timed out",
-				pid2str(&s->targetPortIdentity));
-			remove_subscriber(s);
-		}
+/* Sends out a batch of notifications, skipping any that fail. */
+static void clock_send_notification_batch(struct port *uds,
+					  struct ptp_message **msg, int n)
+{
+	int cnt, i = 0;
+
+	while (i < n) {
+		cnt = port_forward_batch(uds, msg + i, n - i);
+		/* A short count means the next message failed. */
+		i += (cnt > 0 ? cnt : 0) + 1;
+	}
+	for (i = 0; i < n; i++) {
+		msg_put(msg[i]);
 	}
 }
 
 void clock_send_notification(struct clock *c, struct ptp_message *msg,
 			     enum notification event)
 {
-	unsigned int event_pos = event / 8;
-	uint8_t mask = 1 << (event % 8);
+	int len = ntohs(msg->header.messageLength), n = 0;
+	struct ptp_message *batch[TRANSPORT_BATCH_MAX];
 	struct port *uds = c->uds_port;
 	struct clock_subscriber *s;
+	struct ptp_message *dup;
 
-	LIST_FOREACH(s, &c->subscribers, list) {
-		if (!(s->events[event_pos] & mask))
-			continue;
-		/* send event */
-		msg->header.sequenceId = htons(s->sequenceId);
+	if (event >= NOTIFY_MAX)
+		return;
+
+	LIST_FOREACH(s, &c->event_subscribers[event], by_event[event]) {
+		/* Each subscriber gets its own header and address. */
+		dup = msg_allocate();
+		if (!dup) {
+			pr_err("low memory, dropping notifications");
+			break;
+		}
+		memcpy(dup, msg, len);
+		dup->header.sequenceId = htons(s->sequenceId);
 		s->sequenceId++;
-		msg->management.targetPortIdentity.clockIdentity =
+		dup->management.targetPortIdentity.clockIdentity =
 			s->targetPortIdentity.clockIdentity;
-		msg->management.targetPortIdentity.portNumber =
+		dup->management.targetPortIdentity.portNumber =
 			htons(s->targetPortIdentity.portNumber);
-		msg->address = s->addr;
-		port_forward_to(uds, msg);
+		dup->address = s->addr;
+		batch[n++] = dup;
+		if (n == TRANSPORT_BATCH_MAX) {
+			clock_send_notification_batch(uds, batch, n);
+			n = 0;
+		}
 	}
+	clock_send_notification_batch(uds, batch, n);
 }
 
 void clock_destroy(struct clock *c)
@@ -273,8 +392,25 @@ void clock_destroy(struct clock *c)
 		clock_remove_port(c, p);
 	}
 	monitor_destroy(c->slave_event_monitor);
+	if (c->telemetry) {
+		telemetry_destroy(c->telemetry);
+	}
+	if (c->uds_port) {
+		clock_fds_remove(c, c->uds_port);
+	}
 	port_close(c->uds_port);
-	free(c->pollfd);
+	if (c->epfd >= 0) {
+		close(c->epfd);
+	}
+	if (c->wheel) {
+		wheel_destroy(c->wheel);
+	}
+	if (c->rtnl_fd >= 0) {
+		rtnl_close(c->rtnl_fd);
+	}
+	free(c->events);
+	free(c->ready);
+	free(c->links);
 	if (c->clkid != CLOCK_REALTIME) {
 		phc_close(c->clkid);
 	}
@@ -289,6 +425,7 @@ void clock_destroy(struct clock *c)
 	memset(c, 0, sizeof(*c));
 	msg_cleanup();
 	tc_cleanup();
+	port_tx_cleanup();
 }
 
 static int clock_fault_timeout(struct port *port, int set)
@@ -341,8 +478,10 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 	struct grandmaster_settings_np *gsn;
 	struct management_tlv_datum *mtd;
 	struct subscribe_events_np *sen;
+	struct msg_pool_stats_np *mps;
 	struct management_tlv *tlv;
 	struct time_status_np *tsn;
+	struct msg_pool_stats stats;
 	struct tlv_extra *extra;
 	struct transparentClockDefaultDS *tcds;
 	struct PTPText *text;
@@ -464,6 +603,16 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 		mtd->val = c->local_sync_uncertain;
 		datalen = sizeof(*mtd);
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		mps = (struct msg_pool_stats_np *) tlv->data;
+		msg_pool_stats(&stats);
+		mps->allocations = stats.allocations;
+		mps->misses = stats.misses;
+		mps->size = stats.size;
+		mps->in_use = stats.in_use;
+		mps->high_water = stats.high_water;
+		datalen = sizeof(*mps);
+		break;
 	default:
 		/* The caller should *not* respond to this message. */
 		tlv_extra_recycle(extra);
@@ -639,6 +788,11 @@ static enum servo_state clock_no_adjust(struct clock *c, tmv_t ingress,
 		tmv_dbl(tmv_sub(ingress, f->ingress1));
 	freq = (1.0 - ratio) * 1e9;
 
+	telemetry_sample(c->telemetry, c->telemetry_source,
+			 tmv_to_nanoseconds(ingress),
+			 tmv_to_nanoseconds(c->master_offset),
+			 tmv_to_nanoseconds(c->path_delay), freq, state);
+
 	if (c->stats.max_count > 1) {
 		clock_stats_update(&c->stats, tmv_dbl(c->master_offset), freq);
 	} else {
@@ -811,6 +965,11 @@ struct config *clock_config(struct clock *c)
 	return c->config;
 }
 
+clockid_t clock_clkid(struct clock *c)
+{
+	return c->clkid;
+}
+
 int (*clock_dscmp(struct clock *c))(struct dataset *a, struct dataset *b)
 {
 	return c->dscmp;
@@ -827,13 +986,22 @@ static int clock_add_port(struct clock *c, const char *phc_device,
 {
 	struct port *p, *piter, *lastp = NULL;
 
-	if (clock_resize_pollfd(c, c->nports + 1)) {
+	if (clock_resize_events(c, c->nports + 1)) {
 		return -1;
 	}
 	p = port_open(phc_device, phc_index, timestamping,
 		      ++c->last_port_number, iface, c);
 	if (!p) {
-		/* No need to shrink pollfd */
+		/* No need to shrink the event array */
+		return -1;
+	}
+	if (clock_fds_add(c, p)) {
+		port_close(p);
+		return -1;
+	}
+	if (clock_link_add(c, p, interface_name(iface))) {
+		clock_fds_remove(c, p);
+		port_close(p);
 		return -1;
 	}
 	LIST_FOREACH(piter, &c->ports, list) {
@@ -845,21 +1013,21 @@ static int clock_add_port(struct clock *c, const char *phc_device,
 		LIST_INSERT_HEAD(&c->ports, p, list);
 	}
 	c->nports++;
-	clock_fda_changed(c);
 
 	return 0;
 }
 
 static void clock_remove_port(struct clock *c, struct port *p)
 {
-	/* Do not call clock_resize_pollfd, it's pointless to shrink
+	/* Do not call clock_resize_events, it's pointless to shrink
 	 * the allocated memory at this point, clock_destroy will free
 	 * it all anyway. This function is usable from other parts of
-	 * the code, but even then we don't mind if pollfd is larger
-	 * than necessary. */
+	 * the code, but even then we don't mind if the event array is
+	 * larger than necessary. */
 	LIST_REMOVE(p, list);
 	c->nports--;
-	clock_fda_changed(c);
+	clock_link_remove(c, p);
+	clock_fds_remove(c, p);
 	port_close(p);
 }
 
@@ -899,9 +1067,10 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	char ts_label[IF_NAMESIZE], phc[32], *tmp;
 	enum timestamp_type timestamping;
 	int fadj = 0, max_adj = 0, sw_ts;
-	int phc_index, required_modes = 0;
+	int i, phc_index, required_modes = 0;
 	struct clock *c = &the_clock;
 	const char *uds_ifname;
+	struct epoll_event ev;
 	struct port *p;
 	unsigned char oui[OUI_LEN];
 	struct interface *iface;
@@ -1180,13 +1349,47 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	clock_sync_interval(c, 0);
 
 	LIST_INIT(&c->subscribers);
+	for (i = 0; i < NOTIFY_MAX; i++) {
+		LIST_INIT(&c->event_subscribers[i]);
+	}
 	LIST_INIT(&c->ports);
+	LIST_INIT(&c->fds);
 	c->last_port_number = 0;
 
-	if (clock_resize_pollfd(c, 0)) {
-		pr_err("failed to allocate pollfd");
+	c->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (c->epfd < 0) {
+		pr_err("epoll_create1 failed: %m");
 		return NULL;
 	}
+	if (clock_resize_events(c, 0)) {
+		pr_err("failed to allocate epoll events");
+		return NULL;
+	}
+	c->wheel = wheel_create();
+	if (!c->wheel) {
+		pr_err("failed to create the timer wheel");
+		return NULL;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &c->wheel_pfd;
+	c->wheel_pfd.fd = wheel_fd(c->wheel);
+	if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, c->wheel_pfd.fd, &ev)) {
+		pr_err("epoll_ctl failed: %m");
+		return NULL;
+	}
+
+	/* One netlink socket monitors the links of all of the ports. */
+	c->rtnl_fd = rtnl_open();
+	if (c->rtnl_fd >= 0) {
+		ev.data.ptr = &c->rtnl_pfd;
+		c->rtnl_pfd.index = FD_RTNL;
+		c->rtnl_pfd.fd = c->rtnl_fd;
+		if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, c->rtnl_fd, &ev)) {
+			pr_err("epoll_ctl failed: %m");
+			return NULL;
+		}
+	}
 
 	/* Create the UDS interface. */
 	c->uds_port = port_open(phc_device, phc_index, timestamping, 0, c->udsif, c);
@@ -1194,7 +1397,10 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		pr_err("failed to open the UDS port");
 		return NULL;
 	}
-	clock_fda_changed(c);
+	if (clock_fds_add(c, c->uds_port)) {
+		pr_err("failed to register the UDS port");
+		return NULL;
+	}
 
 	c->slave_event_monitor = monitor_create(config, c->uds_port);
 	if (!c->slave_event_monitor) {
@@ -1202,6 +1408,13 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		return NULL;
 	}
 
+	c->telemetry = telemetry_create(config);
+	if (!c->telemetry) {
+		pr_err("failed to create telemetry ring");
+		return NULL;
+	}
+	c->telemetry_source = interface_name(STAILQ_FIRST(&config->interfaces));
+
 	/* Create the ports. */
 	STAILQ_FOREACH(iface, &config->interfaces, list) {
 		if (clock_add_port(c, phc_device, phc_index, timestamping, iface)) {
@@ -1277,59 +1490,305 @@ int clock_gm_capable(struct clock *c)
 	return c->grand_master_capable;
 }
 
+struct wheel *clock_timer_wheel(struct clock *c)
+{
+	return c->wheel;
+}
+
 struct ClockIdentity clock_identity(struct clock *c)
 {
 	return c->dds.clockIdentity;
 }
 
-static int clock_resize_pollfd(struct clock *c, int new_nports)
+static int clock_resize_events(struct clock *c, int new_nports)
 {
-	struct pollfd *new_pollfd;
+	struct epoll_event *new_events;
+	struct clock_event *new_ready;
+	int n;
 
-	/* Need to allocate one whole extra block of fds for UDS. */
-	new_pollfd = realloc(c->pollfd,
-			     (new_nports + 1) * N_CLOCK_PFD *
-			     sizeof(struct pollfd));
-	if (!new_pollfd) {
+	/*
+	 * Need to allocate one whole extra block of events for UDS,
+	 * and one more for the timer wheel. Every descriptor and
+	 * timer of a port appears at most once per poll.
+	 */
+	n = (new_nports + 1) * N_CLOCK_PFD + 1;
+	new_events = realloc(c->events, n * sizeof(struct epoll_event));
+	if (!new_events) {
 		return -1;
 	}
-	c->pollfd = new_pollfd;
+	c->events = new_events;
+	new_ready = realloc(c->ready, n * sizeof(struct clock_event));
+	if (!new_ready) {
+		return -1;
+	}
+	c->ready = new_ready;
+	c->nevents = n;
 	return 0;
 }
 
-static void clock_fill_pollfd(struct pollfd *dest, struct port *p)
+static struct clock_fds *clock_fds_find(struct clock *c, struct port *p)
+{
+	struct clock_fds *fds;
+
+	LIST_FOREACH(fds, &c->fds, list) {
+		if (fds->pfd[0].port == p) {
+			return fds;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Brings the epoll registrations of one port up to date. The port has
+ * already closed the descriptors it replaced, which left the epoll set
+ * by themselves. Their numbers may since have been reused, by this port
+ * or by another one, so they must not be removed here. A failed modify
+ * falls back to adding the descriptor.
+ */
+static void clock_fds_update(struct clock *c, struct clock_fds *fds)
 {
+	struct port *p = fds->pfd[0].port;
+	struct epoll_event ev;
 	struct fdarray *fda;
-	int i;
+	int i, fd;
 
 	fda = port_fda(p);
 	for (i = 0; i < N_POLLFD; i++) {
-		dest[i].fd = fda->fd[i];
-		dest[i].events = POLLIN|POLLPRI;
+		fd = fda->fd[i];
+		fds->pfd[i].fd = fd;
+		if (fd < 0) {
+			continue;
+		}
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN|EPOLLPRI;
+		ev.data.ptr = &fds->pfd[i];
+		if (!epoll_ctl(c->epfd, EPOLL_CTL_MOD, fd, &ev)) {
+			continue;
+		}
+		if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+			pr_err("port %d: epoll_ctl failed: %m", port_number(p));
+		}
 	}
-	dest[i].fd = port_fault_fd(p);
-	dest[i].events = POLLIN|POLLPRI;
 }
 
-static void clock_check_pollfd(struct clock *c)
+static int clock_fds_add(struct clock *c, struct port *p)
 {
-	struct port *p;
-	struct pollfd *dest = c->pollfd;
+	struct clock_fds *fds;
+	int i;
+
+	fds = calloc(1, sizeof(*fds));
+	if (!fds) {
+		return -1;
+	}
+	for (i = 0; i < N_POLLFD; i++) {
+		fds->pfd[i].port = p;
+		fds->pfd[i].index = i;
+		fds->pfd[i].fd = -1;
+	}
+	LIST_INSERT_HEAD(&c->fds, fds, list);
+	clock_fds_update(c, fds);
+	return 0;
+}
+
+static void clock_fds_remove(struct clock *c, struct port *p)
+{
+	struct clock_fds *fds;
+	int i;
 
-	if (c->pollfd_valid) {
+	fds = clock_fds_find(c, p);
+	if (!fds) {
 		return;
 	}
-	LIST_FOREACH(p, &c->ports, list) {
-		clock_fill_pollfd(dest, p);
-		dest += N_CLOCK_PFD;
+	for (i = 0; i < N_POLLFD; i++) {
+		if (fds->pfd[i].fd >= 0) {
+			epoll_ctl(c->epfd, EPOLL_CTL_DEL, fds->pfd[i].fd, NULL);
+		}
+	}
+	LIST_REMOVE(fds, list);
+	free(fds);
+}
+
+static int clock_link_cmp(const void *a, const void *b)
+{
+	const struct clock_link *la = a, *lb = b;
+
+	return la->ifindex - lb->ifindex;
+}
+
+static void clock_link_sort(struct clock *c)
+{
+	qsort(c->links, c->nlinks, sizeof(*c->links), clock_link_cmp);
+}
+
+static int clock_link_add(struct clock *c, struct port *p, const char *name)
+{
+	struct clock_link *links;
+
+	links = realloc(c->links, (c->nlinks + 1) * sizeof(*links));
+	if (!links) {
+		return -1;
+	}
+	c->links = links;
+	c->links[c->nlinks].ifindex = if_nametoindex(name);
+	c->links[c->nlinks].name = name;
+	c->links[c->nlinks].port = p;
+	c->nlinks++;
+	clock_link_sort(c);
+	return 0;
+}
+
+static void clock_link_remove(struct clock *c, struct port *p)
+{
+	int i;
+
+	for (i = 0; i < c->nlinks; i++) {
+		if (c->links[i].port == p) {
+			memmove(&c->links[i], &c->links[i + 1],
+				(c->nlinks - i - 1) * sizeof(*c->links));
+			c->nlinks--;
+			return;
+		}
+	}
+}
+
+/*
+ * Looks up the port by interface index. An interface that has been
+ * recreated under the same name has a new index, and so a miss falls
+ * back to matching the name.
+ */
+static struct clock_link *clock_link_find(struct clock *c, int ifindex,
+					  const char *name)
+{
+	struct clock_link key, *link;
+	int i;
+
+	key.ifindex = ifindex;
+	link = bsearch(&key, c->links, c->nlinks, sizeof(*c->links),
+		       clock_link_cmp);
+	if (link || !name) {
+		return link;
+	}
+	for (i = 0; i < c->nlinks; i++) {
+		if (!strcmp(c->links[i].name, name)) {
+			c->links[i].ifindex = ifindex;
+			clock_link_sort(c);
+			return bsearch(&key, c->links, c->nlinks,
+				       sizeof(*c->links), clock_link_cmp);
+		}
+	}
+	return NULL;
+}
+
+int clock_link_query(struct clock *c, struct port *p)
+{
+	int i;
+
+	if (c->rtnl_fd < 0) {
+		return -1;
+	}
+	for (i = 0; i < c->nlinks; i++) {
+		if (c->links[i].port == p) {
+			c->links[i].ifindex = if_nametoindex(c->links[i].name);
+			clock_link_sort(c);
+			return rtnl_link_query(c->rtnl_fd, c->links[i].name);
+		}
+	}
+	return -1;
+}
+
+void clock_fda_changed(struct clock *c, struct port *p)
+{
+	struct clock_fds *fds;
+
+	fds = clock_fds_find(c, p);
+	if (fds) {
+		clock_fds_update(c, fds);
+	}
+}
+
+/*
+ * Ports are serviced in order, with the UDS port last, and each
+ * port's descriptors in the order given in fd.h.
+ */
+static int clock_event_before(struct clock *c, struct clock_event *a,
+			      struct clock_event *b)
+{
+	int na, nb;
+
+	na = a->port == c->uds_port ? INT_MAX : port_number(a->port);
+	nb = b->port == c->uds_port ? INT_MAX : port_number(b->port);
+	if (na != nb) {
+		return na < nb;
+	}
+	return a->index < b->index;
+}
+
+static void clock_sort_events(struct clock *c, int cnt)
+{
+	struct clock_event tmp;
+	int i, j;
+
+	for (i = 1; i < cnt; i++) {
+		tmp = c->ready[i];
+		for (j = i; j > 0; j--) {
+			if (!clock_event_before(c, &tmp, &c->ready[j - 1])) {
+				break;
+			}
+			c->ready[j] = c->ready[j - 1];
+		}
+		c->ready[j] = tmp;
 	}
-	clock_fill_pollfd(dest, c->uds_port);
-	c->pollfd_valid = 1;
 }
 
-void clock_fda_changed(struct clock *c)
+struct clock_collect {
+	struct clock *clock;
+	int cnt;
+};
+
+static void clock_add_event(struct clock_collect *col, struct port *p,
+			    int index, uint32_t revents)
 {
-	c->pollfd_valid = 0;
+	struct clock_event *ev = &col->clock->ready[col->cnt++];
+
+	ev->port = p;
+	ev->index = index;
+	ev->revents = revents;
+}
+
+static void clock_timer_expired(void *ctx, void *owner, int id)
+{
+	if (id == SUBSCRIBER_TIMER) {
+		clock_subscriber_expired(owner);
+		return;
+	}
+	clock_add_event(ctx, owner, id, EPOLLIN);
+}
+
+/*
+ * Applies a link event to the port owning the interface, and queues
+ * the port's FD_RTNL handler once for all of the events in one read.
+ */
+static void clock_link_status(void *ctx, int ifindex, const char *name,
+			      int linkup, int ts_index)
+{
+	struct clock_collect *col = ctx;
+	struct clock *c = col->clock;
+	struct clock_link *link;
+	int i;
+
+	link = clock_link_find(c, ifindex, name);
+	if (!link) {
+		return;
+	}
+	port_link_status(link->port, linkup, ts_index);
+
+	for (i = 0; i < col->cnt; i++) {
+		if (c->ready[i].port == link->port &&
+		    c->ready[i].index == FD_RTNL) {
+			return;
+		}
+	}
+	clock_add_event(col, link->port, FD_RTNL, EPOLLIN);
 }
 
 static int clock_do_forward_mgmt(struct clock *c,
@@ -1483,6 +1942,7 @@ int clock_do_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 	case TLV_GRANDMASTER_SETTINGS_NP:
 	case TLV_SUBSCRIBE_EVENTS_NP:
 	case TLV_SYNCHRONIZATION_UNCERTAIN_NP:
+	case TLV_MSG_POOL_STATS_NP:
 		clock_management_send_error(p, msg, TLV_NOT_SUPPORTED);
 		break;
 	default:
@@ -1554,73 +2014,111 @@ void clock_set_sde(struct clock *c, int sde)
 
 int clock_poll(struct clock *c)
 {
-	int cnt, i;
+	struct port *p, *faulty = NULL;
+	struct clock_collect col;
 	enum fsm_event event;
-	struct pollfd *cur;
-	struct port *p;
+	struct clock_pfd *pfd;
+	uint32_t revents;
+	int cnt, i, k, n;
 
-	clock_check_pollfd(c);
-	cnt = poll(c->pollfd, (c->nports + 1) * N_CLOCK_PFD, -1);
-	if (cnt < 0) {
+	n = epoll_wait(c->epfd, c->events, c->nevents, -1);
+	if (n < 0) {
 		if (EINTR == errno) {
 			return 0;
 		} else {
 			pr_emerg("poll failed");
 			return -1;
 		}
-	} else if (!cnt) {
+	} else if (!n) {
 		return 0;
 	}
 
-	cur = c->pollfd;
+	col.clock = c;
+	col.cnt = 0;
+	for (k = 0; k < n; k++) {
+		pfd = c->events[k].data.ptr;
+		if (pfd->port) {
+			clock_add_event(&col, pfd->port, pfd->index,
+					c->events[k].events);
+		}
+	}
+	for (k = 0; k < n; k++) {
+		pfd = c->events[k].data.ptr;
+		if (pfd == &c->rtnl_pfd) {
+			pr_debug("received link status notification");
+			rtnl_link_status_all(c->rtnl_fd, clock_link_status, &col);
+		}
+	}
+	for (k = 0; k < n; k++) {
+		pfd = c->events[k].data.ptr;
+		if (pfd == &c->wheel_pfd) {
+			wheel_expire(c->wheel, clock_timer_expired, &col,
+				     c->nevents - col.cnt);
+		}
+	}
+	cnt = col.cnt;
 
-	LIST_FOREACH(p, &c->ports, list) {
-		/* Let the ports handle their events. */
-		for (i = 0; i < N_POLLFD; i++) {
-			if (cur[i].revents & (POLLIN|POLLPRI|POLLERR)) {
-				if (cur[i].revents & POLLERR) {
-					pr_err("port %d: unexpected socket error",
-					       port_number(p));
-					event = EV_FAULT_DETECTED;
-				} else {
-					event = port_event(p, i);
-				}
+	clock_sort_events(c, cnt);
+
+	for (k = 0; k < cnt; k++) {
+		revents = c->ready[k].revents;
+		p = c->ready[k].port;
+		i = c->ready[k].index;
+
+		/* Check the UDS port. */
+		if (p == c->uds_port) {
+			if (i < N_POLLFD && revents & (EPOLLIN|EPOLLPRI)) {
+				event = port_event(c->uds_port, i);
 				if (EV_STATE_DECISION_EVENT == event) {
 					c->sde = 1;
 				}
-				if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
-					c->sde = 1;
-				}
-				port_dispatch(p, event, 0);
-				/* Clear any fault after a little while. */
-				if (PS_FAULTY == port_state(p)) {
-					clock_fault_timeout(p, 1);
-					break;
-				}
 			}
+			continue;
 		}
 
 		/*
 		 * When the fault timer expires we clear the fault,
 		 * but only if the link is up.
 		 */
-		if (cur[N_POLLFD].revents & (POLLIN|POLLPRI)) {
-			clock_fault_timeout(p, 0);
-			if (port_link_status_get(p)) {
-				port_dispatch(p, EV_FAULT_CLEARED, 0);
+		if (i == N_POLLFD) {
+			if (revents & (EPOLLIN|EPOLLPRI)) {
+				clock_fault_timeout(p, 0);
+				if (port_link_status_get(p)) {
+					port_dispatch(p, EV_FAULT_CLEARED, 0);
+				}
 			}
+			continue;
 		}
 
-		cur += N_CLOCK_PFD;
-	}
-
-	/* Check the UDS port. */
-	for (i = 0; i < N_POLLFD; i++) {
-		if (cur[i].revents & (POLLIN|POLLPRI)) {
-			event = port_event(c->uds_port, i);
-			if (EV_STATE_DECISION_EVENT == event) {
-				c->sde = 1;
-			}
+		/*
+		 * Let the ports handle their events. Link events still
+		 * count on a port that just became faulty.
+		 */
+		if ((p == faulty && i != FD_RTNL) ||
+		    !(revents & (EPOLLIN|EPOLLPRI|EPOLLERR))) {
+			continue;
+		}
+		if (i == FD_EVENT && revents & (EPOLLERR|EPOLLPRI)) {
+			/* Deferred or stray transmit time stamps. */
+			event = port_tx_complete(p);
+		} else if (revents & EPOLLERR) {
+			pr_err("port %d: unexpected socket error",
+			       port_number(p));
+			event = EV_FAULT_DETECTED;
+		} else {
+			event = port_event(p, i);
+		}
+		if (EV_STATE_DECISION_EVENT == event) {
+			c->sde = 1;
+		}
+		if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
+			c->sde = 1;
+		}
+		port_dispatch(p, event, 0);
+		/* Clear any fault after a little while. */
+		if (PS_FAULTY == port_state(p)) {
+			clock_fault_timeout(p, 1);
+			faulty = p;
 		}
 	}
 
@@ -1628,7 +2126,6 @@ int clock_poll(struct clock *c)
 		handle_state_decision_event(c);
 		c->sde = 0;
 	}
-	clock_prune_subscriptions(c);
 	return 0;
 }
 
@@ -1786,6 +2283,10 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 		break;
 	}
 
+	telemetry_sample(c->telemetry, c->telemetry_source,
+			 tmv_to_nanoseconds(ingress), offset,
+			 tmv_to_nanoseconds(c->path_delay), adj, state);
+
 	if (c->stats.max_count > 1) {
 		clock_stats_update(&c->stats, tmv_dbl(c->master_offset), adj);
 	} else {
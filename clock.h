@@ -31,6 +31,7 @@
 #include "transport.h"
 
 struct ptp_message; /*forward declaration*/
+struct wheel;
 
 /** Opaque type. */
 struct clock;
@@ -73,6 +74,14 @@ UInteger8 clock_class(struct clock *c);
  */
 struct config *clock_config(struct clock *c);
 
+/**
+ * Obtains the ID of the clock being synchronized, whose time base the
+ * ingress time stamps of the ports use.
+ * @param c  The clock instance.
+ * @return   A clock ID, or CLOCK_INVALID for a free running clock.
+ */
+clockid_t clock_clkid(struct clock *c);
+
 /**
  * Obtains a reference to the current dataset.
  * @param c  The clock instance.
@@ -166,10 +175,11 @@ struct ClockIdentity clock_identity(struct clock *c);
 
 /**
  * Informs clock that a file descriptor of one of its ports changed. The
- * clock will rebuild its array of file descriptors to poll.
+ * clock will update the registrations of that port's descriptors.
  * @param c    The clock instance.
+ * @param p    The port whose descriptors changed.
  */
-void clock_fda_changed(struct clock *c);
+void clock_fda_changed(struct clock *c, struct port *p);
 
 /**
  * Obtains the time of the latest synchronization.
@@ -178,6 +188,15 @@ void clock_fda_changed(struct clock *c);
  */
 tmv_t clock_ingress_time(struct clock *c);
 
+/**
+ * Requests the link status of a port's interface. The answer arrives
+ * on the clock's link monitor socket, like any other link event.
+ * @param c  The clock instance.
+ * @param p  The port whose link status is wanted.
+ * @return   Zero on success, non-zero otherwise.
+ */
+int clock_link_query(struct clock *c, struct port *p);
+
 /**
  * Obtains uds clock port
  * @param c    The clock instance.
@@ -359,6 +378,13 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress,
  */
 void clock_sync_interval(struct clock *c, int n);
 
+/**
+ * Obtains the timer wheel that drives the timers of a clock's ports.
+ * @param c  The clock instance.
+ * @return   A pointer to the clock's timer wheel.
+ */
+struct wheel *clock_timer_wheel(struct clock *c);
+
 /**
  * Obtain a clock's time properties data set.
  * @param c  The clock instance.
@@ -32,6 +32,8 @@
 #include "hash.h"
 #include "print.h"
 #include "util.h"
+#include "uring.h"
+#include "xdp.h"
 
 struct interface {
 	STAILQ_ENTRY(interface) list;
@@ -160,6 +162,7 @@ static struct config_enum dataset_comp_enu[] = {
 static struct config_enum delay_filter_enu[] = {
 	{ "moving_average", FILTER_MOVING_AVERAGE },
 	{ "moving_median",  FILTER_MOVING_MEDIAN  },
+	{ "heap_median",    FILTER_HEAP_MEDIAN    },
 	{ NULL, 0 },
 };
 
@@ -208,6 +211,20 @@ static struct config_enum tsproc_enu[] = {
 	{ NULL, 0 },
 };
 
+static struct config_enum uring_mode_enu[] = {
+	{ "off",    URING_OFF    },
+	{ "on",     URING_ON     },
+	{ "sqpoll", URING_SQPOLL },
+	{ NULL, 0 },
+};
+
+static struct config_enum xdp_mode_enu[] = {
+	{ "off",     XDP_MODE_OFF     },
+	{ "generic", XDP_MODE_GENERIC },
+	{ "native",  XDP_MODE_NATIVE  },
+	{ NULL, 0 },
+};
+
 static struct config_enum as_capable_enu[] = {
 	{ "true", AS_CAPABLE_TRUE },
 	{ "auto", AS_CAPABLE_AUTO },
@@ -260,18 +277,24 @@ struct config_item config_tab[] = {
 	PORT_ITEM_INT("inhibit_delay_req", 0, 0, 1),
 	PORT_ITEM_INT("inhibit_multicast_service", 0, 0, 1),
 	GLOB_ITEM_INT("initial_delay", 0, 0, INT_MAX),
+	PORT_ITEM_ENU("io_uring", URING_OFF, uring_mode_enu),
+	PORT_ITEM_INT("kernel_filter", 1, 0, 1),
 	GLOB_ITEM_INT("kernel_leap", 1, 0, 1),
 	GLOB_ITEM_STR("leapfile", NULL),
+	GLOB_ITEM_INT("linreg_max_size", 6, 2, 10),
 	PORT_ITEM_INT("logAnnounceInterval", 1, INT8_MIN, INT8_MAX),
 	PORT_ITEM_INT("logMinDelayReqInterval", 0, INT8_MIN, INT8_MAX),
 	PORT_ITEM_INT("logMinPdelayReqInterval", 0, INT8_MIN, INT8_MAX),
 	PORT_ITEM_INT("logSyncInterval", 0, INT8_MIN, INT8_MAX),
 	GLOB_ITEM_INT("logging_level", LOG_INFO, PRINT_LEVEL_MIN, PRINT_LEVEL_MAX),
+	GLOB_ITEM_INT("logging_ring_size", 0, 0, 1048576),
 	PORT_ITEM_INT("masterOnly", 0, 0, 1),
 	GLOB_ITEM_INT("maxStepsRemoved", 255, 2, UINT8_MAX),
 	GLOB_ITEM_STR("message_tag", NULL),
 	GLOB_ITEM_STR("manufacturerIdentity", "00:00:00"),
 	GLOB_ITEM_INT("max_frequency", 900000000, 0, INT_MAX),
+	GLOB_ITEM_INT("msg_pool_size", 0, 0, INT_MAX),
+	GLOB_ITEM_INT("msg_pool_strict", 0, 0, 1),
 	PORT_ITEM_INT("min_neighbor_prop_delay", -20000000, INT_MIN, -1),
 	PORT_ITEM_INT("msg_interval_request", 0, 0, 1),
 	PORT_ITEM_INT("neighborPropDelayThresh", 20000000, 0, INT_MAX),
@@ -296,6 +319,7 @@ struct config_item config_tab[] = {
 	PORT_ITEM_STR("ptp_dst_mac", "01:1B:19:00:00:00"),
 	PORT_ITEM_STR("p2p_dst_mac", "01:80:C2:00:00:0E"),
 	GLOB_ITEM_STR("revisionData", ";;"),
+	GLOB_ITEM_INT("rx_batch_size", 1, 1, 64),
 	GLOB_ITEM_INT("sanity_freq_limit", 200000000, 0, INT_MAX),
 	GLOB_ITEM_INT("servo_num_offset_values", 10, 0, INT_MAX),
 	GLOB_ITEM_INT("servo_offset_threshold", 0, 0, INT_MAX),
@@ -306,6 +330,8 @@ struct config_item config_tab[] = {
 	GLOB_ITEM_INT("summary_interval", 0, INT_MIN, INT_MAX),
 	PORT_ITEM_INT("syncReceiptTimeout", 0, 0, UINT8_MAX),
 	GLOB_ITEM_INT("tc_spanning_tree", 0, 0, 1),
+	GLOB_ITEM_STR("telemetry_file", ""),
+	GLOB_ITEM_INT("telemetry_size", 1024, 1, 1048576),
 	GLOB_ITEM_INT("timeSource", INTERNAL_OSCILLATOR, 0x10, 0xfe),
 	GLOB_ITEM_ENU("time_stamping", TS_HARDWARE, timestamping_enu),
 	PORT_ITEM_INT("transportSpecific", 0, 0, 0x0F),
@@ -320,6 +346,7 @@ struct config_item config_tab[] = {
 	GLOB_ITEM_INT("ts2phc.pulsewidth", 500000000, 1000000, 999000000),
 	PORT_ITEM_ENU("tsproc_mode", TSPROC_FILTER, tsproc_enu),
 	GLOB_ITEM_INT("twoStepFlag", 1, 0, 1),
+	GLOB_ITEM_INT("tx_timestamp_async", 0, 0, 1),
 	GLOB_ITEM_INT("tx_timestamp_timeout", 1, 1, INT_MAX),
 	PORT_ITEM_INT("udp_ttl", 1, 1, 255),
 	PORT_ITEM_INT("udp6_scope", 0x0E, 0x00, 0x0F),
@@ -327,11 +354,16 @@ struct config_item config_tab[] = {
 	PORT_ITEM_INT("unicast_listen", 0, 0, 1),
 	PORT_ITEM_INT("unicast_master_table", 0, 0, INT_MAX),
 	PORT_ITEM_INT("unicast_req_duration", 3600, 10, INT_MAX),
+	PORT_ITEM_DBL("update_rate", 1.0, 1e-9, DBL_MAX),
 	GLOB_ITEM_INT("use_syslog", 1, 0, 1),
 	GLOB_ITEM_STR("userDescription", ""),
 	GLOB_ITEM_INT("utc_offset", CURRENT_UTC_OFFSET, 0, INT_MAX),
 	GLOB_ITEM_INT("verbose", 0, 0, 1),
+	PORT_ITEM_INT("worker_cpu", -1, -1, INT_MAX),
+	GLOB_ITEM_INT("worker_threads", 0, 0, 1),
 	GLOB_ITEM_INT("write_phase_mode", 0, 0, 1),
+	PORT_ITEM_ENU("xdp_mode", XDP_MODE_OFF, xdp_mode_enu),
+	PORT_ITEM_INT("xdp_queue", 0, 0, INT_MAX),
 
 	GLOB_ITEM_INT("egress_vlan.tagged", 0, 0, 1),
 	GLOB_ITEM_INT("egress_vlan.id", 0, 0, 4095),
@@ -348,10 +380,7 @@ static struct config_item *config_section_item(struct config *cfg,
 					       const char *section,
 					       const char *name)
 {
-	char buf[CONFIG_LABEL_SIZE + MAX_IFNAME_SIZE];
-
-	snprintf(buf, sizeof(buf), "%s.%s", section, name);
-	return hash_lookup(cfg->htab, buf);
+	return hash_lookup_pair(cfg->htab, section, '.', name);
 }
 
 static struct config_item *config_global_item(struct config *cfg,
@@ -21,7 +21,6 @@
 #include "port.h"
 #include "port_private.h"
 #include "print.h"
-#include "rtnl.h"
 #include "tc.h"
 
 void e2e_dispatch(struct port *p, enum fsm_event event, int mdiff)
@@ -34,12 +33,12 @@ void e2e_dispatch(struct port *p, enum fsm_event event, int mdiff)
 		return;
 	}
 
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+	port_clr_tmo(p->timer[FD_ANNOUNCE_TIMER]);
+	port_clr_tmo(p->timer[FD_SYNC_RX_TIMER]);
 	/* Leave FD_DELAY_TIMER running. */
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(p->timer[FD_QUALIFICATION_TIMER]);
+	port_clr_tmo(p->timer[FD_MANNO_TIMER]);
+	port_clr_tmo(p->timer[FD_SYNC_TX_TIMER]);
 
 	/*
 	 * Handle the side effects of the state transition.
@@ -74,73 +73,15 @@ void e2e_dispatch(struct port *p, enum fsm_event event, int mdiff)
 	};
 }
 
-enum fsm_event e2e_event(struct port *p, int fd_index)
+/*
+ * Forwards one received message and releases it.
+ */
+static enum fsm_event e2e_rx(struct port *p, struct ptp_message *msg,
+			     int cnt)
 {
-	int cnt, fd = p->fda.fd[fd_index];
 	enum fsm_event event = EV_NONE;
-	struct ptp_message *msg, *dup;
+	struct ptp_message *dup;
 
-	switch (fd_index) {
-	case FD_ANNOUNCE_TIMER:
-	case FD_SYNC_RX_TIMER:
-		pr_debug("port %hu: %s timeout", portnum(p),
-			 fd_index == FD_SYNC_RX_TIMER ? "rx sync" : "announce");
-		if (p->best) {
-			fc_clear(p->best);
-		}
-		port_set_announce_tmo(p);
-		return EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES;
-
-	case FD_DELAY_TIMER:
-		pr_debug("port %hu: delay timeout", portnum(p));
-		port_set_delay_tmo(p);
-		delay_req_prune(p);
-		tc_prune(p);
-		if (!clock_free_running(p->clock)) {
-			switch (p->state) {
-			case PS_UNCALIBRATED:
-			case PS_SLAVE:
-				if (port_delay_request(p)) {
-					event = EV_FAULT_DETECTED;
-				}
-				break;
-			default:
-				break;
-			};
-		}
-		return event;
-
-	case FD_QUALIFICATION_TIMER:
-		pr_debug("port %hu: qualification timeout", portnum(p));
-		return EV_QUALIFICATION_TIMEOUT_EXPIRES;
-
-	case FD_MANNO_TIMER:
-	case FD_SYNC_TX_TIMER:
-	case FD_UNICAST_REQ_TIMER:
-	case FD_UNICAST_SRV_TIMER:
-		pr_err("unexpected timer expiration");
-		return EV_NONE;
-
-	case FD_RTNL:
-		pr_debug("port %hu: received link status notification", portnum(p));
-		rtnl_link_status(fd, p->name, port_link_status, p);
-		if (p->link_status == (LINK_UP|LINK_STATE_CHANGED)) {
-			return EV_FAULT_CLEARED;
-		} else if ((p->link_status == (LINK_DOWN|LINK_STATE_CHANGED)) ||
-			   (p->link_status & TS_LABEL_CHANGED)) {
-			return EV_FAULT_DETECTED;
-		} else {
-			return EV_NONE;
-		}
-	}
-
-	msg = msg_allocate();
-	if (!msg) {
-		return EV_FAULT_DETECTED;
-	}
-	msg->hwts.type = p->timestamping;
-
-	cnt = transport_recv(p->trp, fd, msg);
 	if (cnt <= 0) {
 		pr_err("port %hu: recv message failed", portnum(p));
 		msg_put(msg);
@@ -236,3 +177,64 @@ enum fsm_event e2e_event(struct port *p, int fd_index)
 	}
 	return event;
 }
+
+enum fsm_event e2e_event(struct port *p, int fd_index)
+{
+	enum fsm_event event = EV_NONE;
+	int fd = p->fda.fd[fd_index];
+
+	switch (fd_index) {
+	case FD_ANNOUNCE_TIMER:
+	case FD_SYNC_RX_TIMER:
+		pr_debug("port %hu: %s timeout", portnum(p),
+			 fd_index == FD_SYNC_RX_TIMER ? "rx sync" : "announce");
+		if (p->best) {
+			fc_clear(p->best);
+		}
+		port_set_announce_tmo(p);
+		return EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES;
+
+	case FD_DELAY_TIMER:
+		pr_debug("port %hu: delay timeout", portnum(p));
+		port_set_delay_tmo(p);
+		delay_req_prune(p);
+		tc_prune(p);
+		if (!clock_free_running(p->clock)) {
+			switch (p->state) {
+			case PS_UNCALIBRATED:
+			case PS_SLAVE:
+				if (port_delay_request(p)) {
+					event = EV_FAULT_DETECTED;
+				}
+				break;
+			default:
+				break;
+			};
+		}
+		return event;
+
+	case FD_QUALIFICATION_TIMER:
+		pr_debug("port %hu: qualification timeout", portnum(p));
+		return EV_QUALIFICATION_TIMEOUT_EXPIRES;
+
+	case FD_MANNO_TIMER:
+	case FD_SYNC_TX_TIMER:
+	case FD_UNICAST_REQ_TIMER:
+	case FD_UNICAST_SRV_TIMER:
+		pr_err("unexpected timer expiration");
+		return EV_NONE;
+
+	case FD_RTNL:
+		pr_debug("port %hu: received link status notification", portnum(p));
+		if (p->link_status == (LINK_UP|LINK_STATE_CHANGED)) {
+			return EV_FAULT_CLEARED;
+		} else if ((p->link_status == (LINK_DOWN|LINK_STATE_CHANGED)) ||
+			   (p->link_status & TS_LABEL_CHANGED)) {
+			return EV_FAULT_DETECTED;
+		} else {
+			return EV_NONE;
+		}
+	}
+
+	return port_rx_batch(p, fd, e2e_rx);
+}
@@ -20,13 +20,18 @@
 #ifndef HAVE_FD_H
 #define HAVE_FD_H
 
-#define N_TIMER_FDS 8
+#define N_TIMER_FDS 9
 
 /*
  * The order matters here.  The DELAY timer must appear before the
  * ANNOUNCE and SYNC_RX timers in order to correctly handle the case
  * when the DELAY timer and one of the other two expire during the
  * same call to poll().
+ *
+ * The timers are kept in the clock's timer wheel, and the link status
+ * comes from the clock's shared netlink socket, so their slots in the
+ * fdarray always hold -1. Their indices still identify the events
+ * passed to the ports.
  */
 enum {
 	FD_EVENT,
@@ -39,6 +44,7 @@ enum {
 	FD_SYNC_TX_TIMER,
 	FD_UNICAST_REQ_TIMER,
 	FD_UNICAST_SRV_TIMER,
+	FD_TX_TIMER,
 	FD_RTNL,
 	N_POLLFD,
 };
@@ -18,6 +18,7 @@
  */
 
 #include "filter_private.h"
+#include "hmedian.h"
 #include "mave.h"
 #include "mmedian.h"
 
@@ -28,6 +29,8 @@ struct filter *filter_create(enum filter_type type, int length)
 		return mave_create(length);
 	case FILTER_MOVING_MEDIAN:
 		return mmedian_create(length);
+	case FILTER_HEAP_MEDIAN:
+		return hmedian_create(length);
 	default:
 		return NULL;
 	}
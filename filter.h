@@ -31,6 +31,7 @@ struct filter;
 enum filter_type {
 	FILTER_MOVING_AVERAGE,
 	FILTER_MOVING_MEDIAN,
+	FILTER_HEAP_MEDIAN,
 };
 
 /**
@@ -33,6 +33,12 @@ struct foreign_clock {
 	 */
 	LIST_ENTRY(foreign_clock) list;
 
+	/**
+	 * Pointer to next foreign_clock in the same bucket of the
+	 * port's index of foreign masters.
+	 */
+	LIST_ENTRY(foreign_clock) index;
+
 	/**
 	 * A list of received announce messages.
 	 *
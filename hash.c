@@ -22,92 +22,177 @@
 
 #include "hash.h"
 
-#define HASH_TABLE_SIZE 200
+/*
+ * Open addressing with linear probing. The size is always a power of
+ * two, and the table doubles whenever it becomes three quarters full.
+ * Each node remembers the hash of its key, so that growing the table
+ * and probing past other keys never touch the strings.
+ */
+#define HASH_MIN_SIZE	64
+#define FNV_OFFSET	2166136261U
+#define FNV_PRIME	16777619U
 
 struct node {
 	char *key;
 	void *data;
-	struct node *next;
+	unsigned int hash;
 };
 
 struct hash {
-	struct node *table[HASH_TABLE_SIZE];
+	struct node *table;
+	unsigned int size;
+	unsigned int count;
 };
 
-static unsigned int hash_function(const char* s)
+static unsigned int hash_update(unsigned int h, const char *s)
 {
-	unsigned int i;
+	for (; *s; s++) {
+		h ^= (unsigned char) *s;
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+static unsigned int hash_pair(const char *first, char sep, const char *second)
+{
+	unsigned int h = hash_update(FNV_OFFSET, first);
+	char sbuf[2] = { sep, 0 };
+
+	if (second) {
+		h = hash_update(h, sbuf);
+		h = hash_update(h, second);
+	}
+	return h;
+}
+
+/* Compares a stored key with "first", or with "first" sep "second". */
+static int hash_match(const char *key, const char *first, char sep,
+		      const char *second)
+{
+	size_t len = strlen(first);
+
+	if (strncmp(key, first, len)) {
+		return 0;
+	}
+	if (!second) {
+		return !key[len];
+	}
+	return key[len] == sep && !strcmp(key + len + 1, second);
+}
+
+/* Returns the node holding the key, or the empty node where it belongs. */
+static struct node *hash_slot(struct hash *ht, unsigned int h,
+			      const char *first, char sep, const char *second)
+{
+	unsigned int i, mask = ht->size - 1;
+	struct node *n;
+
+	for (i = h & mask; ; i = (i + 1) & mask) {
+		n = &ht->table[i];
+		if (!n->key ||
+		    (n->hash == h && hash_match(n->key, first, sep, second))) {
+			return n;
+		}
+	}
+}
 
-	for (i = 0; *s; s++) {
-		i = 131 * i + *s;
+static int hash_grow(struct hash *ht)
+{
+	unsigned int i, j, mask, size = ht->size * 2;
+	struct node *table;
+
+	table = calloc(size, sizeof(*table));
+	if (!table) {
+		return -1;
+	}
+	mask = size - 1;
+	for (i = 0; i < ht->size; i++) {
+		if (!ht->table[i].key) {
+			continue;
+		}
+		for (j = ht->table[i].hash & mask; table[j].key; j = (j + 1) & mask)
+			;
+		table[j] = ht->table[i];
 	}
-	return i % HASH_TABLE_SIZE;
+	free(ht->table);
+	ht->table = table;
+	ht->size = size;
+	return 0;
 }
 
 struct hash *hash_create(void)
 {
 	struct hash *ht = calloc(1, sizeof(*ht));
+
+	if (!ht) {
+		return NULL;
+	}
+	ht->table = calloc(HASH_MIN_SIZE, sizeof(*ht->table));
+	if (!ht->table) {
+		free(ht);
+		return NULL;
+	}
+	ht->size = HASH_MIN_SIZE;
 	return ht;
 }
 
 void hash_destroy(struct hash *ht, void (*func)(void *))
 {
 	unsigned int i;
-	struct node *n, *next, **table = ht->table;
-
-	for (i = 0; i < HASH_TABLE_SIZE; i++) {
-		for (n = table[i] ; n; n = next) {
-			next = n->next;
-			if (func) {
-				func(n->data);
-			}
-			free(n->key);
-			free(n);
+	struct node *n;
+
+	for (i = 0; i < ht->size; i++) {
+		n = &ht->table[i];
+		if (!n->key) {
+			continue;
 		}
+		if (func) {
+			func(n->data);
+		}
+		free(n->key);
 	}
 
+	free(ht->table);
 	free(ht);
 }
 
 int hash_insert(struct hash *ht, const char* key, void *data)
 {
 	unsigned int h;
-	struct node *n, **table = ht->table;
-
-	h = hash_function(key);
+	struct node *n;
 
-	for (n = table[h] ; n; n = n->next) {
-		if (!strcmp(n->key, key)) {
-			/* reject duplicate keys */
-			return -1;
-		}
+	if (4 * (ht->count + 1) > 3 * ht->size && hash_grow(ht)) {
+		return -1;
 	}
-	n = calloc(1, sizeof(*n));
-	if (!n) {
+	h = hash_pair(key, 0, NULL);
+	n = hash_slot(ht, h, key, 0, NULL);
+	if (n->key) {
+		/* reject duplicate keys */
 		return -1;
 	}
 	n->key = strdup(key);
 	if (!n->key) {
-		free(n);
 		return -1;
 	}
 	n->data = data;
-	n->next = table[h];
-	table[h] = n;
+	n->hash = h;
+	ht->count++;
 	return 0;
 }
 
 void *hash_lookup(struct hash *ht, const char* key)
 {
-	unsigned int h;
-	struct node *n, **table = ht->table;
+	struct node *n;
 
-	h = hash_function(key);
+	n = hash_slot(ht, hash_pair(key, 0, NULL), key, 0, NULL);
+	return n->data;
+}
 
-	for (n = table[h] ; n; n = n->next) {
-		if (!strcmp(n->key, key)) {
-			return n->data;
-		}
-	}
-	return NULL;
+void *hash_lookup_pair(struct hash *ht, const char *first, char sep,
+		       const char *second)
+{
+	struct node *n;
+
+	n = hash_slot(ht, hash_pair(first, sep, second), first, sep, second);
+	return n->data;
 }
@@ -54,6 +54,18 @@ int hash_insert(struct hash *ht, const char* key, void *data);
  */
 void *hash_lookup(struct hash *ht, const char* key);
 
+/**
+ * Looks up an element whose key is made of two strings joined by a
+ * separator, without building the combined key.
+ * @param ht     Hash table to consult.
+ * @param first  The first part of the key.
+ * @param sep    The character between the two parts.
+ * @param second The second part of the key.
+ * @return  Pointer to the element's data, or NULL if the key is not found.
+ */
+void *hash_lookup_pair(struct hash *ht, const char *first, char sep,
+		       const char *second);
+
 #endif
 
 
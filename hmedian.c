@@ -0,0 +1,218 @@
+/**
+ * @file hmedian.c
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "hmedian.h"
+#include "filter_private.h"
+
+/*
+ * The lower half of the samples is kept in a max-heap and the upper
+ * half in a min-heap, so that the median is found at the roots. The
+ * lower heap holds the extra sample when the count is odd. Each sample
+ * remembers its place in the heaps, and the oldest one is replaced in
+ * place by the newest one, which takes O(log n) steps.
+ */
+enum { LO, HI };
+
+struct heap {
+	/* Indices into the circular buffer. */
+	int *idx;
+	int size;
+};
+
+struct hmedian {
+	struct filter filter;
+	int cnt;
+	int len;
+	int index;
+	struct heap heap[2];
+	/* Heap and position within the heap of each sample. */
+	int *which;
+	int *pos;
+	/* Values stored in circular buffer. */
+	tmv_t *samples;
+};
+
+/* Tells whether the sample at 'a' belongs above the one at 'b'. */
+static int hmedian_above(struct hmedian *m, int h, int a, int b)
+{
+	int diff = tmv_cmp(m->samples[a], m->samples[b]);
+
+	return h == LO ? diff > 0 : diff < 0;
+}
+
+static void hmedian_place(struct hmedian *m, int h, int pos, int index)
+{
+	m->heap[h].idx[pos] = index;
+	m->which[index] = h;
+	m->pos[index] = pos;
+}
+
+static void hmedian_sift_up(struct hmedian *m, int h, int pos)
+{
+	struct heap *heap = &m->heap[h];
+	int parent, index = heap->idx[pos];
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (!hmedian_above(m, h, index, heap->idx[parent]))
+			break;
+		hmedian_place(m, h, pos, heap->idx[parent]);
+		pos = parent;
+	}
+	hmedian_place(m, h, pos, index);
+}
+
+static void hmedian_sift_down(struct hmedian *m, int h, int pos)
+{
+	struct heap *heap = &m->heap[h];
+	int child, index = heap->idx[pos];
+
+	while ((child = 2 * pos + 1) < heap->size) {
+		if (child + 1 < heap->size &&
+		    hmedian_above(m, h, heap->idx[child + 1], heap->idx[child]))
+			child++;
+		if (!hmedian_above(m, h, heap->idx[child], index))
+			break;
+		hmedian_place(m, h, pos, heap->idx[child]);
+		pos = child;
+	}
+	hmedian_place(m, h, pos, index);
+}
+
+static void hmedian_push(struct hmedian *m, int h, int index)
+{
+	struct heap *heap = &m->heap[h];
+
+	hmedian_place(m, h, heap->size++, index);
+	hmedian_sift_up(m, h, heap->size - 1);
+}
+
+static int hmedian_pop(struct hmedian *m, int h)
+{
+	struct heap *heap = &m->heap[h];
+	int index = heap->idx[0];
+
+	heap->size--;
+	if (heap->size) {
+		hmedian_place(m, h, 0, heap->idx[heap->size]);
+		hmedian_sift_down(m, h, 0);
+	}
+	return index;
+}
+
+/* Swaps the roots while the two halves overlap. */
+static void hmedian_order(struct hmedian *m)
+{
+	int lo, hi;
+
+	if (!m->heap[HI].size)
+		return;
+	lo = m->heap[LO].idx[0];
+	hi = m->heap[HI].idx[0];
+	if (tmv_cmp(m->samples[lo], m->samples[hi]) <= 0)
+		return;
+	hmedian_place(m, LO, 0, hi);
+	hmedian_place(m, HI, 0, lo);
+	hmedian_sift_down(m, LO, 0);
+	hmedian_sift_down(m, HI, 0);
+}
+
+static void hmedian_destroy(struct filter *filter)
+{
+	struct hmedian *m = container_of(filter, struct hmedian, filter);
+	free(m->heap[LO].idx);
+	free(m->heap[HI].idx);
+	free(m->which);
+	free(m->pos);
+	free(m->samples);
+	free(m);
+}
+
+static tmv_t hmedian_sample(struct filter *filter, tmv_t sample)
+{
+	struct hmedian *m = container_of(filter, struct hmedian, filter);
+	int h, index = m->index;
+
+	m->samples[index] = sample;
+	if (m->cnt < m->len) {
+		m->cnt++;
+		if (!m->heap[LO].size ||
+		    tmv_cmp(sample, m->samples[m->heap[LO].idx[0]]) <= 0)
+			hmedian_push(m, LO, index);
+		else
+			hmedian_push(m, HI, index);
+
+		/* Rebalance the halves. */
+		if (m->heap[LO].size > m->heap[HI].size + 1)
+			hmedian_push(m, HI, hmedian_pop(m, LO));
+		else if (m->heap[HI].size > m->heap[LO].size)
+			hmedian_push(m, LO, hmedian_pop(m, HI));
+	} else {
+		/* The new value takes the place of the replaced one. */
+		h = m->which[index];
+		hmedian_sift_up(m, h, m->pos[index]);
+		hmedian_sift_down(m, h, m->pos[index]);
+		hmedian_order(m);
+	}
+
+	m->index = (1 + m->index) % m->len;
+
+	if (m->cnt % 2)
+		return m->samples[m->heap[LO].idx[0]];
+	else
+		return tmv_div(tmv_add(m->samples[m->heap[LO].idx[0]],
+				       m->samples[m->heap[HI].idx[0]]), 2);
+}
+
+static void hmedian_reset(struct filter *filter)
+{
+	struct hmedian *m = container_of(filter, struct hmedian, filter);
+	m->cnt = 0;
+	m->index = 0;
+	m->heap[LO].size = 0;
+	m->heap[HI].size = 0;
+}
+
+struct filter *hmedian_create(int length)
+{
+	struct hmedian *m;
+
+	if (length < 1)
+		return NULL;
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+	m->filter.destroy = hmedian_destroy;
+	m->filter.sample = hmedian_sample;
+	m->filter.reset = hmedian_reset;
+	m->heap[LO].idx = calloc(1, (length / 2 + 1) * sizeof(int));
+	m->heap[HI].idx = calloc(1, (length / 2 + 1) * sizeof(int));
+	m->which = calloc(1, length * sizeof(*m->which));
+	m->pos = calloc(1, length * sizeof(*m->pos));
+	m->samples = calloc(1, length * sizeof(*m->samples));
+	if (!m->heap[LO].idx || !m->heap[HI].idx || !m->which || !m->pos ||
+	    !m->samples) {
+		hmedian_destroy(&m->filter);
+		return NULL;
+	}
+	m->len = length;
+	return &m->filter;
+}
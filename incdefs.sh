@@ -86,6 +86,19 @@ kernel_flags()
 	if grep -q HWTSTAMP_TX_ONESTEP_P2P ${prefix}${tstamp}; then
 		printf " -DHAVE_ONESTEP_P2P"
 	fi
+
+	# AF_XDP sockets, with XDP programs attached through BPF links.
+	if grep -q XDP_UMEM_REG ${prefix}/usr/include/linux/if_xdp.h 2>/dev/null &&
+	   grep -q BPF_LINK_CREATE ${prefix}/usr/include/linux/bpf.h 2>/dev/null; then
+		printf " -DHAVE_AF_XDP"
+	fi
+
+	# io_uring with multishot receives into a provided buffer ring.
+	if grep -q IORING_RECV_MULTISHOT ${prefix}/usr/include/linux/io_uring.h 2>/dev/null &&
+	   grep -q IORING_REGISTER_PBUF_RING ${prefix}/usr/include/linux/io_uring.h 2>/dev/null &&
+	   grep -q IORING_OP_SEND_ZC ${prefix}/usr/include/linux/io_uring.h 2>/dev/null; then
+		printf " -DHAVE_IO_URING"
+	fi
 }
 
 flags="$(user_flags)$(kernel_flags)"
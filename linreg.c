@@ -18,15 +18,17 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#include "config.h"
 #include "linreg.h"
 #include "print.h"
 #include "servo_private.h"
 
 /* Maximum and minimum number of points used in regression,
    defined as a power of 2 */
-#define MAX_SIZE 6
+#define MAX_SIZE 10
 #define MIN_SIZE 2
 
 #define MAX_POINTS (1 << MAX_SIZE)
@@ -37,6 +39,8 @@
 #define ERR_INITIAL_UPDATES 10
 /* Maximum ratio of two err values to be considered equal */
 #define ERR_EQUALS 1.05
+/* Number of samples after which the sums are recomputed from scratch */
+#define RESUM_INTERVAL MAX_POINTS
 
 /* Uncorrected local time vs remote time */
 struct point {
@@ -45,6 +49,15 @@ struct point {
 	double w;
 };
 
+/* Weighted sums over the points of one size, relative to the reference */
+struct sums {
+	double x;
+	double y;
+	double xy;
+	double x2;
+	double w;
+};
+
 struct result {
 	/* Slope and intercept from latest regression */
 	double slope;
@@ -69,8 +82,14 @@ struct linreg_servo {
 	double x_remainder;
 	/* Local time stamp of last update */
 	uint64_t last_update;
+	/* Running sums for all sizes */
+	struct sums sums[MAX_SIZE - MIN_SIZE + 1];
+	/* Samples added since the sums were last recomputed */
+	unsigned int resum_count;
 	/* Regression results for all sizes */
 	struct result results[MAX_SIZE - MIN_SIZE + 1];
+	/* Largest size in use */
+	unsigned int max_size;
 	/* Selected size */
 	unsigned int size;
 	/* Current frequency offset of the clock */
@@ -91,16 +110,24 @@ static void linreg_destroy(struct servo *servo)
 
 static void move_reference(struct linreg_servo *s, int64_t x, int64_t y)
 {
+	double dx = x, dy = y;
 	struct result *res;
+	struct sums *sum;
 	unsigned int i;
 
 	s->reference.x += x;
 	s->reference.y += y;
 
-	/* Update intercepts for new reference */
-	for (i = MIN_SIZE; i <= MAX_SIZE; i++) {
+	/* Update intercepts and sums for new reference */
+	for (i = MIN_SIZE; i <= s->max_size; i++) {
 		res = &s->results[i - MIN_SIZE];
 		res->intercept += x * res->slope - y;
+
+		sum = &s->sums[i - MIN_SIZE];
+		sum->xy += dx * dy * sum->w - dy * sum->x - dx * sum->y;
+		sum->x2 += dx * (dx * sum->w - 2.0 * sum->x);
+		sum->x -= dx * sum->w;
+		sum->y -= dy * sum->w;
 	}
 }
 
@@ -123,36 +150,93 @@ static void update_reference(struct linreg_servo *s, uint64_t local_ts)
 	s->last_update = local_ts;
 }
 
+static void sums_add(struct sums *sum, double x, double y, double w)
+{
+	sum->x += x * w;
+	sum->y += y * w;
+	sum->xy += x * y * w;
+	sum->x2 += x * x * w;
+	sum->w += w;
+}
+
+/*
+ * Recomputes the sums of all sizes from the stored points, which
+ * discards the rounding errors accumulated by the running updates.
+ */
+static void resum(struct linreg_servo *s)
+{
+	struct sums sum = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+	unsigned int i = 0, l, n, size;
+	double x, y;
+
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
+		n = 1 << size;
+		for (; i < n && i < s->num_points; i++) {
+			/* Iterate points from newest to oldest */
+			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
+
+			x = (int64_t)(s->points[l].x - s->reference.x);
+			y = (int64_t)(s->points[l].y - s->reference.y);
+			sums_add(&sum, x, y, s->points[l].w);
+		}
+		s->sums[size - MIN_SIZE] = sum;
+	}
+	s->resum_count = 0;
+}
+
 static void add_sample(struct linreg_servo *s, int64_t offset, double weight)
 {
+	unsigned int l, n, size;
+	struct point *p;
+	double x, y;
+
 	s->last_point = (s->last_point + 1) % MAX_POINTS;
 
+	/* Drop the oldest point from each size that is already full. */
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
+		n = 1 << size;
+		if (n > s->num_points)
+			break;
+		l = (MAX_POINTS + s->last_point - n) % MAX_POINTS;
+		p = &s->points[l];
+		x = (int64_t)(p->x - s->reference.x);
+		y = (int64_t)(p->y - s->reference.y);
+		sums_add(&s->sums[size - MIN_SIZE], x, y, -p->w);
+	}
+
 	s->points[s->last_point].x = s->reference.x;
 	s->points[s->last_point].y = s->reference.y - offset;
 	s->points[s->last_point].w = weight;
 
 	if (s->num_points < MAX_POINTS)
 		s->num_points++;
+
+	if (++s->resum_count >= RESUM_INTERVAL) {
+		resum(s);
+		return;
+	}
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
+		sums_add(&s->sums[size - MIN_SIZE], 0.0, -offset, weight);
+	}
 }
 
 static void regress(struct linreg_servo *s)
 {
-	double x, y, y0, e, x_sum, y_sum, xy_sum, x2_sum, w, w_sum;
-	unsigned int i, l, n, size;
+	double y0, e;
+	unsigned int n, size;
 	struct result *res;
-
-	x_sum = 0.0, y_sum = 0.0, xy_sum = 0.0, x2_sum = 0.0; w_sum = 0.0;
-	i = 0;
+	struct sums *sum;
 
 	y0 = (int64_t)(s->points[s->last_point].y - s->reference.y);
 
-	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
 		n = 1 << size;
 		if (n > s->num_points)
 			/* Not enough points for this size */
 			break;
 
 		res = &s->results[size - MIN_SIZE];
+		sum = &s->sums[size - MIN_SIZE];
 
 		/* Update moving average of the prediction error */
 		if (res->slope) {
@@ -167,25 +251,10 @@ static void regress(struct linreg_servo *s)
 			}
 		}
 
-		for (; i < n; i++) {
-			/* Iterate points from newest to oldest */
-			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
-
-			x = (int64_t)(s->points[l].x - s->reference.x);
-			y = (int64_t)(s->points[l].y - s->reference.y);
-			w = s->points[l].w;
-
-			x_sum += x * w;
-			y_sum += y * w;
-			xy_sum += x * y * w;
-			x2_sum += x * x * w;
-			w_sum += w;
-		}
-
 		/* Get new intercept and slope */
-		res->slope = (xy_sum - x_sum * y_sum / w_sum) /
-				(x2_sum - x_sum * x_sum / w_sum);
-		res->intercept = (y_sum - res->slope * x_sum) / w_sum;
+		res->slope = (sum->xy - sum->x * sum->y / sum->w) /
+				(sum->x2 - sum->x * sum->x / sum->w);
+		res->intercept = (sum->y - res->slope * sum->x) / sum->w;
 	}
 }
 
@@ -200,7 +269,7 @@ static void update_size(struct linreg_servo *s)
 	best_size = 0;
 	best_err = 0.0;
 
-	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+	for (size = MIN_SIZE; size <= s->max_size; size++) {
 		res = &s->results[size - MIN_SIZE];
 		if ((!best_size && res->slope) ||
 		    (best_err * ERR_EQUALS > res->err &&
@@ -302,6 +371,8 @@ static void linreg_reset(struct servo *servo)
 	s->last_update = 0;
 	s->size = 0;
 	s->frequency_ratio = 1.0;
+	s->resum_count = 0;
+	memset(s->sums, 0, sizeof(s->sums));
 
 	for (i = MIN_SIZE; i <= MAX_SIZE; i++) {
 		s->results[i - MIN_SIZE].slope = 0.0;
@@ -330,7 +401,7 @@ static void linreg_leap(struct servo *servo, int leap)
 	s->leap = leap;
 }
 
-struct servo *linreg_servo_create(int fadj)
+struct servo *linreg_servo_create(struct config *cfg, int fadj)
 {
 	struct linreg_servo *s;
 
@@ -347,6 +418,7 @@ struct servo *linreg_servo_create(int fadj)
 
 	s->clock_freq = -fadj;
 	s->frequency_ratio = 1.0;
+	s->max_size = config_get_int(cfg, NULL, "linreg_max_size");
 
 	return &s->servo;
 }
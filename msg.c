@@ -19,7 +19,9 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <time.h>
 
 #include "contain.h"
@@ -42,11 +44,34 @@ struct message_storage {
 	struct ptp_message msg;
 } PACKED;
 
+/*
+ * Slab entries have the layout of message_storage, but are not packed,
+ * so that the messages in them may be linked into the pool directly.
+ * The extra room in front lets the kernel place its headers there when
+ * a transport receives into a lent message.
+ */
+struct message_slot {
+	unsigned char lend_room[MSG_LEND_HEADROOM - MSG_HEADROOM];
+	unsigned char reserved[MSG_HEADROOM];
+	struct ptp_message msg;
+};
+
 static TAILQ_HEAD(msg_pool, ptp_message) msg_pool = TAILQ_HEAD_INITIALIZER(msg_pool);
 
+/*
+ * When a slab is configured, the pool holds exactly the messages of
+ * the slab. Messages taken from the heap on exhaustion are freed
+ * again when released, so the pool never grows.
+ */
+static struct message_slot *msg_slab;
+static size_t msg_slab_len;
+static int msg_slab_size;
+static int msg_slab_strict;
+
 static struct {
 	int total;
 	int count;
+	struct msg_pool_stats np;
 } pool_stats;
 
 #ifdef DEBUG_POOL
@@ -258,17 +283,26 @@ static void timestamp_pre_send(struct Timestamp *ts)
 
 /* public methods */
 
+static int msg_in_slab(struct ptp_message *m)
+{
+	struct message_slot *s = container_of(m, struct message_slot, msg);
+
+	return msg_slab && s >= msg_slab && s < msg_slab + msg_slab_size;
+}
+
 struct ptp_message *msg_allocate(void)
 {
 	struct message_storage *s;
 	struct ptp_message *m = TAILQ_FIRST(&msg_pool);
 
+	pool_stats.np.allocations++;
 	if (m) {
 		TAILQ_REMOVE(&msg_pool, m, list);
 		pool_stats.count--;
 		pool_debug("dequeue", m);
 	} else {
-		s = malloc(sizeof(*s));
+		pool_stats.np.misses++;
+		s = msg_slab_strict ? NULL : malloc(sizeof(*s));
 		if (s) {
 			m = &s->msg;
 			pool_stats.total++;
@@ -279,6 +313,10 @@ struct ptp_message *msg_allocate(void)
 		memset(m, 0, sizeof(*m));
 		m->refcnt = 1;
 		TAILQ_INIT(&m->tlv_list);
+		pool_stats.np.in_use++;
+		if (pool_stats.np.in_use > pool_stats.np.high_water) {
+			pool_stats.np.high_water = pool_stats.np.in_use;
+		}
 	}
 
 	return m;
@@ -293,9 +331,62 @@ void msg_cleanup(void)
 
 	while ((m = TAILQ_FIRST(&msg_pool)) != NULL) {
 		TAILQ_REMOVE(&msg_pool, m, list);
-		s = container_of(m, struct message_storage, msg);
-		free(s);
+		if (!msg_in_slab(m)) {
+			s = container_of(m, struct message_storage, msg);
+			free(s);
+		}
+	}
+	if (msg_slab) {
+		munmap(msg_slab, msg_slab_len);
+	}
+	msg_slab = NULL;
+	msg_slab_len = 0;
+	msg_slab_size = 0;
+}
+
+int msg_pool_init(int size, int strict)
+{
+	int i;
+
+	if (msg_slab) {
+		return -1;
+	}
+	msg_slab_strict = size ? strict : 0;
+	if (!size) {
+		return 0;
+	}
+	/* Page aligned, so that it may be registered with the kernel. */
+	msg_slab_len = size * sizeof(*msg_slab);
+	msg_slab = mmap(NULL, msg_slab_len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (msg_slab == MAP_FAILED) {
+		msg_slab = NULL;
+		return -1;
 	}
+	msg_slab_size = size;
+	for (i = 0; i < size; i++) {
+		TAILQ_INSERT_TAIL(&msg_pool, &msg_slab[i].msg, list);
+	}
+	pool_stats.total += size;
+	pool_stats.count += size;
+	pool_stats.np.size = size;
+	return 0;
+}
+
+void msg_pool_stats(struct msg_pool_stats *stats)
+{
+	*stats = pool_stats.np;
+}
+
+int msg_lendable(struct ptp_message *m)
+{
+	return msg_in_slab(m);
+}
+
+void *msg_slab_area(size_t *len)
+{
+	*len = msg_slab_len;
+	return msg_slab;
 }
 
 struct ptp_message *msg_duplicate(struct ptp_message *msg, int cnt)
@@ -583,9 +674,16 @@ void msg_put(struct ptp_message *m)
 	if (m->refcnt) {
 		return;
 	}
+	pool_stats.np.in_use--;
+	msg_tlv_recycle(m);
+	if (msg_slab && !msg_in_slab(m)) {
+		pool_stats.total--;
+		pool_debug("free", m);
+		free(container_of(m, struct message_storage, msg));
+		return;
+	}
 	pool_stats.count++;
 	pool_debug("recycle", m);
-	msg_tlv_recycle(m);
 	TAILQ_INSERT_HEAD(&msg_pool, m, list);
 }
 
@@ -327,6 +327,64 @@ struct ptp_message *msg_allocate(void);
  */
 void msg_cleanup(void);
 
+/**
+ * Statistics of the message cache.
+ */
+struct msg_pool_stats {
+	uint64_t allocations; /* calls to msg_allocate() */
+	uint64_t misses;      /* allocations not served by the cache */
+	uint32_t size;        /* number of preallocated messages */
+	uint32_t in_use;      /* messages currently allocated */
+	uint32_t high_water;  /* largest value of in_use */
+};
+
+/**
+ * Preallocate the message cache. Without a call to this function, the
+ * cache starts empty and grows on demand without bound.
+ *
+ * @param size    The number of messages to preallocate, or zero to keep
+ *                the cache growing on demand.
+ * @param strict  When non-zero, msg_allocate() fails once the
+ *                preallocated messages run out, instead of falling
+ *                back to the heap.
+ * @return        Zero on success, non-zero otherwise.
+ */
+int msg_pool_init(int size, int strict);
+
+/**
+ * Obtain the statistics of the message cache.
+ * @param stats  Buffer to hold the statistics.
+ */
+void msg_pool_stats(struct msg_pool_stats *stats);
+
+/**
+ * The number of bytes in front of a lendable message which belong to
+ * it, see msg_lendable().
+ */
+#define MSG_LEND_HEADROOM 576
+
+/**
+ * Tell whether a message may be lent to the kernel, for a transport
+ * to receive into it directly. Only the preallocated messages may be
+ * lent. Their data field and MSG_LEND_HEADROOM bytes in front of the
+ * message may be written by the kernel, as long as the message is
+ * lent.
+ *
+ * @param m  A message obtained using @ref msg_allocate().
+ * @return   Non-zero if the message may be lent.
+ */
+int msg_lendable(struct ptp_message *m);
+
+/**
+ * Obtain the memory holding the preallocated messages, for registering
+ * it with the kernel.
+ *
+ * @param len  Returns the length of the memory in bytes.
+ * @return     The page aligned start of the memory, or NULL if there
+ *             are no preallocated messages.
+ */
+void *msg_slab_area(size_t *len);
+
 /**
  * Duplicate a message instance.
  *
@@ -22,6 +22,7 @@
 
 enum notification {
 	NOTIFY_PORT_STATE,
+	NOTIFY_MAX,
 };
 
 #endif
@@ -24,6 +24,9 @@
 #include <limits.h>
 #include <net/if.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -47,11 +50,13 @@
 #include "phc.h"
 #include "pi.h"
 #include "pmc_common.h"
+#include "pqueue.h"
 #include "print.h"
 #include "servo.h"
 #include "sk.h"
 #include "stats.h"
 #include "sysoff.h"
+#include "telemetry.h"
 #include "tlv.h"
 #include "uds.h"
 #include "util.h"
@@ -82,10 +87,17 @@ struct clock {
 	int sync_offset;
 	int leap_set;
 	int utc_offset_set;
+	/* set while the clock is on the dst_clocks list, for the workers */
+	int dst_active;
+	/* update period and next update, in CLOCK_MONOTONIC nanoseconds */
+	uint64_t interval;
+	uint64_t deadline;
 	struct servo *servo;
 	enum servo_state servo_state;
 	char *device;
 	const char *source_label;
+	/* how the last PHC to PHC offset was measured */
+	const char *method;
 	struct stats *offset_stats;
 	struct stats *freq_stats;
 	struct stats *delay_stats;
@@ -99,6 +111,18 @@ struct port {
 	struct clock *clock;
 };
 
+/*
+ * In the threaded mode each clock gets a worker, which measures and
+ * updates the clock whenever it is selected as a destination.
+ */
+struct worker {
+	LIST_ENTRY(worker) list;
+	struct phc2sys_private *priv;
+	struct clock *clock;
+	pthread_t thread;
+	int cpu;
+};
+
 struct phc2sys_private {
 	unsigned int stats_max_count;
 	int sanity_freq_limit;
@@ -120,6 +144,20 @@ struct phc2sys_private {
 	LIST_HEAD(clock_head, clock) clocks;
 	LIST_HEAD(dst_clock_head, clock) dst_clocks;
 	struct clock *master;
+	struct telemetry *telemetry;
+	/* threaded mode */
+	int threads;
+	LIST_HEAD(worker_head, worker) workers;
+	int nworkers;
+	/* UTC offset and leap flags, packed for lock free reading */
+	uint64_t utc_state;
+	int worker_failed;
+	/* Protects the fields below, which park and release the workers. */
+	pthread_mutex_t park_lock;
+	pthread_cond_t park_cond;
+	int pause;
+	int parked;
+	int stop;
 };
 
 static struct config *phc2sys_config;
@@ -131,6 +169,7 @@ static int clock_handle_leap(struct phc2sys_private *priv,
 static int run_pmc_get_utc_offset(struct phc2sys_private *priv,
 				  int timeout);
 static void run_pmc_events(struct phc2sys_private *priv);
+static void utc_state_publish(struct phc2sys_private *priv);
 
 static int normalize_state(int state);
 static int run_pmc_port_properties(struct phc2sys_private *priv,
@@ -167,7 +206,7 @@ static struct servo *servo_add(struct phc2sys_private *priv,
 		return NULL;
 	}
 
-	servo_sync_interval(servo, priv->phc_interval);
+	servo_sync_interval(servo, (double) clock->interval / NS_PER_SEC);
 
 	return servo;
 }
@@ -193,6 +232,8 @@ static struct clock *clock_add(struct phc2sys_private *priv, char *device)
 	c->phc_index = phc_index;
 	c->servo_state = SERVO_UNLOCKED;
 	c->device = device ? strdup(device) : NULL;
+	c->interval = NS_PER_SEC /
+		config_get_double(phc2sys_config, device, "update_rate");
 
 	if (c->clkid == CLOCK_REALTIME) {
 		c->source_label = "sys";
@@ -517,6 +558,54 @@ static int read_phc(clockid_t clkid, clockid_t sysclk, int readings,
 	return 1;
 }
 
+static const char *sysoff_name[SYSOFF_LAST] = {
+	[SYSOFF_PRECISE] = "precise",
+	[SYSOFF_EXTENDED] = "extended",
+	[SYSOFF_BASIC] = "basic",
+};
+
+/*
+ * Measures the offset between two PHCs by comparing each of them with
+ * the system clock, back to back, and subtracting the results. This is
+ * also compared with reading the two PHCs directly, and whichever of
+ * the two measurements reports the smaller delay is used.
+ */
+static int read_phc_pair(struct clock *src, struct clock *dst, int readings,
+			 int64_t *offset, uint64_t *ts, int64_t *delay)
+{
+	int64_t src_offset, dst_offset, src_delay, dst_delay, phc_offset;
+	int64_t phc_delay, xts_delay = INT64_MAX;
+	uint64_t src_ts, dst_ts, phc_ts;
+
+	if (sysoff_measure(CLOCKID_TO_FD(src->clkid), src->sysoff_method,
+			   readings, &src_offset, &src_ts, &src_delay) >= 0 &&
+	    sysoff_measure(CLOCKID_TO_FD(dst->clkid), dst->sysoff_method,
+			   readings, &dst_offset, &dst_ts, &dst_delay) >= 0) {
+		/* Both offsets are the system time minus the PHC time. */
+		*offset = src_offset - dst_offset;
+		*ts = dst_ts - dst_offset;
+		xts_delay = src_delay + dst_delay;
+		*delay = xts_delay;
+		/* The less precise of the two methods is reported. */
+		dst->method = sysoff_name[src->sysoff_method > dst->sysoff_method ?
+					  src->sysoff_method : dst->sysoff_method];
+	}
+	if (!xts_delay)
+		return 1;
+
+	if (!read_phc(src->clkid, dst->clkid, readings,
+		      &phc_offset, &phc_ts, &phc_delay))
+		return xts_delay != INT64_MAX;
+
+	if (phc_delay < xts_delay) {
+		*offset = phc_offset;
+		*ts = phc_ts;
+		*delay = phc_delay;
+		dst->method = "gettime";
+	}
+	return 1;
+}
+
 static int64_t get_sync_offset(struct phc2sys_private *priv, struct clock *dst)
 {
 	int direction = priv->forced_sync_offset;
@@ -546,11 +635,13 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 		pr_info("%s "
 			"rms %4.0f max %4.0f "
 			"freq %+6.0f +/- %3.0f "
-			"delay %5.0f +/- %3.0f",
+			"delay %5.0f +/- %3.0f%s%s",
 			clock->device,
 			offset_stats.rms, offset_stats.max_abs,
 			freq_stats.mean, freq_stats.stddev,
-			delay_stats.mean, delay_stats.stddev);
+			delay_stats.mean, delay_stats.stddev,
+			clock->method ? " " : "",
+			clock->method ? clock->method : "");
 	} else {
 		pr_info("%s "
 			"rms %4.0f max %4.0f "
@@ -600,10 +691,18 @@ static void update_clock(struct phc2sys_private *priv, struct clock *clock,
 		break;
 	}
 
+	telemetry_sample(priv->telemetry, clock->device, ts, offset, delay,
+			 ppb, state);
+
 	if (clock->offset_stats) {
 		update_clock_stats(clock, priv->stats_max_count, offset, ppb, delay);
 	} else {
-		if (delay >= 0) {
+		if (delay >= 0 && clock->method) {
+			pr_info("%s %s offset %9" PRId64 " s%d freq %+7.0f "
+				"delay %6" PRId64 " %s",
+				clock->device, priv->master->source_label,
+				offset, state, ppb, delay, clock->method);
+		} else if (delay >= 0) {
 			pr_info("%s %s offset %9" PRId64 " s%d freq %+7.0f "
 				"delay %6" PRId64,
 				clock->device, priv->master->source_label,
@@ -715,18 +814,310 @@ static int update_needed(struct clock *c)
 	return 0;
 }
 
-static int do_loop(struct phc2sys_private *priv, int subscriptions)
+static uint64_t monotonic_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline / NS_PER_SEC;
+	ts.tv_nsec = deadline % NS_PER_SEC;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/*
+ * Advances a deadline by one period. The periods which have already
+ * passed are skipped, so that the deadlines stay on the same grid.
+ */
+static uint64_t next_deadline(uint64_t deadline, uint64_t interval,
+			      uint64_t now)
+{
+	deadline += interval;
+	if (deadline <= now)
+		deadline += ((now - deadline) / interval + 1) * interval;
+	return deadline;
+}
+
+/* Returns: -1 in case of a fatal error, 0 otherwise */
+static int clock_sync(struct phc2sys_private *priv, struct clock *clock)
 {
-	struct timespec interval;
-	struct clock *clock;
 	uint64_t ts;
 	int64_t offset, delay;
 
-	interval.tv_sec = priv->phc_interval;
-	interval.tv_nsec = (priv->phc_interval - interval.tv_sec) * 1e9;
+	if (!update_needed(clock))
+		return 0;
+
+	/* don't try to synchronize the clock to itself */
+	if (clock->clkid == priv->master->clkid ||
+	    (clock->phc_index >= 0 &&
+	     clock->phc_index == priv->master->phc_index) ||
+	    !strcmp(clock->device, priv->master->device))
+		return 0;
+
+	if (!clock->servo) {
+		pr_err("cannot update clock without servo");
+		return -1;
+	}
+
+	clock->method = NULL;
+
+	if (clock->clkid == CLOCK_REALTIME &&
+	    priv->master->sysoff_method >= 0) {
+		/* use sysoff */
+		if (sysoff_measure(CLOCKID_TO_FD(priv->master->clkid),
+				   priv->master->sysoff_method,
+				   priv->phc_readings,
+				   &offset, &ts, &delay) < 0)
+			return -1;
+	} else if (priv->master->clkid == CLOCK_REALTIME &&
+		   clock->sysoff_method >= 0) {
+		/* use reversed sysoff */
+		if (sysoff_measure(CLOCKID_TO_FD(clock->clkid),
+				   clock->sysoff_method,
+				   priv->phc_readings,
+				   &offset, &ts, &delay) < 0)
+			return -1;
+		offset = -offset;
+		ts += offset;
+	} else if (clock->sysoff_method >= 0 &&
+		   priv->master->sysoff_method >= 0) {
+		/* use the better of composed sysoff and phc */
+		if (!read_phc_pair(priv->master, clock, priv->phc_readings,
+				   &offset, &ts, &delay))
+			return 0;
+	} else {
+		/* use phc */
+		if (!read_phc(priv->master->clkid, clock->clkid,
+			      priv->phc_readings,
+			      &offset, &ts, &delay))
+			return 0;
+	}
+	update_clock(priv, clock, offset, ts, delay);
+	return 0;
+}
+
+/*
+ * Sleeps in the worker until the deadline, unless the main thread
+ * pauses or stops the workers earlier. Returns non-zero in that case.
+ */
+static int worker_sleep(struct phc2sys_private *priv, uint64_t deadline)
+{
+	struct timespec ts;
+	int err = 0, wake;
+
+	ts.tv_sec = deadline / NS_PER_SEC;
+	ts.tv_nsec = deadline % NS_PER_SEC;
+
+	pthread_mutex_lock(&priv->park_lock);
+	while (!(wake = priv->pause || priv->stop) && err != ETIMEDOUT)
+		err = pthread_cond_timedwait(&priv->park_cond,
+					     &priv->park_lock, &ts);
+	pthread_mutex_unlock(&priv->park_lock);
+	return wake;
+}
+
+/*
+ * Waits in the worker until the main thread releases the workers
+ * again. Returns non-zero when the worker should exit.
+ */
+static int worker_park(struct phc2sys_private *priv)
+{
+	int stop;
+
+	pthread_mutex_lock(&priv->park_lock);
+	priv->parked++;
+	pthread_cond_broadcast(&priv->park_cond);
+	while (priv->pause && !priv->stop)
+		pthread_cond_wait(&priv->park_cond, &priv->park_lock);
+	stop = priv->stop;
+	if (!stop)
+		priv->parked--;
+	pthread_mutex_unlock(&priv->park_lock);
+	return stop;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct phc2sys_private *priv = w->priv;
+	uint64_t deadline, interval = w->clock->interval, now;
+	cpu_set_t cpus;
+	int err, wake;
+
+	if (w->cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(w->cpu, &cpus);
+		err = pthread_setaffinity_np(pthread_self(), sizeof(cpus),
+					     &cpus);
+		if (err)
+			pr_warning("%s: failed to pin worker to cpu %d: %s",
+				   w->clock->device, w->cpu, strerror(err));
+	}
+
+	deadline = now = monotonic_now();
+
+	/* The termination signals are blocked in the workers. */
+	while (is_running()) {
+		deadline = next_deadline(deadline, interval, now);
+		wake = worker_sleep(priv, deadline);
+		now = monotonic_now();
+
+		if (wake) {
+			if (worker_park(priv))
+				return NULL;
+			continue;
+		}
+		if (!priv->master || !w->clock->dst_active)
+			continue;
+		if (clock_sync(priv, w->clock)) {
+			__atomic_store_n(&priv->worker_failed, 1,
+					 __ATOMIC_RELEASE);
+			break;
+		}
+	}
+
+	/* An exited worker counts as parked for good. */
+	pthread_mutex_lock(&priv->park_lock);
+	priv->parked++;
+	pthread_cond_broadcast(&priv->park_cond);
+	pthread_mutex_unlock(&priv->park_lock);
+	return NULL;
+}
+
+static void workers_select(struct phc2sys_private *priv)
+{
+	struct clock *c;
+
+	LIST_FOREACH(c, &priv->clocks, list)
+		c->dst_active = 0;
+	LIST_FOREACH(c, &priv->dst_clocks, dst_list)
+		c->dst_active = 1;
+}
+
+/*
+ * Wakes and parks the workers, so that the main thread may change the
+ * clocks, the servos and the selected master. A worker in the middle
+ * of a measurement parks as soon as it is done.
+ */
+static void workers_pause(struct phc2sys_private *priv)
+{
+	pthread_mutex_lock(&priv->park_lock);
+	priv->pause = 1;
+	pthread_cond_broadcast(&priv->park_cond);
+	while (priv->parked < priv->nworkers)
+		pthread_cond_wait(&priv->park_cond, &priv->park_lock);
+	pthread_mutex_unlock(&priv->park_lock);
+}
+
+static void workers_resume(struct phc2sys_private *priv)
+{
+	workers_select(priv);
+	pthread_mutex_lock(&priv->park_lock);
+	priv->pause = 0;
+	pthread_cond_broadcast(&priv->park_cond);
+	pthread_mutex_unlock(&priv->park_lock);
+}
+
+static void workers_stop(struct phc2sys_private *priv)
+{
+	struct worker *w;
+
+	pthread_mutex_lock(&priv->park_lock);
+	priv->stop = 1;
+	pthread_cond_broadcast(&priv->park_cond);
+	pthread_mutex_unlock(&priv->park_lock);
+
+	while ((w = LIST_FIRST(&priv->workers)) != NULL) {
+		pthread_join(w->thread, NULL);
+		LIST_REMOVE(w, list);
+		free(w);
+	}
+	priv->nworkers = 0;
+	pthread_cond_destroy(&priv->park_cond);
+	pthread_mutex_destroy(&priv->park_lock);
+}
+
+static int workers_start(struct phc2sys_private *priv)
+{
+	pthread_condattr_t attr;
+	sigset_t mask, orig;
+	struct worker *w;
+	struct clock *c;
+	int err;
+
+	/* The workers sleep on the condition until their deadlines. */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&priv->park_lock, NULL);
+	pthread_cond_init(&priv->park_cond, &attr);
+	pthread_condattr_destroy(&attr);
+	workers_select(priv);
+	utc_state_publish(priv);
+
+	/* Leave the termination signals to the main thread. */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGQUIT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, &orig);
+
+	LIST_FOREACH(c, &priv->clocks, list) {
+		w = calloc(1, sizeof(*w));
+		if (!w) {
+			pr_err("failed to allocate memory for a worker");
+			break;
+		}
+		w->priv = priv;
+		w->clock = c;
+		w->cpu = config_get_int(phc2sys_config, c->device,
+					"worker_cpu");
+		err = pthread_create(&w->thread, NULL, worker_run, w);
+		if (err) {
+			pr_err("failed to create worker thread: %s",
+			       strerror(err));
+			free(w);
+			break;
+		}
+		LIST_INSERT_HEAD(&priv->workers, w, list);
+		priv->nworkers++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &orig, NULL);
+
+	if (c) {
+		workers_stop(priv);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * In the threaded mode, the main thread only talks to ptp4l and
+ * reconfigures the clocks, while the workers do the measurements.
+ */
+static int do_threaded_loop(struct phc2sys_private *priv, int subscriptions)
+{
+	uint64_t deadline, interval = priv->phc_interval * NS_PER_SEC;
+	int err = 0;
+
+	if (workers_start(priv))
+		return -1;
+
+	deadline = monotonic_now() + interval;
 
 	while (is_running()) {
-		clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
+		sleep_until(deadline);
+		deadline = next_deadline(deadline, interval, monotonic_now());
+		if (__atomic_load_n(&priv->worker_failed, __ATOMIC_ACQUIRE)) {
+			err = -1;
+			break;
+		}
 		if (update_pmc(priv, subscriptions) < 0)
 			continue;
 
@@ -739,57 +1130,120 @@ static int do_loop(struct phc2sys_private *priv, int subscriptions)
 					pr_err("failed to get UTC offset");
 					continue;
 				}
+				workers_pause(priv);
 				reconfigure(priv);
+				workers_resume(priv);
 			}
 		}
-		if (!priv->master)
-			continue;
+		utc_state_publish(priv);
+	}
 
-		LIST_FOREACH(clock, &priv->dst_clocks, dst_list) {
-			if (!update_needed(clock))
-				continue;
+	workers_stop(priv);
+	return err;
+}
+
+static int clock_deadline_cmp(void *a, void *b)
+{
+	struct clock *ca = a, *cb = b;
+
+	if (ca->deadline < cb->deadline)
+		return 1;
+	if (ca->deadline > cb->deadline)
+		return -1;
+	return 0;
+}
 
-			/* don't try to synchronize the clock to itself */
-			if (clock->clkid == priv->master->clkid ||
-			    (clock->phc_index >= 0 &&
-			     clock->phc_index == priv->master->phc_index) ||
-			    !strcmp(clock->device, priv->master->device))
+/*
+ * Fills the deadline queue with the selected destination clocks. A clock
+ * which stays selected keeps its schedule.
+ */
+static void schedule_clocks(struct phc2sys_private *priv, struct pqueue *q,
+			    uint64_t now)
+{
+	struct clock *c;
+
+	while (pqueue_extract(q))
+		;
+	LIST_FOREACH(c, &priv->dst_clocks, dst_list) {
+		if (c->deadline <= now)
+			c->deadline = now + c->interval;
+		pqueue_insert(q, c);
+	}
+}
+
+static int do_loop(struct phc2sys_private *priv, int subscriptions)
+{
+	uint64_t next, now, pmc_deadline, interval;
+	struct clock *clock;
+	struct pqueue *q;
+	int n = 0, err = 0;
+
+	if (priv->threads)
+		return do_threaded_loop(priv, subscriptions);
+
+	LIST_FOREACH(clock, &priv->clocks, list)
+		n++;
+	q = pqueue_create(n, clock_deadline_cmp);
+	if (!q) {
+		pr_err("failed to create the deadline queue");
+		return -1;
+	}
+
+	/*
+	 * Every destination clock is updated on its own grid of absolute
+	 * deadlines, while ptp4l is polled at the global update rate.
+	 */
+	interval = priv->phc_interval * NS_PER_SEC;
+	now = monotonic_now();
+	pmc_deadline = now + interval;
+	schedule_clocks(priv, q, now);
+
+	while (is_running()) {
+		next = pmc_deadline;
+		clock = pqueue_peek(q);
+		if (clock && clock->deadline < next)
+			next = clock->deadline;
+		sleep_until(next);
+		now = monotonic_now();
+
+		if (now >= pmc_deadline) {
+			pmc_deadline = next_deadline(pmc_deadline, interval, now);
+			if (update_pmc(priv, subscriptions) < 0)
 				continue;
 
-			if (!clock->servo) {
-				pr_err("cannot update clock without servo");
-				return -1;
+			if (subscriptions) {
+				run_pmc_events(priv);
+				if (priv->state_changed) {
+					/* force getting offset, as it may have
+					 * changed after the port state change */
+					if (run_pmc_get_utc_offset(priv, 1000) <= 0) {
+						pr_err("failed to get UTC offset");
+					} else {
+						reconfigure(priv);
+						schedule_clocks(priv, q, now);
+					}
+				}
 			}
+		}
 
-			if (clock->clkid == CLOCK_REALTIME &&
-			    priv->master->sysoff_method >= 0) {
-				/* use sysoff */
-				if (sysoff_measure(CLOCKID_TO_FD(priv->master->clkid),
-						   priv->master->sysoff_method,
-						   priv->phc_readings,
-						   &offset, &ts, &delay) < 0)
-					return -1;
-			} else if (priv->master->clkid == CLOCK_REALTIME &&
-				   clock->sysoff_method >= 0) {
-				/* use reversed sysoff */
-				if (sysoff_measure(CLOCKID_TO_FD(clock->clkid),
-						   clock->sysoff_method,
-						   priv->phc_readings,
-						   &offset, &ts, &delay) < 0)
-					return -1;
-				offset = -offset;
-				ts += offset;
-			} else {
-				/* use phc */
-				if (!read_phc(priv->master->clkid, clock->clkid,
-					      priv->phc_readings,
-					      &offset, &ts, &delay))
-					continue;
+		while ((clock = pqueue_peek(q)) && clock->deadline <= now) {
+			clock = pqueue_extract(q);
+			clock->deadline = next_deadline(clock->deadline,
+							clock->interval, now);
+			pqueue_insert(q, clock);
+
+			/* Hold off until the reconfiguration succeeds. */
+			if (!priv->master || priv->state_changed)
+				continue;
+			if (clock_sync(priv, clock)) {
+				err = -1;
+				goto out;
 			}
-			update_clock(priv, clock, offset, ts, delay);
 		}
 	}
-	return 0;
+out:
+	pqueue_destroy(q);
+	return err;
 }
 
 static int check_clock_identity(struct phc2sys_private *priv,
@@ -1260,13 +1714,44 @@ static int update_pmc(struct phc2sys_private *priv, int subscribe)
 	return 0;
 }
 
+/*
+ * The workers read the UTC offset and the leap second flags as one word,
+ * which the main thread republishes after each update from ptp4l.
+ */
+static void utc_state_publish(struct phc2sys_private *priv)
+{
+	uint64_t v;
+
+	v = (uint32_t)priv->sync_offset;
+	v |= (uint64_t)(priv->leap + 1) << 32;
+	v |= (uint64_t)(priv->utc_offset_traceable ? 1 : 0) << 34;
+	__atomic_store_n(&priv->utc_state, v, __ATOMIC_RELEASE);
+}
+
+static void utc_state_read(struct phc2sys_private *priv, int *sync_offset,
+			   int *leap, int *traceable)
+{
+	uint64_t v;
+
+	if (LIST_EMPTY(&priv->workers)) {
+		*sync_offset = priv->sync_offset;
+		*leap = priv->leap;
+		*traceable = priv->utc_offset_traceable;
+		return;
+	}
+	v = __atomic_load_n(&priv->utc_state, __ATOMIC_ACQUIRE);
+	*sync_offset = (int32_t)(v & 0xffffffff);
+	*leap = (int)((v >> 32) & 3) - 1;
+	*traceable = (v >> 34) & 1;
+}
+
 /* Returns: non-zero to skip clock update */
 static int clock_handle_leap(struct phc2sys_private *priv, struct clock *clock,
 			     int64_t offset, uint64_t ts)
 {
-	int clock_leap, node_leap = priv->leap;
+	int clock_leap, node_leap, traceable;
 
-	clock->sync_offset = priv->sync_offset;
+	utc_state_read(priv, &clock->sync_offset, &node_leap, &traceable);
 
 	if ((node_leap || clock->leap_set) &&
 	    clock->is_utc != priv->master->is_utc) {
@@ -1307,7 +1792,7 @@ static int clock_handle_leap(struct phc2sys_private *priv, struct clock *clock,
 		}
 	}
 
-	if (priv->utc_offset_traceable &&
+	if (traceable &&
 	    clock->utc_offset_set != clock->sync_offset) {
 		if (clock->clkid == CLOCK_REALTIME)
 			sysclk_set_tai_offset(clock->sync_offset);
@@ -1369,7 +1854,6 @@ int main(int argc, char *argv[])
 	double phc_rate, tmp;
 	struct phc2sys_private priv = {
 		.phc_readings = 5,
-		.phc_interval = 1.0,
 	};
 
 	handle_term_signals();
@@ -1460,9 +1944,9 @@ int main(int argc, char *argv[])
 				goto end;
 			break;
 		case 'R':
-			if (get_arg_val_d(c, optarg, &phc_rate, 1e-9, DBL_MAX))
+			if (get_arg_val_d(c, optarg, &phc_rate, 1e-9, DBL_MAX) ||
+			    config_set_double(cfg, "update_rate", phc_rate))
 				goto end;
-			priv.phc_interval = 1.0 / phc_rate;
 			break;
 		case 'N':
 			if (get_arg_val_i(c, optarg, &priv.phc_readings, 1, INT_MAX))
@@ -1580,6 +2064,16 @@ int main(int argc, char *argv[])
 	print_set_verbose(config_get_int(cfg, NULL, "verbose"));
 	print_set_syslog(config_get_int(cfg, NULL, "use_syslog"));
 	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+	if (print_set_async(config_get_int(cfg, NULL, "logging_ring_size"))) {
+		fprintf(stderr, "failed to start the logging thread\n");
+		goto end;
+	}
+
+	priv.telemetry = telemetry_create(cfg);
+	if (!priv.telemetry) {
+		fprintf(stderr, "failed to create telemetry ring\n");
+		goto end;
+	}
 
 	priv.servo_type = config_get_int(cfg, NULL, "clock_servo");
 	if (priv.servo_type == CLOCK_SERVO_NTPSHM) {
@@ -1587,6 +2081,8 @@ int main(int argc, char *argv[])
 		config_set_int(cfg, "sanity_freq_limit", 0);
 	}
 	priv.kernel_leap = config_get_int(cfg, NULL, "kernel_leap");
+	priv.threads = config_get_int(cfg, NULL, "worker_threads");
+	priv.phc_interval = 1.0 / config_get_double(cfg, NULL, "update_rate");
 	priv.sanity_freq_limit = config_get_int(cfg, NULL, "sanity_freq_limit");
 
 	if (autocfg) {
@@ -1667,6 +2163,8 @@ end:
 	if (priv.pmc)
 		close_pmc(&priv);
 	clock_cleanup(&priv);
+	if (priv.telemetry)
+		telemetry_destroy(priv.telemetry);
 	port_cleanup(&priv);
 	config_destroy(cfg);
 	msg_cleanup();
@@ -143,6 +143,7 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 	struct transparentClockPortDS *tcpds;
 	struct grandmaster_settings_np *gsn;
 	struct mgmt_clock_description *cd;
+	struct msg_pool_stats_np *mps;
 	struct subscribe_events_np *sen;
 	struct management_tlv_datum *mtd;
 	struct port_properties_np *ppn;
@@ -410,6 +411,20 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 		fprintf(fp, "SYNCHRONIZATION_UNCERTAIN_NP "
 			IFMT "uncertain %hhu", mtd->val);
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		mps = (struct msg_pool_stats_np *) mgt->data;
+		fprintf(fp, "MSG_POOL_STATS_NP "
+			IFMT "allocations  %" PRIu64
+			IFMT "misses       %" PRIu64
+			IFMT "size         %u"
+			IFMT "in_use       %u"
+			IFMT "high_water   %u",
+			mps->allocations,
+			mps->misses,
+			mps->size,
+			mps->in_use,
+			mps->high_water);
+		break;
 	case TLV_PORT_DATA_SET:
 		p = (struct portDS *) mgt->data;
 		if (p->portState > PS_SLAVE) {
@@ -548,6 +563,135 @@ out:
 	fflush(fp);
 }
 
+static void pipeline_show(void *ctx, struct pmc_request *req,
+			  struct ptp_message *msg)
+{
+	pmc_show(msg, stdout);
+}
+
+static void pipeline_count_ports(void *ctx, struct pmc_request *req,
+				 struct ptp_message *msg)
+{
+	struct management_tlv *mgt;
+	struct defaultDS *dds;
+
+	mgt = (struct management_tlv *) msg->management.suffix;
+	if (mgt->type != TLV_MANAGEMENT || mgt->id != TLV_DEFAULT_DATA_SET ||
+	    mgt->length == 2)
+		return;
+	dds = (struct defaultDS *) mgt->data;
+	*(int *) ctx = dds->numberPorts;
+}
+
+/*
+ * Replaces each request for a port data set addressed to all ports
+ * of the local clock with one request per port, so that every
+ * request has exactly one response and the batch completes as soon
+ * as the last one arrives.
+ */
+static int pipeline_expand(struct pmc_request **req, int *n, int timeout)
+{
+	struct pmc_request dds = { .id = TLV_DEFAULT_DATA_SET, .expect = 1 };
+	struct pmc_request *new;
+	int i, j, k, ports = 0, wild = 0;
+
+	for (i = 0; i < *n; i++) {
+		if (!(*req)[i].expect)
+			wild++;
+	}
+	if (!wild)
+		return 0;
+
+	memset(&dds.target, 0xff, sizeof(dds.target));
+	if (pmc_pipeline(pmc, &dds, 1, timeout, pipeline_count_ports,
+			 &ports) != 1 || !ports) {
+		return -1;
+	}
+	new = calloc(*n + wild * (ports - 1), sizeof(*new));
+	if (!new)
+		return -1;
+	for (i = 0, k = 0; i < *n; i++) {
+		if ((*req)[i].expect) {
+			new[k++] = (*req)[i];
+			continue;
+		}
+		for (j = 1; j <= ports; j++) {
+			new[k] = (*req)[i];
+			new[k].target.portNumber = j;
+			new[k].expect = 1;
+			k++;
+		}
+	}
+	free(*req);
+	*req = new;
+	*n = k;
+	return 0;
+}
+
+static int do_pipeline(int argc, char *argv[], int local, int timeout)
+{
+	struct pmc_request *req = NULL, *tmp;
+	int answered, length, n = 0, size = 0, ret = 0, use_stdin;
+	char line[1024], *command;
+
+	/* Without commands on the command line, read them from stdin. */
+	use_stdin = optind == argc;
+
+	while (1) {
+		if (optind < argc) {
+			command = argv[optind++];
+		} else if (use_stdin && fgets(line, sizeof(line), stdin)) {
+			length = strlen(line);
+			if (length < 2)
+				continue;
+			if (line[length - 1] == '\n')
+				line[length - 1] = 0;
+			command = line;
+		} else {
+			break;
+		}
+		if (n == size) {
+			size = size ? 2 * size : 64;
+			tmp = realloc(req, size * sizeof(*req));
+			if (!tmp) {
+				pr_err("low memory");
+				ret = -1;
+				goto out;
+			}
+			req = tmp;
+		}
+		switch (pmc_parse_request(pmc, command, &req[n])) {
+		case 0:
+			n++;
+			break;
+		case 1:
+			break;
+		default:
+			fprintf(stderr, "bad command: %s\n", command);
+			break;
+		}
+	}
+	if (!n)
+		goto out;
+
+	if (local && pipeline_expand(&req, &n, timeout)) {
+		fprintf(stderr, "failed to get the number of ports\n");
+		ret = -1;
+		goto out;
+	}
+	answered = pmc_pipeline(pmc, req, n, timeout, pipeline_show, NULL);
+	if (answered < 0) {
+		ret = -1;
+	} else if (answered < n) {
+		fprintf(stderr, "%d of %d requests not answered\n",
+			n - answered, n);
+		ret = -1;
+	}
+out:
+	free(req);
+	return ret;
+}
+
 static void usage(char *progname)
 {
 	fprintf(stderr,
@@ -564,6 +708,7 @@ static void usage(char *progname)
 		" -h        prints this message and exits\n"
 		" -i [dev]  interface device to use, default 'eth0'\n"
 		"           for network and '/var/run/pmc.$pid' for UDS.\n"
+		" -p        pipeline the GET commands of a batch\n"
 		" -s [path] server address for UDS, default '/var/run/ptp4l'.\n"
 		" -t [hex]  transport specific field, default 0x0\n"
 		" -v        prints the software version and exits\n"
@@ -577,6 +722,7 @@ int main(int argc, char *argv[])
 	const char *iface_name = NULL;
 	char *config = NULL, *progname;
 	int c, cnt, index, length, tmo = -1, batch_mode = 0, zero_datalen = 0;
+	int pipeline = 0;
 	int ret = 0;
 	char line[1024], *command = NULL, uds_local[MAX_IFNAME_SIZE + 1];
 	enum transport_type transport_type = TRANS_UDP_IPV4;
@@ -599,7 +745,7 @@ int main(int argc, char *argv[])
 	/* Process the command line arguments. */
 	progname = strrchr(argv[0], '/');
 	progname = progname ? 1+progname : argv[0];
-	while (EOF != (c = getopt_long(argc, argv, "246u""b:d:f:hi:s:t:vz",
+	while (EOF != (c = getopt_long(argc, argv, "246u""b:d:f:hi:ps:t:vz",
 				       opts, &index))) {
 		switch (c) {
 		case 0:
@@ -647,6 +793,9 @@ int main(int argc, char *argv[])
 		case 'i':
 			iface_name = optarg;
 			break;
+		case 'p':
+			pipeline = 1;
+			break;
 		case 's':
 			if (strlen(optarg) > MAX_IFNAME_SIZE) {
 				fprintf(stderr, "path %s too long, max is %d\n",
@@ -720,6 +869,12 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	if (pipeline) {
+		ret = do_pipeline(argc, argv, transport_type == TRANS_UDS &&
+				  !boundary_hops, 100);
+		goto done;
+	}
+
 	pollfd[0].fd = batch_mode ? -1 : STDIN_FILENO;
 	pollfd[1].fd = pmc_get_transport_fd(pmc);
 
@@ -790,6 +945,7 @@ int main(int argc, char *argv[])
 		}
 	}
 
+done:
 	pmc_destroy(pmc);
 	msg_cleanup();
 
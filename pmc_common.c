@@ -18,6 +18,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <errno.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -35,6 +36,15 @@
 #define AMBIGUOUS_ID -2
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
+/*
+ * Upper bound on the number of pipelined requests still waiting for
+ * their first response. This keeps the backlog on the server's UDS
+ * socket below the kernel's default net.unix.max_dgram_qlen, so that
+ * a blocking sendto() in either direction cannot deadlock the two
+ * peers.
+ */
+#define PIPELINE_WINDOW 8
+
 /*
    Field                  Len  Type
   --------------------------------------------------------
@@ -111,6 +121,7 @@ struct management_id idtab[] = {
 	{ "GRANDMASTER_SETTINGS_NP", TLV_GRANDMASTER_SETTINGS_NP, do_set_action },
 	{ "SUBSCRIBE_EVENTS_NP", TLV_SUBSCRIBE_EVENTS_NP, do_set_action },
 	{ "SYNCHRONIZATION_UNCERTAIN_NP", TLV_SYNCHRONIZATION_UNCERTAIN_NP, do_set_action },
+	{ "MSG_POOL_STATS_NP", TLV_MSG_POOL_STATS_NP, do_get_action },
 /* Port management ID values */
 	{ "NULL_MANAGEMENT", TLV_NULL_MANAGEMENT, null_management },
 	{ "CLOCK_DESCRIPTION", TLV_CLOCK_DESCRIPTION, do_get_action },
@@ -322,6 +333,18 @@ static int parse_id(char *s)
 	return index;
 }
 
+/* The port management IDs follow NULL_MANAGEMENT in the table. */
+static int null_management_index(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(idtab); i++) {
+		if (idtab[i].code == TLV_NULL_MANAGEMENT)
+			break;
+	}
+	return i;
+}
+
 static int parse_target(struct pmc *pmc, const char *str)
 {
 	struct PortIdentity pid;
@@ -512,6 +535,9 @@ static int pmc_tlv_datalen(struct pmc *pmc, int id)
 	case TLV_TIME_STATUS_NP:
 		len += sizeof(struct time_status_np);
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		len += sizeof(struct msg_pool_stats_np);
+		break;
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		len += sizeof(struct grandmaster_settings_np);
 		break;
@@ -659,6 +685,173 @@ failed:
 	return NULL;
 }
 
+static struct pmc_request *pipeline_match(struct pmc_request *req, int sent,
+					  UInteger16 base,
+					  struct ptp_message *msg)
+{
+	struct management_error_status *mes;
+	struct management_tlv *mgt;
+	UInteger16 index;
+	int action, id;
+
+	if (msg_type(msg) != MANAGEMENT || msg_tlv_count(msg) != 1)
+		return NULL;
+	action = management_action(msg);
+	if (action != RESPONSE && action != ACKNOWLEDGE)
+		return NULL;
+
+	/* Sequence ids are handed out consecutively starting at base. */
+	index = msg->header.sequenceId - base;
+	if (index >= sent)
+		return NULL;
+
+	mgt = (struct management_tlv *) msg->management.suffix;
+	switch (mgt->type) {
+	case TLV_MANAGEMENT:
+		id = mgt->id;
+		break;
+	case TLV_MANAGEMENT_ERROR_STATUS:
+		mes = (struct management_error_status *) mgt;
+		id = mes->id;
+		break;
+	default:
+		return NULL;
+	}
+	return id == req[index].id ? &req[index] : NULL;
+}
+
+static int pipeline_complete(struct pmc_request *req)
+{
+	return req->expect && req->responses >= req->expect;
+}
+
+int pmc_pipeline(struct pmc *pmc, struct pmc_request *req, int n,
+		 int timeout, pmc_response_fn fn, void *ctx)
+{
+	int answered = 0, cnt, complete = 0, i, inflight = 0, open = 0, sent = 0;
+	struct PortIdentity target = pmc->target;
+	UInteger16 base = pmc->sequence_id;
+	struct pmc_request *r;
+	struct ptp_message *msg;
+	struct pollfd pollfd;
+
+	if (n > UINT16_MAX + 1)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		req[i].responses = 0;
+		if (!req[i].expect)
+			open++;
+	}
+	pollfd.fd = pmc_get_transport_fd(pmc);
+
+	while (open || sent < n || complete < n) {
+		pollfd.events = POLLIN | POLLPRI;
+		if (sent < n && inflight < PIPELINE_WINDOW)
+			pollfd.events |= POLLOUT;
+
+		cnt = poll(&pollfd, 1, timeout);
+		if (cnt < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_err("poll failed");
+			answered = -1;
+			goto out;
+		} else if (!cnt) {
+			break;
+		}
+
+		/* Drain responses before adding to the server's backlog. */
+		if (pollfd.revents & (POLLIN | POLLPRI)) {
+			msg = pmc_recv(pmc);
+			if (!msg)
+				continue;
+			r = pipeline_match(req, sent, base, msg);
+			if (r) {
+				if (!r->responses++) {
+					answered++;
+					inflight--;
+				}
+				if (pipeline_complete(r))
+					complete++;
+				if (fn)
+					fn(ctx, r, msg);
+			}
+			msg_put(msg);
+			continue;
+		}
+
+		if (pollfd.revents & POLLOUT) {
+			r = &req[sent];
+			pmc->target = r->target;
+			r->sequence_id = pmc->sequence_id;
+			if (pmc_send_get_action(pmc, r->id)) {
+				answered = -1;
+				goto out;
+			}
+			sent++;
+			inflight++;
+		}
+	}
+out:
+	pmc->target = target;
+	return answered;
+}
+
+int pmc_parse_request(struct pmc *pmc, char *str, struct pmc_request *req)
+{
+	char action_str[10+1] = {0}, id_str[64+1] = {0};
+	struct ClockIdentity wildcard = {
+		{0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}
+	};
+	int index, local, port_id;
+
+	if (0 == strncasecmp(str, "HELP", strlen(str))) {
+		print_help(stdout);
+		return 1;
+	}
+
+	if (2 != sscanf(str, " %10s %64s", action_str, id_str))
+		return -1;
+
+	if (0 == strncasecmp(action_str, "TARGET", strlen(action_str)))
+		return parse_target(pmc, id_str) ? -1 : 1;
+
+	if (parse_action(action_str) != GET)
+		return -1;
+
+	index = parse_id(id_str);
+	if (index == BAD_ID)
+		return -1;
+	if (index == AMBIGUOUS_ID) {
+		fprintf(stderr, "id %s is too ambiguous\n", id_str);
+		return -1;
+	}
+	if (idtab[index].func == not_supported) {
+		fprintf(stderr, "sorry, %s not supported yet\n",
+			idtab[index].name);
+		return -1;
+	}
+
+	req->id = idtab[index].code;
+	req->target = pmc->target;
+
+	/*
+	 * Only a request that just one port of one clock can answer has
+	 * a known number of responses. Without boundary hops the local
+	 * UDS server is the only clock that sees the request.
+	 */
+	local = transport_type(pmc->transport) == TRANS_UDS &&
+		!pmc->boundary_hops;
+	port_id = index >= null_management_index();
+	if (local || !cid_eq(&req->target.clockIdentity, &wildcard))
+		req->expect = (!port_id || req->target.portNumber != 0xffff);
+	else
+		req->expect = 0;
+
+	return 0;
+}
+
 int pmc_target(struct pmc *pmc, struct PortIdentity *pid)
 {
 	pmc->target = *pid;
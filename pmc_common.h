@@ -27,6 +27,31 @@
 
 struct pmc;
 
+/**
+ * Describes one GET request of a pipelined batch, see pmc_pipeline().
+ */
+struct pmc_request {
+	/** Management ID of the requested data set. */
+	int id;
+	/** Port targeted by the request. */
+	struct PortIdentity target;
+	/** Number of responses to wait for, or zero if not known. */
+	int expect;
+	/** Sequence id of the request, assigned by pmc_pipeline(). */
+	UInteger16 sequence_id;
+	/** Number of responses received, maintained by pmc_pipeline(). */
+	int responses;
+};
+
+/**
+ * Handles one response matched to a pipelined request.
+ * @param ctx  The context pointer passed to pmc_pipeline().
+ * @param req  The request being answered.
+ * @param msg  The response, owned by the caller of the function.
+ */
+typedef void (*pmc_response_fn)(void *ctx, struct pmc_request *req,
+				struct ptp_message *msg);
+
 struct pmc *pmc_create(struct config *cfg, enum transport_type transport_type,
 		       const char *iface_name, UInteger8 boundary_hops,
 		       UInteger8 domain_number, UInteger8 transport_specific,
@@ -49,4 +74,36 @@ void pmc_target_all(struct pmc *pmc);
 const char *pmc_action_string(int action);
 int pmc_do_command(struct pmc *pmc, char *str);
 
+/**
+ * Parses a command for a pipelined batch. TARGET and HELP commands
+ * are carried out immediately, and GET commands are translated into
+ * a request using the current target. Other actions are rejected.
+ * @param pmc  A pointer obtained via pmc_create().
+ * @param str  The command to parse.
+ * @param req  Filled in when the command is a GET.
+ * @return     Zero if @a req was filled in, one if the command was
+ *             consumed, or -1 if the command is invalid.
+ */
+int pmc_parse_request(struct pmc *pmc, char *str, struct pmc_request *req);
+
+/**
+ * Issues a batch of GET requests without waiting for each response.
+ * Every request carries its own sequence id, and responses are
+ * correlated by that id as they arrive, so the whole batch costs
+ * about one round trip. Requests that expect a known number of
+ * responses are done once those have arrived. If any request has an
+ * unknown number of responses, the batch only ends after no further
+ * message arrived during the timeout.
+ * @param pmc      A pointer obtained via pmc_create().
+ * @param req      Array of requests.
+ * @param n        Number of requests in @a req.
+ * @param timeout  Time in milliseconds to wait for the next message.
+ * @param fn       Called for each response, may be NULL.
+ * @param ctx      Passed to @a fn.
+ * @return         The number of requests that received at least one
+ *                 response, or -1 on error.
+ */
+int pmc_pipeline(struct pmc *pmc, struct pmc_request *req, int n,
+		 int timeout, pmc_response_fn fn, void *ctx);
+
 #endif
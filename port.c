@@ -35,8 +35,8 @@
 #include "port.h"
 #include "port_private.h"
 #include "print.h"
-#include "rtnl.h"
 #include "sk.h"
+#include "stats.h"
 #include "tc.h"
 #include "tlv.h"
 #include "tmv.h"
@@ -57,6 +57,7 @@ enum syfu_event {
 
 static int port_is_ieee8021as(struct port *p);
 static void port_nrate_initialize(struct port *p);
+static void port_peer_delay(struct port *p);
 
 static int announce_compare(struct ptp_message *m1, struct ptp_message *m2)
 {
@@ -183,21 +184,13 @@ void fault_interval(struct port *port, enum fault_type ft,
 	i->val = port->flt_interval_pertype[ft].val;
 }
 
-int port_fault_fd(struct port *port)
-{
-	return port->fault_fd;
-}
-
 struct fdarray *port_fda(struct port *port)
 {
 	return &port->fda;
 }
 
-int set_tmo_log(int fd, unsigned int scale, int log_seconds)
+int set_tmo_log(struct wheel_timer *t, unsigned int scale, int log_seconds)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
 	uint64_t ns;
 	int i;
 
@@ -207,35 +200,21 @@ int set_tmo_log(int fd, unsigned int scale, int log_seconds)
 		for (i = 1, ns = scale * 500000000ULL; i < log_seconds; i++) {
 			ns >>= 1;
 		}
-		tmo.it_value.tv_nsec = ns;
-
-		while (tmo.it_value.tv_nsec >= NS_PER_SEC) {
-			tmo.it_value.tv_nsec -= NS_PER_SEC;
-			tmo.it_value.tv_sec++;
-		}
 
 	} else
-		tmo.it_value.tv_sec = scale * (1 << log_seconds);
+		ns = scale * (1ULL << log_seconds) * NS_PER_SEC;
 
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	return wheel_timer_set(t, ns);
 }
 
-int set_tmo_lin(int fd, int seconds)
+int set_tmo_lin(struct wheel_timer *t, int seconds)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
-
-	tmo.it_value.tv_sec = seconds;
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	return wheel_timer_set(t, seconds * NS_PER_SEC);
 }
 
-int set_tmo_random(int fd, int min, int span, int log_seconds)
+int set_tmo_random(struct wheel_timer *t, int min, int span, int log_seconds)
 {
 	uint64_t value_ns, min_ns, span_ns;
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
 
 	if (log_seconds >= 0) {
 		min_ns = min * NS_PER_SEC << log_seconds;
@@ -247,21 +226,18 @@ int set_tmo_random(int fd, int min, int span, int log_seconds)
 
 	value_ns = min_ns + (span_ns * (random() % (1 << 15) + 1) >> 15);
 
-	tmo.it_value.tv_sec = value_ns / NS_PER_SEC;
-	tmo.it_value.tv_nsec = value_ns % NS_PER_SEC;
-
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	return wheel_timer_set(t, value_ns);
 }
 
 int port_set_fault_timer_log(struct port *port,
 			     unsigned int scale, int log_seconds)
 {
-	return set_tmo_log(port->fault_fd, scale, log_seconds);
+	return set_tmo_log(port->fault_timer, scale, log_seconds);
 }
 
 int port_set_fault_timer_lin(struct port *port, int seconds)
 {
-	return set_tmo_lin(port->fault_fd, seconds);
+	return set_tmo_lin(port->fault_timer, seconds);
 }
 
 void fc_clear(struct foreign_clock *fc)
@@ -334,6 +310,29 @@ void ts_add(tmv_t *ts, Integer64 correction)
 	*ts = tmv_add(*ts, correction_to_tmv(correction));
 }
 
+static struct fmi *fm_bucket(struct port *p, struct PortIdentity *pid)
+{
+	unsigned int i, h = pid->portNumber;
+
+	for (i = 0; i < sizeof(pid->clockIdentity.id); i++) {
+		h = h * 31 + pid->clockIdentity.id[i];
+	}
+	return &p->fm_index[h % FM_INDEX_SIZE];
+}
+
+static struct foreign_clock *fm_lookup(struct port *p,
+				       struct PortIdentity *pid)
+{
+	struct foreign_clock *fc;
+
+	LIST_FOREACH(fc, fm_bucket(p, pid), index) {
+		if (pid_eq(&fc->dataset.sender, pid)) {
+			break;
+		}
+	}
+	return fc;
+}
+
 /*
  * Returns non-zero if the announce message is different than last.
  */
@@ -343,11 +342,7 @@ static int add_foreign_master(struct port *p, struct ptp_message *m)
 	struct ptp_message *tmp;
 	int broke_threshold = 0, diff = 0;
 
-	LIST_FOREACH(fc, &p->foreign_masters, list) {
-		if (msg_source_equal(m, fc)) {
-			break;
-		}
-	}
+	fc = fm_lookup(p, &m->header.sourcePortIdentity);
 	if (!fc) {
 		pr_notice("port %hu: new foreign master %s", portnum(p),
 			pid2str(&m->header.sourcePortIdentity));
@@ -360,6 +355,8 @@ static int add_foreign_master(struct port *p, struct ptp_message *m)
 		memset(fc, 0, sizeof(*fc));
 		TAILQ_INIT(&fc->messages);
 		LIST_INSERT_HEAD(&p->foreign_masters, fc, list);
+		LIST_INSERT_HEAD(fm_bucket(p, &m->header.sourcePortIdentity),
+				 fc, index);
 		fc->port = p;
 		fc->dataset.sender = m->header.sourcePortIdentity;
 		/* We do not count this first message, see 9.5.3(b) */
@@ -496,6 +493,7 @@ static void free_foreign_masters(struct port *p)
 	struct foreign_clock *fc;
 	while ((fc = LIST_FIRST(&p->foreign_masters)) != NULL) {
 		LIST_REMOVE(fc, list);
+		LIST_REMOVE(fc, index);
 		fc_clear(fc);
 		free(fc);
 	}
@@ -612,6 +610,238 @@ static int peer_prepare_and_send(struct port *p, struct ptp_message *msg,
 	return 0;
 }
 
+/*
+ * Deferred transmit time stamps
+ */
+
+static TAILQ_HEAD(tx_pool, tx_pending) tx_pool = TAILQ_HEAD_INITIALIZER(tx_pool);
+
+static void tx_pending_recycle(struct tx_pending *txp)
+{
+	msg_put(txp->msg);
+	if (txp->req) {
+		msg_put(txp->req);
+	}
+	if (txp->rsp) {
+		msg_put(txp->rsp);
+	}
+	TAILQ_INSERT_HEAD(&tx_pool, txp, list);
+}
+
+static int tx_pending_current(struct tx_pending *txp, struct timespec now)
+{
+	int64_t t1, t2, tmo;
+
+	tmo = 1000000LL * sk_tx_timeout;
+	t1 = txp->sent.tv_sec * NSEC2SEC + txp->sent.tv_nsec;
+	t2 = now.tv_sec * NSEC2SEC + now.tv_nsec;
+
+	return t2 - t1 < tmo;
+}
+
+static void port_tx_flush(struct port *p)
+{
+	struct tx_pending *txp;
+
+	while ((txp = TAILQ_FIRST(&p->tx_pending)) != NULL) {
+		TAILQ_REMOVE(&p->tx_pending, txp, list);
+		tx_pending_recycle(txp);
+	}
+	port_clr_tmo(p->timer[FD_TX_TIMER]);
+}
+
+/*
+ * Arms the port's FD_TX_TIMER to expire when the oldest pending entry
+ * times out, so that a missing time stamp is noticed even if no other
+ * traffic follows.
+ */
+static void port_tx_timer_update(struct port *p)
+{
+	struct tx_pending *txp = TAILQ_FIRST(&p->tx_pending);
+	struct timespec ts;
+	int64_t ns;
+
+	if (!txp) {
+		port_clr_tmo(p->timer[FD_TX_TIMER]);
+		return;
+	}
+	ns = txp->sent.tv_nsec + 1000000LL * sk_tx_timeout;
+	ts.tv_sec = txp->sent.tv_sec + ns / NSEC2SEC;
+	ts.tv_nsec = ns % NSEC2SEC;
+	wheel_timer_set_abs(p->timer[FD_TX_TIMER], &ts);
+}
+
+/*
+ * Returns the number of entries that waited too long for their time
+ * stamp. Those entries are discarded.
+ */
+static int port_tx_prune(struct port *p)
+{
+	struct tx_pending *txp;
+	struct timespec now;
+	int cnt = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	while ((txp = TAILQ_FIRST(&p->tx_pending)) != NULL) {
+		if (tx_pending_current(txp, now)) {
+			break;
+		}
+		pr_err("port %hu: timed out waiting for %s tx timestamp",
+		       portnum(p), msg_type_string(msg_type(txp->msg)));
+		TAILQ_REMOVE(&p->tx_pending, txp, list);
+		tx_pending_recycle(txp);
+		cnt++;
+	}
+	if (cnt) {
+		pr_err("increasing tx_timestamp_timeout may correct "
+		       "this issue, but it is likely caused by a driver bug");
+	}
+	port_tx_timer_update(p);
+	return cnt;
+}
+
+struct tx_pending *port_tx_defer(struct port *p, struct ptp_message *msg,
+				 int (*complete)(struct port *p,
+						 struct tx_pending *txp))
+{
+	struct tx_pending *txp;
+
+	if (port_tx_prune(p)) {
+		return NULL;
+	}
+	txp = TAILQ_FIRST(&tx_pool);
+	if (txp) {
+		TAILQ_REMOVE(&tx_pool, txp, list);
+		memset(txp, 0, sizeof(*txp));
+	} else {
+		txp = calloc(1, sizeof(*txp));
+		if (!txp) {
+			return NULL;
+		}
+	}
+	msg_get(msg);
+	txp->msg = msg;
+	txp->complete = complete;
+	clock_gettime(CLOCK_MONOTONIC, &txp->sent);
+	TAILQ_INSERT_TAIL(&p->tx_pending, txp, list);
+	if (TAILQ_FIRST(&p->tx_pending) == txp) {
+		port_tx_timer_update(p);
+	}
+	return txp;
+}
+
+/*
+ * Finds the entry whose message was looped back in the given frame.
+ * The frame carries the link and network headers in front of the PTP
+ * message, so search for the header as it was transmitted. A frame
+ * too short to hold the header cannot be matched and is dropped.
+ */
+static struct tx_pending *port_tx_match(struct port *p, unsigned char *pkt,
+					int cnt)
+{
+	struct tx_pending *txp;
+
+	if (cnt < sizeof(struct ptp_header)) {
+		return NULL;
+	}
+	TAILQ_FOREACH(txp, &p->tx_pending, list) {
+		if (memmem(pkt, cnt, &txp->msg->header,
+			   sizeof(struct ptp_header))) {
+			return txp;
+		}
+	}
+	return NULL;
+}
+
+int port_tx_pending(struct port *p)
+{
+	return !TAILQ_EMPTY(&p->tx_pending);
+}
+
+/*
+ * Completes the pending entry whose message was looped back in 'pkt'.
+ * Time stamps matching no entry are dropped.
+ */
+static int port_tx_dispatch(struct port *p, unsigned char *pkt, int cnt,
+			    struct hw_timestamp *hwts)
+{
+	struct tx_pending *txp;
+	int err;
+
+	txp = port_tx_match(p, pkt, cnt);
+	if (!txp) {
+		pr_debug("port %hu: dropping unmatched tx timestamp",
+			 portnum(p));
+		return 0;
+	}
+	TAILQ_REMOVE(&p->tx_pending, txp, list);
+	if (tmv_is_zero(hwts->ts)) {
+		pr_err("port %hu: missing timestamp on transmitted %s",
+		       portnum(p), msg_type_string(msg_type(txp->msg)));
+		err = -1;
+	} else {
+		txp->msg->hwts.ts = hwts->ts;
+		ts_add(&txp->msg->hwts.ts, p->tx_timestamp_offset);
+		err = txp->complete(p, txp);
+	}
+	tx_pending_recycle(txp);
+	return err;
+}
+
+enum fsm_event port_tx_complete(struct port *p)
+{
+	unsigned char pkt[1600];
+	int cnt, err = 0, n = 0;
+
+	/*
+	 * Drain the whole error queue. Time stamps arriving after their
+	 * entry timed out, or after a synchronous wait gave up, are
+	 * dropped here.
+	 */
+	while (!err) {
+		struct hw_timestamp hwts = { .type = p->timestamping };
+
+		cnt = transport_txts_next(p->trp, &p->fda, pkt, sizeof(pkt),
+					  &hwts, 0);
+		if (cnt == -EAGAIN) {
+			break;
+		} else if (cnt < 0) {
+			return EV_FAULT_DETECTED;
+		}
+		n++;
+		err = port_tx_dispatch(p, pkt, cnt, &hwts);
+	}
+	if (!n && !port_tx_pending(p)) {
+		/* Nothing queued, so the socket reported a real error. */
+		pr_err("port %hu: unexpected socket error", portnum(p));
+		return EV_FAULT_DETECTED;
+	}
+	if (port_tx_prune(p)) {
+		err = -1;
+	}
+	return err ? EV_FAULT_DETECTED : EV_NONE;
+}
+
+void port_tx_cleanup(void)
+{
+	struct tx_pending *txp;
+
+	while ((txp = TAILQ_FIRST(&tx_pool)) != NULL) {
+		TAILQ_REMOVE(&tx_pool, txp, list);
+		free(txp);
+	}
+}
+
+/*
+ * Returns the transport event to use for a message that needs a
+ * transmit time stamp, deferring the collection when configured.
+ */
+static enum transport_event port_tx_event(struct port *p)
+{
+	return p->tx_timestamp_async ? TRANS_DEFER_EVENT : TRANS_EVENT;
+}
+
 int port_capable(struct port *p)
 {
 	if (!port_is_ieee8021as(p)) {
@@ -679,12 +909,10 @@ not_capable:
 	return 0;
 }
 
-int port_clr_tmo(int fd)
+int port_clr_tmo(struct wheel_timer *t)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	wheel_timer_clear(t);
+	return 0;
 }
 
 static int port_ignore(struct port *p, struct ptp_message *m)
@@ -1078,7 +1306,7 @@ static void port_nrate_initialize(struct port *p)
 
 int port_set_announce_tmo(struct port *p)
 {
-	return set_tmo_random(p->fda.fd[FD_ANNOUNCE_TIMER],
+	return set_tmo_random(p->timer[FD_ANNOUNCE_TIMER],
 			      p->announceReceiptTimeout,
 			      p->announce_span, p->logAnnounceInterval);
 }
@@ -1090,34 +1318,34 @@ int port_set_delay_tmo(struct port *p)
 	}
 
 	if (p->delayMechanism == DM_P2P) {
-		return set_tmo_log(p->fda.fd[FD_DELAY_TIMER], 1,
+		return set_tmo_log(p->timer[FD_DELAY_TIMER], 1,
 			       p->logPdelayReqInterval);
 	} else {
-		return set_tmo_random(p->fda.fd[FD_DELAY_TIMER], 0, 2,
+		return set_tmo_random(p->timer[FD_DELAY_TIMER], 0, 2,
 				p->logMinDelayReqInterval);
 	}
 }
 
 static int port_set_manno_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, p->logAnnounceInterval);
+	return set_tmo_log(p->timer[FD_MANNO_TIMER], 1, p->logAnnounceInterval);
 }
 
 int port_set_qualification_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_QUALIFICATION_TIMER],
+	return set_tmo_log(p->timer[FD_QUALIFICATION_TIMER],
 		       1+clock_steps_removed(p->clock), p->logAnnounceInterval);
 }
 
 static int port_set_sync_rx_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_SYNC_RX_TIMER],
+	return set_tmo_log(p->timer[FD_SYNC_RX_TIMER],
 			   p->syncReceiptTimeout, p->logSyncInterval);
 }
 
 static int port_set_sync_tx_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_SYNC_TX_TIMER], 1, p->logSyncInterval);
+	return set_tmo_log(p->timer[FD_SYNC_TX_TIMER], 1, p->logSyncInterval);
 }
 
 void port_show_transition(struct port *p, enum port_state next,
@@ -1334,6 +1562,16 @@ static void port_syfufsm(struct port *p, enum syfu_event event,
 	}
 }
 
+static int port_pdelay_request_complete(struct port *p,
+					struct tx_pending *txp)
+{
+	/* The response may have overtaken the time stamp. */
+	if (p->peer_delay_req == txp->msg) {
+		port_peer_delay(p);
+	}
+	return 0;
+}
+
 static int port_pdelay_request(struct port *p)
 {
 	struct ptp_message *msg;
@@ -1368,12 +1606,16 @@ static int port_pdelay_request(struct port *p)
 		msg->header.flagField[0] |= UNICAST;
 	}
 
-	err = peer_prepare_and_send(p, msg, TRANS_EVENT);
+	err = peer_prepare_and_send(p, msg, port_tx_event(p));
 	if (err) {
 		pr_err("port %hu: send peer delay request failed", portnum(p));
 		goto out;
 	}
-	if (msg_sots_missing(msg)) {
+	if (p->tx_timestamp_async) {
+		if (!port_tx_defer(p, msg, port_pdelay_request_complete)) {
+			goto out;
+		}
+	} else if (msg_sots_missing(msg)) {
 		pr_err("missing timestamp on transmitted peer delay request");
 		goto out;
 	}
@@ -1391,6 +1633,43 @@ out:
 	return -1;
 }
 
+static void port_delay_response(struct port *p, struct ptp_message *req,
+				struct ptp_message *m)
+{
+	tmv_t c3, t3, t4, t4c;
+
+	c3 = correction_to_tmv(m->header.correction);
+	t3 = req->hwts.ts;
+	t4 = timestamp_to_tmv(m->ts.pdu);
+	t4c = tmv_sub(t4, c3);
+
+	monitor_delay(p->slave_event_monitor, clock_parent_identity(p->clock),
+		      m->header.sequenceId, t3, c3, t4);
+
+	clock_path_delay(p->clock, t3, t4c);
+
+	TAILQ_REMOVE(&p->delay_req, req, list);
+	msg_put(req);
+}
+
+static int port_delay_request_complete(struct port *p,
+				       struct tx_pending *txp)
+{
+	struct ptp_message *req;
+
+	/* Finish a response which overtook the time stamp. */
+	if (!txp->rsp) {
+		return 0;
+	}
+	TAILQ_FOREACH(req, &p->delay_req, list) {
+		if (req == txp->msg) {
+			port_delay_response(p, req, txp->rsp);
+			break;
+		}
+	}
+	return 0;
+}
+
 int port_delay_request(struct port *p)
 {
 	struct ptp_message *msg;
@@ -1432,11 +1711,15 @@ int port_delay_request(struct port *p)
 		msg->header.flagField[0] |= UNICAST;
 	}
 
-	if (port_prepare_and_send(p, msg, TRANS_EVENT)) {
+	if (port_prepare_and_send(p, msg, port_tx_event(p))) {
 		pr_err("port %hu: send delay request failed", portnum(p));
 		goto out;
 	}
-	if (msg_sots_missing(msg)) {
+	if (p->tx_timestamp_async) {
+		if (!port_tx_defer(p, msg, port_delay_request_complete)) {
+			goto out;
+		}
+	} else if (msg_sots_missing(msg)) {
 		pr_err("missing timestamp on transmitted delay request");
 		goto out;
 	}
@@ -1449,22 +1732,16 @@ out:
 	return -1;
 }
 
-int port_tx_announce(struct port *p, struct address *dst)
+static struct ptp_message *port_announce_msg(struct port *p,
+					      struct address *dst)
 {
 	struct timePropertiesDS tp = clock_time_properties(p->clock);
 	struct parent_ds *dad = clock_parent_ds(p->clock);
 	struct ptp_message *msg;
-	int err;
 
-	if (p->inhibit_multicast_service && !dst) {
-		return 0;
-	}
-	if (!port_capable(p)) {
-		return 0;
-	}
 	msg = msg_allocate();
 	if (!msg) {
-		return -1;
+		return NULL;
 	}
 
 	msg->hwts.type = p->timestamping;
@@ -1495,6 +1772,24 @@ int port_tx_announce(struct port *p, struct address *dst)
 	if (p->path_trace_enabled && path_trace_append(p, msg, dad)) {
 		pr_err("port %hu: append path trace failed", portnum(p));
 	}
+	return msg;
+}
+
+int port_tx_announce(struct port *p, struct address *dst)
+{
+	struct ptp_message *msg;
+	int err;
+
+	if (p->inhibit_multicast_service && !dst) {
+		return 0;
+	}
+	if (!port_capable(p)) {
+		return 0;
+	}
+	msg = port_announce_msg(p, dst);
+	if (!msg) {
+		return -1;
+	}
 
 	err = port_prepare_and_send(p, msg, TRANS_GENERAL);
 	if (err) {
@@ -1504,44 +1799,62 @@ int port_tx_announce(struct port *p, struct address *dst)
 	return err;
 }
 
-int port_tx_sync(struct port *p, struct address *dst)
+/*
+ * Prepares and sends a batch of messages, returning the number of
+ * messages that were sent.
+ */
+static int port_prepare_and_send_batch(struct port *p,
+				       struct ptp_message **msg, int n,
+				       enum transport_event event)
 {
-	struct ptp_message *msg, *fup;
-	int err, event;
+	int cnt, i;
 
-	switch (p->timestamping) {
-	case TS_SOFTWARE:
-	case TS_LEGACY_HW:
-	case TS_HARDWARE:
-		event = TRANS_EVENT;
-		break;
-	case TS_ONESTEP:
-		event = TRANS_ONESTEP;
-		break;
-	case TS_P2P1STEP:
-		event = TRANS_P2P1STEP;
-		break;
-	default:
-		return -1;
+	for (i = 0; i < n; i++) {
+		if (msg_pre_send(msg[i])) {
+			return -1;
+		}
 	}
-
-	if (p->inhibit_multicast_service && !dst) {
-		return 0;
+	cnt = transport_send_batch(p->trp, &p->fda, event, msg, n);
+	for (i = 0; i < cnt; i++) {
+		port_stats_inc_tx(p, msg[i]);
 	}
+	return cnt;
+}
+
+int port_tx_announce_batch(struct port *p, struct address **dst, int n)
+{
+	struct ptp_message *msg[TRANSPORT_BATCH_MAX];
+	int cnt, err = 0, i;
+
 	if (!port_capable(p)) {
 		return 0;
 	}
-	if (port_sync_incapable(p)) {
-		return 0;
+	for (i = 0; i < n; i++) {
+		msg[i] = port_announce_msg(p, dst[i]);
+		if (!msg[i]) {
+			err = -1;
+			break;
+		}
+	}
+	n = i;
+	cnt = port_prepare_and_send_batch(p, msg, n, TRANS_GENERAL);
+	if (cnt < n) {
+		pr_err("port %hu: send announce batch failed", portnum(p));
+		err = -1;
+	}
+	for (i = 0; i < n; i++) {
+		msg_put(msg[i]);
 	}
+	return err;
+}
+
+static struct ptp_message *port_sync_msg(struct port *p, struct address *dst)
+{
+	struct ptp_message *msg;
+
 	msg = msg_allocate();
 	if (!msg) {
-		return -1;
-	}
-	fup = msg_allocate();
-	if (!fup) {
-		msg_put(msg);
-		return -1;
+		return NULL;
 	}
 
 	msg->hwts.type = p->timestamping;
@@ -1564,22 +1877,19 @@ int port_tx_sync(struct port *p, struct address *dst)
 		msg->header.flagField[0] |= UNICAST;
 		msg->header.logMessageInterval = 0x7f;
 	}
-	err = port_prepare_and_send(p, msg, event);
-	if (err) {
-		pr_err("port %hu: send sync failed", portnum(p));
-		goto out;
-	}
-	if (p->timestamping == TS_ONESTEP || p->timestamping == TS_P2P1STEP) {
-		goto out;
-	} else if (msg_sots_missing(msg)) {
-		pr_err("missing timestamp on transmitted sync");
-		err = -1;
-		goto out;
-	}
+	return msg;
+}
+
+static struct ptp_message *port_follow_up_msg(struct port *p,
+					      struct ptp_message *msg)
+{
+	struct ptp_message *fup;
+
+	fup = msg_allocate();
+	if (!fup) {
+		return NULL;
+	}
 
-	/*
-	 * Send the follow up message right away.
-	 */
 	fup->hwts.type = p->timestamping;
 
 	fup->header.tsmt               = FOLLOW_UP | p->transportSpecific;
@@ -1587,35 +1897,327 @@ int port_tx_sync(struct port *p, struct address *dst)
 	fup->header.messageLength      = sizeof(struct follow_up_msg);
 	fup->header.domainNumber       = clock_domain_number(p->clock);
 	fup->header.sourcePortIdentity = p->portIdentity;
-	fup->header.sequenceId         = p->seqnum.sync - 1;
+	fup->header.sequenceId         = ntohs(msg->header.sequenceId);
 	fup->header.control            = CTL_FOLLOW_UP;
 	fup->header.logMessageInterval = p->logSyncInterval;
 
 	fup->follow_up.preciseOriginTimestamp = tmv_to_Timestamp(msg->hwts.ts);
 
-	if (dst) {
-		fup->address = *dst;
+	if (msg_unicast(msg)) {
+		fup->address = msg->address;
 		fup->header.flagField[0] |= UNICAST;
 	}
 	if (p->follow_up_info && follow_up_info_append(fup)) {
 		pr_err("port %hu: append fup info failed", portnum(p));
-		err = -1;
-		goto out;
+		msg_put(fup);
+		return NULL;
 	}
+	return fup;
+}
+
+static int port_tx_follow_up(struct port *p, struct ptp_message *msg)
+{
+	struct ptp_message *fup;
+	int err;
 
+	fup = port_follow_up_msg(p, msg);
+	if (!fup) {
+		return -1;
+	}
 	err = port_prepare_and_send(p, fup, TRANS_GENERAL);
 	if (err) {
 		pr_err("port %hu: send follow up failed", portnum(p));
 	}
+	msg_put(fup);
+	return err;
+}
+
+static int port_tx_sync_complete(struct port *p, struct tx_pending *txp)
+{
+	return port_tx_follow_up(p, txp->msg);
+}
+
+static int port_sync_event(struct port *p, int batch)
+{
+	switch (p->timestamping) {
+	case TS_SOFTWARE:
+	case TS_LEGACY_HW:
+	case TS_HARDWARE:
+		return batch ? TRANS_DEFER_EVENT : port_tx_event(p);
+	case TS_ONESTEP:
+		return TRANS_ONESTEP;
+	case TS_P2P1STEP:
+		return TRANS_P2P1STEP;
+	}
+	return -1;
+}
+
+int port_tx_sync(struct port *p, struct address *dst)
+{
+	struct ptp_message *msg;
+	int err, event;
+
+	event = port_sync_event(p, 0);
+	if (event < 0) {
+		return -1;
+	}
+	if (p->inhibit_multicast_service && !dst) {
+		return 0;
+	}
+	if (!port_capable(p)) {
+		return 0;
+	}
+	if (port_sync_incapable(p)) {
+		return 0;
+	}
+	msg = port_sync_msg(p, dst);
+	if (!msg) {
+		return -1;
+	}
+
+	err = port_prepare_and_send(p, msg, event);
+	if (err) {
+		pr_err("port %hu: send sync failed", portnum(p));
+		goto out;
+	}
+	if (p->timestamping == TS_ONESTEP || p->timestamping == TS_P2P1STEP) {
+		goto out;
+	} else if (event == TRANS_DEFER_EVENT) {
+		/*
+		 * The follow up goes out once the time stamp arrives.
+		 */
+		if (!port_tx_defer(p, msg, port_tx_sync_complete)) {
+			err = -1;
+		}
+		goto out;
+	} else if (msg_sots_missing(msg)) {
+		pr_err("missing timestamp on transmitted sync");
+		err = -1;
+		goto out;
+	}
+
+	/*
+	 * Send the follow up message right away.
+	 */
+	err = port_tx_follow_up(p, msg);
 out:
 	msg_put(msg);
-	msg_put(fup);
+	return err;
+}
+
+/*
+ * Collects the time stamps of a batch of event messages. The error
+ * queue is drained without blocking, and only once it runs dry does
+ * the port wait for the time stamps still missing, for what remains
+ * of one tx_timestamp_timeout. Entries belonging to deferred messages
+ * are completed on the way. Returns the number of messages left
+ * without a time stamp, or -1 if completing a deferred one failed.
+ */
+static int port_tx_collect(struct port *p, struct ptp_message **msg, int n)
+{
+	int cnt, i, missing = n, timeout = 0;
+	struct timespec start, now;
+	unsigned char pkt[1600];
+	int64_t elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (missing) {
+		struct hw_timestamp hwts = { .type = p->timestamping };
+
+		cnt = transport_txts_next(p->trp, &p->fda, pkt, sizeof(pkt),
+					  &hwts, timeout);
+		if (cnt == -EAGAIN && !timeout) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed = (now.tv_sec - start.tv_sec) * NSEC2SEC +
+				now.tv_nsec - start.tv_nsec;
+			timeout = sk_tx_timeout - elapsed / 1000000;
+			if (timeout <= 0) {
+				break;
+			}
+			continue;
+		}
+		if (cnt < 0) {
+			break;
+		}
+		timeout = 0;
+		if (cnt < sizeof(struct ptp_header)) {
+			pr_debug("port %hu: dropping short tx timestamp frame",
+				 portnum(p));
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			if (msg_sots_valid(msg[i])) {
+				continue;
+			}
+			if (memmem(pkt, cnt, &msg[i]->header,
+				   sizeof(struct ptp_header))) {
+				break;
+			}
+		}
+		if (i == n) {
+			if (port_tx_dispatch(p, pkt, cnt, &hwts)) {
+				return -1;
+			}
+			continue;
+		}
+		if (tmv_is_zero(hwts.ts)) {
+			continue;
+		}
+		msg[i]->hwts.ts = hwts.ts;
+		ts_add(&msg[i]->hwts.ts, p->tx_timestamp_offset);
+		missing--;
+	}
+	return missing;
+}
+
+int port_tx_sync_batch(struct port *p, struct address **dst, int n)
+{
+	struct ptp_message *msg[TRANSPORT_BATCH_MAX], *fup[TRANSPORT_BATCH_MAX];
+	int cnt, err = 0, event, i, nfup = 0, nmsg;
+
+	event = port_sync_event(p, 1);
+	if (event < 0) {
+		return -1;
+	}
+	if (!port_capable(p)) {
+		return 0;
+	}
+	if (port_sync_incapable(p)) {
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		msg[i] = port_sync_msg(p, dst[i]);
+		if (!msg[i]) {
+			err = -1;
+			break;
+		}
+	}
+	n = nmsg = i;
+
+	cnt = port_prepare_and_send_batch(p, msg, n, event);
+	if (cnt < n) {
+		pr_err("port %hu: send sync batch failed", portnum(p));
+		err = -1;
+		n = cnt > 0 ? cnt : 0;
+	}
+	if (p->timestamping == TS_ONESTEP || p->timestamping == TS_P2P1STEP) {
+		goto out;
+	}
+	if (p->tx_timestamp_async) {
+		for (i = 0; i < n; i++) {
+			if (!port_tx_defer(p, msg[i], port_tx_sync_complete)) {
+				err = -1;
+			}
+		}
+		goto out;
+	}
+	cnt = port_tx_collect(p, msg, n);
+	if (cnt > 0) {
+		pr_err("missing timestamp on transmitted sync batch");
+	}
+	if (cnt) {
+		err = -1;
+	}
+
+	/*
+	 * Send the follow up messages in one go.
+	 */
+	for (i = 0; i < n; i++) {
+		if (!msg_sots_valid(msg[i])) {
+			continue;
+		}
+		fup[nfup] = port_follow_up_msg(p, msg[i]);
+		if (!fup[nfup]) {
+			err = -1;
+			continue;
+		}
+		nfup++;
+	}
+	cnt = port_prepare_and_send_batch(p, fup, nfup, TRANS_GENERAL);
+	if (cnt < nfup) {
+		pr_err("port %hu: send follow up batch failed", portnum(p));
+		err = -1;
+	}
+	for (i = 0; i < nfup; i++) {
+		msg_put(fup[i]);
+	}
+out:
+	for (i = 0; i < nmsg; i++) {
+		msg_put(msg[i]);
+	}
 	return err;
 }
 
 /*
  * port initialize and disable
  */
+static int filter_equal(struct transport_filter *a,
+			struct transport_filter *b)
+{
+	return a->types == b->types &&
+		a->source_types == b->source_types &&
+		pid_eq(&a->source, &b->source) &&
+		a->domain == b->domain &&
+		a->transport_specific == b->transport_specific;
+}
+
+/*
+ * Lets the transport drop the messages which port_ignore() and the
+ * message handlers would discard in the current state, so that they
+ * never wake us up. Transparent clocks forward everything and do not
+ * use this.
+ */
+static void port_filter_update(struct port *p)
+{
+	struct transport_filter f;
+
+	if (!p->kernel_filter || !portnum(p) || !port_is_enabled(p)) {
+		return;
+	}
+	memset(&f, 0, sizeof(f));
+	f.types = 1 << ANNOUNCE | 1 << SIGNALING | 1 << MANAGEMENT;
+	f.domain = clock_domain_number(p->clock);
+	f.transport_specific =
+		p->match_transport_specific ? p->transportSpecific : -1;
+
+	if (p->delayMechanism != DM_E2E) {
+		f.types |= 1 << PDELAY_REQ | 1 << PDELAY_RESP |
+			1 << PDELAY_RESP_FOLLOW_UP;
+	}
+	if (p->net_sync_monitor) {
+		f.types |= 1 << DELAY_REQ;
+	}
+	switch (p->state) {
+	case PS_MASTER:
+	case PS_GRAND_MASTER:
+		f.types |= 1 << DELAY_REQ;
+		break;
+	case PS_UNCALIBRATED:
+	case PS_SLAVE:
+		f.types |= 1 << SYNC | 1 << FOLLOW_UP | 1 << DELAY_RESP;
+		if (!p->ignore_source_id) {
+			f.source_types = 1 << SYNC | 1 << FOLLOW_UP |
+				1 << DELAY_RESP;
+			f.source = clock_parent_identity(p->clock);
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (filter_equal(&f, &p->filter)) {
+		return;
+	}
+	if (transport_set_filter(p->trp, &p->fda, &f)) {
+		pr_warning("port %hu: failed to install receive filter",
+			   portnum(p));
+		memset(&p->filter, 0, sizeof(p->filter));
+		return;
+	}
+	p->filter = f;
+}
+
 int port_is_enabled(struct port *p)
 {
 	switch (p->state) {
@@ -1676,11 +2278,55 @@ static void port_clear_fda(struct port *p, int count)
 		p->fda.fd[i] = -1;
 }
 
+static void port_destroy_timers(struct port *p)
+{
+	int i;
+
+	for (i = 0; i < N_TIMER_FDS; i++) {
+		if (p->timer[FD_FIRST_TIMER + i]) {
+			wheel_timer_destroy(p->timer[FD_FIRST_TIMER + i]);
+			p->timer[FD_FIRST_TIMER + i] = NULL;
+		}
+	}
+	if (p->fault_timer) {
+		wheel_timer_destroy(p->fault_timer);
+		p->fault_timer = NULL;
+	}
+}
+
+/*
+ * The timers live in the clock's timer wheel for the whole lifetime
+ * of the port. Each one reports its FD_ index upon expiration, and
+ * the fault timer reports N_POLLFD.
+ */
+static int port_create_timers(struct port *p)
+{
+	struct wheel *w = clock_timer_wheel(p->clock);
+	int i;
+
+	for (i = 0; i < N_TIMER_FDS; i++) {
+		p->timer[FD_FIRST_TIMER + i] =
+			wheel_timer_create(w, p, FD_FIRST_TIMER + i);
+		if (!p->timer[FD_FIRST_TIMER + i]) {
+			return -1;
+		}
+	}
+	/* No need for a fault timer on the UDS port. */
+	if (portnum(p)) {
+		p->fault_timer = wheel_timer_create(w, p, N_POLLFD);
+		if (!p->fault_timer) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
 void port_disable(struct port *p)
 {
 	int i;
 
 	tc_flush(p);
+	port_tx_flush(p);
 	flush_last_sync(p);
 	flush_delay_req(p);
 	flush_peer_delay(p);
@@ -1690,18 +2336,17 @@ void port_disable(struct port *p)
 	transport_close(p->trp, &p->fda);
 
 	for (i = 0; i < N_TIMER_FDS; i++) {
-		close(p->fda.fd[FD_FIRST_TIMER + i]);
+		port_clr_tmo(p->timer[FD_FIRST_TIMER + i]);
 	}
 
-	/* Keep rtnl socket to get link status info. */
-	port_clear_fda(p, FD_RTNL);
-	clock_fda_changed(p->clock);
+	port_clear_fda(p, N_POLLFD);
+	clock_fda_changed(p->clock, p);
 }
 
 int port_initialize(struct port *p)
 {
 	struct config *cfg = clock_config(p->clock);
-	int fd[N_TIMER_FDS], i;
+	int i;
 
 	p->multiple_seq_pdr_count  = 0;
 	p->multiple_pdr_detected   = 0;
@@ -1739,22 +2384,9 @@ int port_initialize(struct port *p)
 		return -1;
 	}
 
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		fd[i] = -1;
-	}
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		fd[i] = timerfd_create(CLOCK_MONOTONIC, 0);
-		if (fd[i] < 0) {
-			pr_err("timerfd_create: %s", strerror(errno));
-			goto no_timers;
-		}
-	}
 	if (transport_open(p->trp, p->iface, &p->fda, p->timestamping))
 		goto no_tropen;
-
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		p->fda.fd[FD_FIRST_TIMER + i] = fd[i];
-	}
+	memset(&p->filter, 0, sizeof(p->filter));
 
 	if (port_set_announce_tmo(p)) {
 		goto no_tmo;
@@ -1763,7 +2395,7 @@ int port_initialize(struct port *p)
 		goto no_tmo;
 	}
 
-	/* No need to open rtnl socket on UDS port. */
+	/* No need to monitor the link of the UDS port. */
 	if (transport_type(p->trp) != TRANS_UDS) {
 		/*
 		 * The delay timer is usually started when the device
@@ -1773,28 +2405,20 @@ int port_initialize(struct port *p)
 		if (p->bmca == BMCA_NOOP) {
 			port_set_delay_tmo(p);
 		}
-		if (p->fda.fd[FD_RTNL] == -1) {
-			p->fda.fd[FD_RTNL] = rtnl_open();
-		}
-		if (p->fda.fd[FD_RTNL] >= 0) {
-			const char *ifname = interface_name(p->iface);
-			rtnl_link_query(p->fda.fd[FD_RTNL], ifname);
-		}
+		clock_link_query(p->clock, p);
 	}
 
 	port_nrate_initialize(p);
 
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 	return 0;
 
 no_tmo:
-	transport_close(p->trp, &p->fda);
-no_tropen:
-no_timers:
 	for (i = 0; i < N_TIMER_FDS; i++) {
-		if (fd[i] >= 0)
-			close(fd[i]);
+		port_clr_tmo(p->timer[FD_FIRST_TIMER + i]);
 	}
+	transport_close(p->trp, &p->fda);
+no_tropen:
 	return -1;
 }
 
@@ -1808,9 +2432,13 @@ static int port_renew_transport(struct port *p)
 	transport_close(p->trp, &p->fda);
 	port_clear_fda(p, FD_FIRST_TIMER);
 	res = transport_open(p->trp, p->iface, &p->fda, p->timestamping);
+	memset(&p->filter, 0, sizeof(p->filter));
+	if (!res) {
+		port_filter_update(p);
+	}
 	/* Need to call clock_fda_changed even if transport_open failed in
 	 * order to update clock to the now closed descriptors. */
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 	return res;
 }
 
@@ -1890,9 +2518,98 @@ int process_announce(struct port *p, struct ptp_message *m)
 	return result;
 }
 
+/*
+ * Builds the Delay_Resp templates for one receive batch. Only the
+ * fields taken from the request differ from message to message.
+ */
+static void delay_resp_prepare(struct port *p)
+{
+	struct delay_resp_msg *t;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		t = &p->delay_resp.template[i];
+		memset(t, 0, sizeof(*t));
+		t->hdr.tsmt               = DELAY_RESP | p->transportSpecific;
+		t->hdr.ver                = PTP_VERSION;
+		t->hdr.messageLength      = sizeof(struct delay_resp_msg);
+		t->hdr.domainNumber       = clock_domain_number(p->clock);
+		t->hdr.sourcePortIdentity = p->portIdentity;
+		t->hdr.control            = CTL_DELAY_RESP;
+		t->hdr.logMessageInterval = p->logMinDelayReqInterval;
+	}
+	t = &p->delay_resp.template[1];
+	t->hdr.flagField[0] |= UNICAST;
+	t->hdr.logMessageInterval = 0x7f;
+}
+
+static void delay_resp_report(struct port *p)
+{
+	struct delay_resp_batch *b = &p->delay_resp;
+	struct stats_result size, latency;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec < b->stats_tmo) {
+		return;
+	}
+	b->stats_tmo = now.tv_sec + b->stats_interval;
+
+	if (stats_get_result(b->size, &size)) {
+		return;
+	}
+	if (stats_get_result(b->latency, &latency)) {
+		memset(&latency, 0, sizeof(latency));
+	}
+	pr_info("port %hu: delay resp batches %u size %5.1f max %3.0f "
+		"latency %9.0f +/- %7.0f max %9.0f ns", portnum(p),
+		stats_get_num_values(b->size), size.mean, size.max,
+		latency.mean, latency.stddev, latency.max);
+	stats_reset(b->size);
+	stats_reset(b->latency);
+}
+
+/*
+ * Sends the Delay_Resp messages of a receive batch with as few system
+ * calls as the transport allows.
+ */
+static int delay_resp_flush(struct port *p)
+{
+	struct delay_resp_batch *b = &p->delay_resp;
+	clockid_t clkid = clock_clkid(p->clock);
+	int cnt, err = 0, i, n = b->n;
+	struct timespec now;
+	tmv_t t;
+
+	if (!n) {
+		return 0;
+	}
+	b->n = 0;
+
+	cnt = port_prepare_and_send_batch(p, b->msg, n, TRANS_GENERAL);
+	if (cnt < n) {
+		pr_err("port %hu: send delay response failed", portnum(p));
+		err = -1;
+	}
+	stats_add_value(b->size, n);
+	if (cnt > 0 && clkid != CLOCK_INVALID && !clock_gettime(clkid, &now)) {
+		t = timespec_to_tmv(now);
+		for (i = 0; i < cnt; i++) {
+			stats_add_value(b->latency,
+					tmv_dbl(tmv_sub(t, b->ingress[i])));
+		}
+	}
+	for (i = 0; i < n; i++) {
+		msg_put(b->msg[i]);
+	}
+	delay_resp_report(p);
+	return err;
+}
+
 static int process_delay_req(struct port *p, struct ptp_message *m)
 {
-	int err, nsm, saved_seqnum_sync;
+	struct delay_resp_batch *b = &p->delay_resp;
+	int err, nsm, saved_seqnum_sync, unicast;
 	struct ptp_message *msg;
 
 	nsm = port_nsm_reply(p, m);
@@ -1913,26 +2630,31 @@ static int process_delay_req(struct port *p, struct ptp_message *m)
 
 	msg->hwts.type = p->timestamping;
 
-	msg->header.tsmt               = DELAY_RESP | p->transportSpecific;
-	msg->header.ver                = PTP_VERSION;
-	msg->header.messageLength      = sizeof(struct delay_resp_msg);
-	msg->header.domainNumber       = m->header.domainNumber;
-	msg->header.correction         = m->header.correction;
-	msg->header.sourcePortIdentity = p->portIdentity;
-	msg->header.sequenceId         = m->header.sequenceId;
-	msg->header.control            = CTL_DELAY_RESP;
-	msg->header.logMessageInterval = p->logMinDelayReqInterval;
-
+	if (!b->n) {
+		delay_resp_prepare(p);
+	}
+	unicast = p->hybrid_e2e && msg_unicast(m);
+	msg->delay_resp = b->template[unicast];
+	msg->header.correction = m->header.correction;
+	msg->header.sequenceId = m->header.sequenceId;
 	msg->delay_resp.receiveTimestamp = tmv_to_Timestamp(m->hwts.ts);
-
 	msg->delay_resp.requestingPortIdentity = m->header.sourcePortIdentity;
-
-	if (p->hybrid_e2e && msg_unicast(m)) {
+	if (unicast) {
 		msg->address = m->address;
-		msg->header.flagField[0] |= UNICAST;
-		msg->header.logMessageInterval = 0x7f;
 	}
-	if (nsm && net_sync_resp_append(p, msg)) {
+
+	if (!nsm) {
+		/* Sent by delay_resp_flush() at the end of the batch. */
+		if (b->n == TRANSPORT_BATCH_MAX && delay_resp_flush(p)) {
+			msg_put(msg);
+			return -1;
+		}
+		b->ingress[b->n] = m->hwts.ts;
+		b->msg[b->n++] = msg;
+		return 0;
+	}
+
+	if (net_sync_resp_append(p, msg)) {
 		pr_err("port %hu: append NSM failed", portnum(p));
 		err = -1;
 		goto out;
@@ -1942,12 +2664,10 @@ static int process_delay_req(struct port *p, struct ptp_message *m)
 		pr_err("port %hu: send delay response failed", portnum(p));
 		goto out;
 	}
-	if (nsm) {
-		saved_seqnum_sync = p->seqnum.sync;
-		p->seqnum.sync = m->header.sequenceId;
-		err = port_tx_sync(p, &m->address);
-		p->seqnum.sync = saved_seqnum_sync;
-	}
+	saved_seqnum_sync = p->seqnum.sync;
+	p->seqnum.sync = m->header.sequenceId;
+	err = port_tx_sync(p, &m->address);
+	p->seqnum.sync = saved_seqnum_sync;
 out:
 	msg_put(msg);
 	return err;
@@ -1956,8 +2676,8 @@ out:
 void process_delay_resp(struct port *p, struct ptp_message *m)
 {
 	struct delay_resp_msg *rsp = &m->delay_resp;
+	struct tx_pending *txp;
 	struct ptp_message *req;
-	tmv_t c3, t3, t4, t4c;
 
 	if (p->state != PS_UNCALIBRATED && p->state != PS_SLAVE) {
 		return;
@@ -1976,19 +2696,23 @@ void process_delay_resp(struct port *p, struct ptp_message *m)
 	if (!req) {
 		return;
 	}
-
-	c3 = correction_to_tmv(m->header.correction);
-	t3 = req->hwts.ts;
-	t4 = timestamp_to_tmv(m->ts.pdu);
-	t4c = tmv_sub(t4, c3);
-
-	monitor_delay(p->slave_event_monitor, clock_parent_identity(p->clock),
-		      m->header.sequenceId, t3, c3, t4);
-
-	clock_path_delay(p->clock, t3, t4c);
-
-	TAILQ_REMOVE(&p->delay_req, req, list);
-	msg_put(req);
+	if (msg_sots_missing(req)) {
+		/* Hold the response until the time stamp is collected. */
+		TAILQ_FOREACH(txp, &p->tx_pending, list) {
+			if (txp->msg == req) {
+				break;
+			}
+		}
+		if (!txp || txp->rsp) {
+			return;
+		}
+		pr_debug("port %hu: delay response overtook tx timestamp",
+			 portnum(p));
+		msg_get(m);
+		txp->rsp = m;
+	} else {
+		port_delay_response(p, req, m);
+	}
 
 	if (p->logMinDelayReqInterval == rsp->hdr.logMessageInterval) {
 		return;
@@ -2031,26 +2755,73 @@ void process_follow_up(struct port *p, struct ptp_message *m)
 		return;
 	}
 
-	if (p->follow_up_info) {
-		struct follow_up_info_tlv *fui = follow_up_info_extract(m);
-		if (!fui)
-			return;
-		clock_follow_up_info(p->clock, fui);
+	if (p->follow_up_info) {
+		struct follow_up_info_tlv *fui = follow_up_info_extract(m);
+		if (!fui)
+			return;
+		clock_follow_up_info(p->clock, fui);
+	}
+
+	if (p->syfu == SF_HAVE_SYNC &&
+	    p->last_syncfup->header.sequenceId == m->header.sequenceId) {
+		event = FUP_MATCH;
+	} else {
+		event = FUP_MISMATCH;
+	}
+	port_syfufsm(p, event, m);
+}
+
+static int port_tx_pdelay_resp_fup(struct port *p, struct ptp_message *m,
+				   struct ptp_message *rsp)
+{
+	struct ptp_message *fup;
+	int err;
+
+	fup = msg_allocate();
+	if (!fup) {
+		return -1;
+	}
+
+	fup->hwts.type = p->timestamping;
+
+	fup->header.tsmt               = PDELAY_RESP_FOLLOW_UP | p->transportSpecific;
+	fup->header.ver                = PTP_VERSION;
+	fup->header.messageLength      = sizeof(struct pdelay_resp_fup_msg);
+	fup->header.domainNumber       = m->header.domainNumber;
+	fup->header.correction         = m->header.correction;
+	fup->header.sourcePortIdentity = p->portIdentity;
+	fup->header.sequenceId         = m->header.sequenceId;
+	fup->header.control            = CTL_OTHER;
+	fup->header.logMessageInterval = 0x7f;
+
+	fup->pdelay_resp_fup.requestingPortIdentity = m->header.sourcePortIdentity;
+
+	fup->pdelay_resp_fup.responseOriginTimestamp =
+		tmv_to_Timestamp(rsp->hwts.ts);
+
+	if (msg_unicast(m)) {
+		fup->address = m->address;
+		fup->header.flagField[0] |= UNICAST;
+	}
+
+	err = peer_prepare_and_send(p, fup, TRANS_GENERAL);
+	if (err) {
+		pr_err("port %hu: send pdelay_resp_fup failed", portnum(p));
 	}
+	msg_put(fup);
+	return err;
+}
 
-	if (p->syfu == SF_HAVE_SYNC &&
-	    p->last_syncfup->header.sequenceId == m->header.sequenceId) {
-		event = FUP_MATCH;
-	} else {
-		event = FUP_MISMATCH;
-	}
-	port_syfufsm(p, event, m);
+static int port_pdelay_resp_complete(struct port *p, struct tx_pending *txp)
+{
+	return port_tx_pdelay_resp_fup(p, txp->req, txp->msg);
 }
 
 int process_pdelay_req(struct port *p, struct ptp_message *m)
 {
-	struct ptp_message *rsp, *fup;
+	struct ptp_message *rsp;
 	enum transport_event event;
+	struct tx_pending *txp;
 	int err;
 
 	switch (p->timestamping) {
@@ -2058,7 +2829,7 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 	case TS_LEGACY_HW:
 	case TS_HARDWARE:
 	case TS_ONESTEP:
-		event = TRANS_EVENT;
+		event = port_tx_event(p);
 		break;
 	case TS_P2P1STEP:
 		event = TRANS_P2P1STEP;
@@ -2097,12 +2868,6 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 		return -1;
 	}
 
-	fup = msg_allocate();
-	if (!fup) {
-		msg_put(rsp);
-		return -1;
-	}
-
 	rsp->hwts.type = p->timestamping;
 
 	rsp->header.tsmt               = PDELAY_RESP | p->transportSpecific;
@@ -2142,6 +2907,15 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 	}
 	if (p->timestamping == TS_P2P1STEP) {
 		goto out;
+	} else if (event == TRANS_DEFER_EVENT) {
+		txp = port_tx_defer(p, rsp, port_pdelay_resp_complete);
+		if (!txp) {
+			err = -1;
+		} else {
+			msg_get(m);
+			txp->req = m;
+		}
+		goto out;
 	} else if (msg_sots_missing(rsp)) {
 		pr_err("missing timestamp on transmitted peer delay response");
 		err = -1;
@@ -2151,35 +2925,9 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 	/*
 	 * Send the follow up message right away.
 	 */
-	fup->hwts.type = p->timestamping;
-
-	fup->header.tsmt               = PDELAY_RESP_FOLLOW_UP | p->transportSpecific;
-	fup->header.ver                = PTP_VERSION;
-	fup->header.messageLength      = sizeof(struct pdelay_resp_fup_msg);
-	fup->header.domainNumber       = m->header.domainNumber;
-	fup->header.correction         = m->header.correction;
-	fup->header.sourcePortIdentity = p->portIdentity;
-	fup->header.sequenceId         = m->header.sequenceId;
-	fup->header.control            = CTL_OTHER;
-	fup->header.logMessageInterval = 0x7f;
-
-	fup->pdelay_resp_fup.requestingPortIdentity = m->header.sourcePortIdentity;
-
-	fup->pdelay_resp_fup.responseOriginTimestamp =
-		tmv_to_Timestamp(rsp->hwts.ts);
-
-	if (msg_unicast(m)) {
-		fup->address = m->address;
-		fup->header.flagField[0] |= UNICAST;
-	}
-
-	err = peer_prepare_and_send(p, fup, TRANS_GENERAL);
-	if (err) {
-		pr_err("port %hu: send pdelay_resp_fup failed", portnum(p));
-	}
+	err = port_tx_pdelay_resp_fup(p, m, rsp);
 out:
 	msg_put(rsp);
-	msg_put(fup);
 	return err;
 }
 
@@ -2195,6 +2943,10 @@ static void port_peer_delay(struct port *p)
 	if (!rsp)
 		return;
 
+	/* Wait for the deferred transmit time stamp. */
+	if (msg_sots_missing(req))
+		return;
+
 	if (!pid_eq(&rsp->pdelay_resp.requestingPortIdentity, &p->portIdentity))
 		return;
 
@@ -2371,17 +3123,13 @@ void port_close(struct port *p)
 		port_disable(p);
 	}
 
-	if (p->fda.fd[FD_RTNL] >= 0) {
-		rtnl_close(p->fda.fd[FD_RTNL]);
-	}
-
 	unicast_client_cleanup(p);
 	unicast_service_cleanup(p);
 	transport_destroy(p->trp);
 	tsproc_destroy(p->tsproc);
-	if (p->fault_fd >= 0) {
-		close(p->fault_fd);
-	}
+	stats_destroy(p->delay_resp.size);
+	stats_destroy(p->delay_resp.latency);
+	port_destroy_timers(p);
 	free(p);
 }
 
@@ -2422,12 +3170,12 @@ struct foreign_clock *port_compute_best(struct port *p)
 
 static void port_e2e_transition(struct port *p, enum port_state next)
 {
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_DELAY_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(p->timer[FD_ANNOUNCE_TIMER]);
+	port_clr_tmo(p->timer[FD_SYNC_RX_TIMER]);
+	port_clr_tmo(p->timer[FD_DELAY_TIMER]);
+	port_clr_tmo(p->timer[FD_QUALIFICATION_TIMER]);
+	port_clr_tmo(p->timer[FD_MANNO_TIMER]);
+	port_clr_tmo(p->timer[FD_SYNC_TX_TIMER]);
 	/* Leave FD_UNICAST_REQ_TIMER running. */
 
 	switch (next) {
@@ -2446,7 +3194,7 @@ static void port_e2e_transition(struct port *p, enum port_state next)
 	case PS_MASTER:
 	case PS_GRAND_MASTER:
 		if (!p->inhibit_announce) {
-			set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, -10); /*~1ms*/
+			set_tmo_log(p->timer[FD_MANNO_TIMER], 1, -10); /*~1ms*/
 		}
 		port_set_sync_tx_tmo(p);
 		break;
@@ -2466,12 +3214,12 @@ static void port_e2e_transition(struct port *p, enum port_state next)
 
 static void port_p2p_transition(struct port *p, enum port_state next)
 {
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+	port_clr_tmo(p->timer[FD_ANNOUNCE_TIMER]);
+	port_clr_tmo(p->timer[FD_SYNC_RX_TIMER]);
 	/* Leave FD_DELAY_TIMER running. */
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(p->timer[FD_QUALIFICATION_TIMER]);
+	port_clr_tmo(p->timer[FD_MANNO_TIMER]);
+	port_clr_tmo(p->timer[FD_SYNC_TX_TIMER]);
 	/* Leave FD_UNICAST_REQ_TIMER running. */
 
 	switch (next) {
@@ -2491,7 +3239,7 @@ static void port_p2p_transition(struct port *p, enum port_state next)
 	case PS_MASTER:
 	case PS_GRAND_MASTER:
 		if (!p->inhibit_announce) {
-			set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, -10); /*~1ms*/
+			set_tmo_log(p->timer[FD_MANNO_TIMER], 1, -10); /*~1ms*/
 		}
 		port_set_sync_tx_tmo(p);
 		break;
@@ -2522,6 +3270,12 @@ static void bc_dispatch(struct port *p, enum fsm_event event, int mdiff)
 	}
 
 	if (!port_state_update(p, event, mdiff)) {
+		/*
+		 * A new parent may be selected without a change of
+		 * state, as in UNCALIBRATED, and the filter matches the
+		 * parent's identity. Unchanged filters are not reloaded.
+		 */
+		port_filter_update(p);
 		return;
 	}
 
@@ -2531,6 +3285,8 @@ static void bc_dispatch(struct port *p, enum fsm_event event, int mdiff)
 		port_e2e_transition(p, p->state);
 	}
 
+	port_filter_update(p);
+
 	if (p->jbod && p->state == PS_UNCALIBRATED) {
 		if (clock_switch_phc(p->clock, p->phc_index)) {
 			p->last_fault_type = FT_SWITCH_PHC;
@@ -2599,99 +3355,48 @@ void port_link_status(void *ctx, int linkup, int ts_index)
 		clock_set_sde(p->clock, 1);
 }
 
-enum fsm_event port_event(struct port *p, int fd_index)
+static enum fsm_event port_tx_poll(struct port *p)
 {
-	return p->event(p, fd_index);
+	if (port_tx_pending(p) && transport_txts_pending(p->trp)) {
+		return port_tx_complete(p);
+	}
+	return EV_NONE;
 }
 
-static enum fsm_event bc_event(struct port *p, int fd_index)
+/*
+ * With an io_uring, the transmit time stamps are signaled through the
+ * same descriptor as the received messages, for boundary and
+ * transparent clocks alike, so they are collected here. Those already
+ * queued are taken first, as a response might depend on them. The
+ * FD_TX_TIMER fires when the oldest deferred time stamp is overdue.
+ */
+enum fsm_event port_event(struct port *p, int fd_index)
 {
-	enum fsm_event event = EV_NONE;
-	struct ptp_message *msg;
-	int cnt, fd = p->fda.fd[fd_index], err;
-
-	switch (fd_index) {
-	case FD_ANNOUNCE_TIMER:
-	case FD_SYNC_RX_TIMER:
-		pr_debug("port %hu: %s timeout", portnum(p),
-			 fd_index == FD_SYNC_RX_TIMER ? "rx sync" : "announce");
-		if (p->best) {
-			fc_clear(p->best);
-		}
-
-		/*
-		 * Clear out the event returned by poll(). It is only cleared
-		 * in port_*_transition(). But, when BMCA == 'noop', there is no
-		 * state transition. So, it won't be cleared anywhere else.
-		 */
-		if (p->bmca == BMCA_NOOP) {
-			port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
-		}
-
-		if (p->inhibit_announce) {
-			port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-		} else {
-			port_set_announce_tmo(p);
-		}
-
-		delay_req_prune(p);
-		if (clock_slave_only(p->clock) && p->delayMechanism != DM_P2P &&
-		    port_renew_transport(p)) {
-			return EV_FAULT_DETECTED;
-		}
-
-		if (p->inhibit_announce) {
-			return EV_NONE;
-		}
-		return EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES;
-
-	case FD_DELAY_TIMER:
-		pr_debug("port %hu: delay timeout", portnum(p));
-		port_set_delay_tmo(p);
-		delay_req_prune(p);
-		return port_delay_request(p) ? EV_FAULT_DETECTED : EV_NONE;
-
-	case FD_QUALIFICATION_TIMER:
-		pr_debug("port %hu: qualification timeout", portnum(p));
-		return EV_QUALIFICATION_TIMEOUT_EXPIRES;
-
-	case FD_MANNO_TIMER:
-		pr_debug("port %hu: master tx announce timeout", portnum(p));
-		port_set_manno_tmo(p);
-		return port_tx_announce(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
-
-	case FD_SYNC_TX_TIMER:
-		pr_debug("port %hu: master sync timeout", portnum(p));
-		port_set_sync_tx_tmo(p);
-		return port_tx_sync(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
-
-	case FD_UNICAST_SRV_TIMER:
-		pr_debug("port %hu: unicast service timeout", portnum(p));
-		return unicast_service_timer(p) ? EV_FAULT_DETECTED : EV_NONE;
+	enum fsm_event ev, event;
 
-	case FD_UNICAST_REQ_TIMER:
-		pr_debug("port %hu: unicast request timeout", portnum(p));
-		return unicast_client_timer(p) ? EV_FAULT_DETECTED : EV_NONE;
-
-	case FD_RTNL:
-		pr_debug("port %hu: received link status notification", portnum(p));
-		rtnl_link_status(fd, p->name, port_link_status, p);
-		if (p->link_status == (LINK_UP | LINK_STATE_CHANGED))
-			return EV_FAULT_CLEARED;
-		else if ((p->link_status == (LINK_DOWN | LINK_STATE_CHANGED)) ||
-			 (p->link_status & TS_LABEL_CHANGED))
-			return EV_FAULT_DETECTED;
-		else
-			return EV_NONE;
+	if (fd_index == FD_TX_TIMER) {
+		return port_tx_prune(p) ? EV_FAULT_DETECTED : EV_NONE;
 	}
+	event = port_tx_poll(p);
+	if (event != EV_NONE) {
+		return event;
+	}
+	event = p->event(p, fd_index);
+	ev = port_tx_poll(p);
+	if (ev != EV_NONE) {
+		event = ev;
+	}
+	return event;
+}
 
-	msg = msg_allocate();
-	if (!msg)
-		return EV_FAULT_DETECTED;
-
-	msg->hwts.type = p->timestamping;
+/*
+ * Processes one received message and releases it.
+ */
+static enum fsm_event bc_rx(struct port *p, struct ptp_message *msg, int cnt)
+{
+	enum fsm_event event = EV_NONE;
+	int err;
 
-	cnt = transport_recv(p->trp, fd, msg);
 	if (cnt < 0) {
 		pr_err("port %hu: recv message failed", portnum(p));
 		msg_put(msg);
@@ -2771,6 +3476,134 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 	return event;
 }
 
+/*
+ * Receives up to rx_batch_size messages from 'fd' and passes each one
+ * to 'rx_msg', which releases it. Boundary and transparent clocks
+ * share this loop.
+ */
+enum fsm_event port_rx_batch(struct port *p, int fd,
+			     enum fsm_event (*rx_msg)(struct port *p,
+						      struct ptp_message *msg,
+						      int cnt))
+{
+	struct ptp_message *msg[TRANSPORT_BATCH_MAX];
+	int i, n, rx, cnt[TRANSPORT_BATCH_MAX];
+	enum fsm_event ev, event = EV_NONE;
+
+	for (n = 0; n < p->rx_batch; n++) {
+		msg[n] = msg_allocate();
+		if (!msg[n])
+			break;
+		msg[n]->hwts.type = p->timestamping;
+	}
+	if (!n)
+		return EV_FAULT_DETECTED;
+
+	rx = transport_recv_batch(p->trp, fd, msg, cnt, n);
+	if (rx == -EAGAIN) {
+		rx = 0;
+	} else if (rx < 0) {
+		pr_err("port %hu: recv message failed", portnum(p));
+		rx = 0;
+		event = EV_FAULT_DETECTED;
+	}
+
+	/*
+	 * Drain the whole batch. The state decisions of the messages are
+	 * made together by the clock, but a fault drops the rest.
+	 */
+	for (i = 0; i < rx; i++) {
+		if (event == EV_FAULT_DETECTED) {
+			msg_put(msg[i]);
+			continue;
+		}
+		ev = rx_msg(p, msg[i], cnt[i]);
+		if (ev != EV_NONE)
+			event = ev;
+	}
+	for (i = rx; i < n; i++) {
+		msg_put(msg[i]);
+	}
+	return event;
+}
+
+static enum fsm_event bc_event(struct port *p, int fd_index)
+{
+	enum fsm_event event;
+	int fd = p->fda.fd[fd_index];
+
+	switch (fd_index) {
+	case FD_ANNOUNCE_TIMER:
+	case FD_SYNC_RX_TIMER:
+		pr_debug("port %hu: %s timeout", portnum(p),
+			 fd_index == FD_SYNC_RX_TIMER ? "rx sync" : "announce");
+		if (p->best) {
+			fc_clear(p->best);
+		}
+
+		if (p->inhibit_announce) {
+			port_clr_tmo(p->timer[FD_ANNOUNCE_TIMER]);
+		} else {
+			port_set_announce_tmo(p);
+		}
+
+		delay_req_prune(p);
+		if (clock_slave_only(p->clock) && p->delayMechanism != DM_P2P &&
+		    port_renew_transport(p)) {
+			return EV_FAULT_DETECTED;
+		}
+
+		if (p->inhibit_announce) {
+			return EV_NONE;
+		}
+		return EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES;
+
+	case FD_DELAY_TIMER:
+		pr_debug("port %hu: delay timeout", portnum(p));
+		port_set_delay_tmo(p);
+		delay_req_prune(p);
+		return port_delay_request(p) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_QUALIFICATION_TIMER:
+		pr_debug("port %hu: qualification timeout", portnum(p));
+		return EV_QUALIFICATION_TIMEOUT_EXPIRES;
+
+	case FD_MANNO_TIMER:
+		pr_debug("port %hu: master tx announce timeout", portnum(p));
+		port_set_manno_tmo(p);
+		return port_tx_announce(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_SYNC_TX_TIMER:
+		pr_debug("port %hu: master sync timeout", portnum(p));
+		port_set_sync_tx_tmo(p);
+		return port_tx_sync(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_UNICAST_SRV_TIMER:
+		pr_debug("port %hu: unicast service timeout", portnum(p));
+		return unicast_service_timer(p) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_UNICAST_REQ_TIMER:
+		pr_debug("port %hu: unicast request timeout", portnum(p));
+		return unicast_client_timer(p) ? EV_FAULT_DETECTED : EV_NONE;
+
+	case FD_RTNL:
+		pr_debug("port %hu: received link status notification", portnum(p));
+		if (p->link_status == (LINK_UP | LINK_STATE_CHANGED))
+			return EV_FAULT_CLEARED;
+		else if ((p->link_status == (LINK_DOWN | LINK_STATE_CHANGED)) ||
+			 (p->link_status & TS_LABEL_CHANGED))
+			return EV_FAULT_DETECTED;
+		else
+			return EV_NONE;
+	}
+
+	event = port_rx_batch(p, fd, bc_rx);
+	if (delay_resp_flush(p)) {
+		event = EV_FAULT_DETECTED;
+	}
+	return event;
+}
+
 int port_forward(struct port *p, struct ptp_message *msg)
 {
 	int cnt;
@@ -2795,6 +3628,17 @@ int port_forward_to(struct port *p, struct ptp_message *msg)
 	return 0;
 }
 
+int port_forward_batch(struct port *p, struct ptp_message **msg, int n)
+{
+	int cnt, i;
+
+	cnt = transport_send_batch(p->trp, &p->fda, TRANS_GENERAL, msg, n);
+	for (i = 0; i < cnt; i++) {
+		port_stats_inc_tx(p, msg[i]);
+	}
+	return cnt;
+}
+
 int port_prepare_and_send(struct port *p, struct ptp_message *msg,
 			  enum transport_event event)
 {
@@ -3021,7 +3865,8 @@ struct port *port_open(const char *phc_device,
 	}
 
 	memset(p, 0, sizeof(*p));
-	TAILQ_INIT(&p->tc_transmitted);
+	tc_init(p);
+	TAILQ_INIT(&p->tx_pending);
 
 	switch (type) {
 	case CLOCK_TYPE_ORDINARY:
@@ -3090,10 +3935,13 @@ struct port *port_open(const char *phc_device,
 	p->announce_span = transport == TRANS_UDS ? 0 : ANNOUNCE_SPAN;
 	p->follow_up_info = config_get_int(cfg, p->name, "follow_up_info");
 	p->freq_est_interval = config_get_int(cfg, p->name, "freq_est_interval");
+	p->kernel_filter = config_get_int(cfg, p->name, "kernel_filter");
 	p->msg_interval_request = config_get_int(cfg, p->name, "msg_interval_request");
 	p->net_sync_monitor = config_get_int(cfg, p->name, "net_sync_monitor");
 	p->path_trace_enabled = config_get_int(cfg, p->name, "path_trace_enabled");
 	p->tc_spanning_tree = config_get_int(cfg, p->name, "tc_spanning_tree");
+	p->tx_timestamp_async = config_get_int(cfg, NULL, "tx_timestamp_async");
+	p->rx_batch = config_get_int(cfg, NULL, "rx_batch_size");
 	p->rx_timestamp_offset = config_get_int(cfg, p->name, "ingressLatency");
 	p->rx_timestamp_offset <<= 16;
 	p->tx_timestamp_offset = config_get_int(cfg, p->name, "egressLatency");
@@ -3160,18 +4008,31 @@ struct port *port_open(const char *phc_device,
 	}
 	p->nrate.ratio = 1.0;
 
+	p->delay_resp.size = stats_create();
+	p->delay_resp.latency = stats_create();
+	if (!p->delay_resp.size || !p->delay_resp.latency) {
+		pr_err("failed to create delay response statistics");
+		goto err_stats;
+	}
+	i = config_get_int(cfg, NULL, "summary_interval");
+	p->delay_resp.stats_interval = i > 0 ? 1 << i : 1;
+
 	port_clear_fda(p, N_POLLFD);
-	p->fault_fd = -1;
-	if (number) {
-		p->fault_fd = timerfd_create(CLOCK_MONOTONIC, 0);
-		if (p->fault_fd < 0) {
-			pr_err("timerfd_create failed: %m");
-			goto err_tsproc;
-		}
+	if (port_create_timers(p)) {
+		pr_err("failed to create timers");
+		goto err_tsproc;
 	}
 	return p;
 
 err_tsproc:
+	port_destroy_timers(p);
+err_stats:
+	if (p->delay_resp.size) {
+		stats_destroy(p->delay_resp.size);
+	}
+	if (p->delay_resp.latency) {
+		stats_destroy(p->delay_resp.latency);
+	}
 	tsproc_destroy(p->tsproc);
 err_uc_service:
 	unicast_service_cleanup(p);
@@ -25,6 +25,7 @@
 #include "fsm.h"
 #include "notification.h"
 #include "transport.h"
+#include "wheel.h"
 
 /* forward declarations */
 struct interface;
@@ -85,6 +86,26 @@ void port_dispatch(struct port *p, enum fsm_event event, int mdiff);
  */
 enum fsm_event port_event(struct port *port, int fd_index);
 
+/**
+ * Tests whether a port has event messages awaiting their transmit
+ * time stamps.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return     One if time stamps are pending, zero otherwise.
+ */
+int port_tx_pending(struct port *port);
+
+/**
+ * Collects the transmit time stamps queued on a port's event socket
+ * and completes the work deferred until their arrival. Time stamps
+ * matching no pending message are dropped. Call this when the event
+ * socket signals its error queue.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return     One of the @a fsm_event codes.
+ */
+enum fsm_event port_tx_complete(struct port *port);
+
 /**
  * Forward a message on a given port.
  * @param port    A pointer previously obtained via port_open().
@@ -101,6 +122,18 @@ int port_forward(struct port *p, struct ptp_message *msg);
  */
 int port_forward_to(struct port *p, struct ptp_message *msg);
 
+/**
+ * Forward a batch of messages on a given port, each to the address
+ * stored in the message, using as few system calls as the transport
+ * allows.
+ * @param port    A pointer previously obtained via port_open().
+ * @param msg     The messages to send. Must be in network byte order.
+ * @param n       Number of messages, at most TRANSPORT_BATCH_MAX.
+ * @return        The number of messages sent, or negative errno value
+ *                if none could be sent.
+ */
+int port_forward_batch(struct port *p, struct ptp_message **msg, int n);
+
 /**
  * Prepare message for transmission and send it to a given port. Note that
  * a single message cannot be sent several times using this function, that
@@ -134,6 +167,16 @@ int port_number(struct port *p);
  */
 int port_link_status_get(struct port *p);
 
+/**
+ * Update the link status of a port. This is invoked for each link
+ * event concerning the port's interface.
+ * @param ctx      A port instance.
+ * @param linkup   One (1) if the link is up, zero otherwise.
+ * @param ts_index The index of the interface that time stamps the
+ *                 port's packets, or -1 if it is the port's own.
+ */
+void port_link_status(void *ctx, int linkup, int ts_index);
+
 /**
  * Manage a port according to a given message.
  * @param p        A pointer previously obtained via port_open().
@@ -247,58 +290,51 @@ int port_state_update(struct port *p, enum fsm_event event, int mdiff);
 struct fdarray *port_fda(struct port *port);
 
 /**
- * Return file descriptor of the port.
- * @param port	A port instance.
- * @return	File descriptor or -1 if not applicable.
- */
-int port_fault_fd(struct port *port);
-
-/**
- * Utility function for setting or resetting a file descriptor timer.
+ * Utility function for setting or resetting a timer.
  *
- * This function sets the timer 'fd' to the value M(2^N), where M is
+ * This function sets the timer 't' to the value M(2^N), where M is
  * the value of the 'scale' parameter and N in the value of the
  * 'log_seconds' parameter.
  *
  * Passing both 'scale' and 'log_seconds' as zero disables the timer.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param t A timer previously created with wheel_timer_create().
  * @param scale The multiplicative factor for the timer.
  * @param log_seconds The exponential factor for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_log(int fd, unsigned int scale, int log_seconds);
+int set_tmo_log(struct wheel_timer *t, unsigned int scale, int log_seconds);
 
 /**
- * Utility function for setting a file descriptor timer.
+ * Utility function for setting a timer.
  *
- * This function sets the timer 'fd' to a random value between M * 2^N and
+ * This function sets the timer 't' to a random value between M * 2^N and
  * (M + S) * 2^N, where M is the value of the 'min' parameter, S is the value
  * of the 'span' parameter, and N in the value of the 'log_seconds' parameter.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param t A timer previously created with wheel_timer_create().
  * @param min The minimum value for the timer.
  * @param span The span value for the timer. Must be a positive value.
  * @param log_seconds The exponential factor for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_random(int fd, int min, int span, int log_seconds);
+int set_tmo_random(struct wheel_timer *t, int min, int span, int log_seconds);
 
 /**
- * Utility function for setting or resetting a file descriptor timer.
+ * Utility function for setting or resetting a timer.
  *
- * This function sets the timer 'fd' to the value of the 'seconds' parameter.
+ * This function sets the timer 't' to the value of the 'seconds' parameter.
  *
  * Passing 'seconds' as zero disables the timer.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param t A timer previously created with wheel_timer_create().
  * @param seconds The timeout value for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_lin(int fd, int seconds);
+int set_tmo_lin(struct wheel_timer *t, int seconds);
 
 /**
- * Sets port's fault file descriptor timer.
+ * Sets port's fault timer.
  * Passing both 'scale' and 'log_seconds' as zero disables the timer.
  *
  * @param fd		A port instance.
@@ -310,7 +346,7 @@ int port_set_fault_timer_log(struct port *port,
 			     unsigned int scale, int log_seconds);
 
 /**
- * Sets port's fault file descriptor timer.
+ * Sets port's fault timer.
  * Passing 'seconds' as zero disables the timer.
  *
  * @param fd		A port instance.
@@ -351,4 +387,9 @@ enum bmca_select port_bmca(struct port *p);
  */
 void tc_cleanup(void);
 
+/**
+ * Release all of the memory in the pending transmit time stamp cache.
+ */
+void port_tx_cleanup(void);
+
 #endif
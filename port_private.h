@@ -27,8 +27,12 @@
 #include "monitor.h"
 #include "msg.h"
 #include "tmv.h"
+#include "wheel.h"
 
 #define NSEC2SEC 1000000000LL
+#define FM_INDEX_SIZE 64
+#define TC_INDEX_SIZE 256
+#define TC_AGE_BUCKETS 8
 
 enum syfu_state {
 	SF_EMPTY,
@@ -54,9 +58,43 @@ struct nrate_estimator {
 
 struct tc_txd {
 	TAILQ_ENTRY(tc_txd) list;
+	LIST_ENTRY(tc_txd) index;
 	struct ptp_message *msg;
 	tmv_t residence;
 	int ingress_port;
+	int age;
+};
+
+/*
+ * Delay_Resp messages answering the Delay_Req messages of one receive
+ * batch, sent together once the batch has been processed.
+ */
+struct delay_resp_batch {
+	struct ptp_message *msg[TRANSPORT_BATCH_MAX];
+	tmv_t ingress[TRANSPORT_BATCH_MAX];
+	/* prebuilt responses, multicast and unicast */
+	struct delay_resp_msg template[2];
+	int n;
+	/* batch size and ingress to transmission latency statistics */
+	struct stats *size;
+	struct stats *latency;
+	time_t stats_tmo;
+	int stats_interval;
+};
+
+/*
+ * An event message whose transmit time stamp has not yet been
+ * collected from the error queue of the egress port.
+ */
+struct tx_pending {
+	TAILQ_ENTRY(tx_pending) list;
+	struct ptp_message *msg;
+	struct ptp_message *req;
+	struct ptp_message *rsp;
+	struct port *ingress;
+	tmv_t ingress_ts;
+	struct timespec sent;
+	int (*complete)(struct port *p, struct tx_pending *txp);
 };
 
 struct port {
@@ -67,7 +105,9 @@ struct port {
 	struct transport *trp;
 	enum timestamp_type timestamping;
 	struct fdarray fda;
-	int fault_fd;
+	/* Indexed by the FD_ timer constants, other entries are NULL. */
+	struct wheel_timer *timer[N_POLLFD];
+	struct wheel_timer *fault_timer;
 	int phc_index;
 
 	void (*dispatch)(struct port *p, enum fsm_event event, int mdiff);
@@ -127,6 +167,7 @@ struct port {
 	int                 follow_up_info;
 	int                 freq_est_interval;
 	int                 hybrid_e2e;
+	int                 kernel_filter;
 	int                 master_only;
 	int                 match_transport_specific;
 	int                 msg_interval_request;
@@ -134,6 +175,8 @@ struct port {
 	int                 net_sync_monitor;
 	int                 path_trace_enabled;
 	int                 tc_spanning_tree;
+	int                 tx_timestamp_async;
+	int                 rx_batch;
 	Integer64           rx_timestamp_offset;
 	Integer64           tx_timestamp_offset;
 	int                 unicast_req_duration;
@@ -144,8 +187,16 @@ struct port {
 	struct PortStats    stats;
 	/* foreignMasterDS */
 	LIST_HEAD(fm, foreign_clock) foreign_masters;
-	/* TC book keeping */
-	TAILQ_HEAD(tct, tc_txd) tc_transmitted;
+	LIST_HEAD(fmi, foreign_clock) fm_index[FM_INDEX_SIZE];
+	/* TC book keeping, indexed by message key and bucketed by age */
+	LIST_HEAD(tci, tc_txd) tc_index[TC_INDEX_SIZE];
+	TAILQ_HEAD(tct, tc_txd) tc_age[TC_AGE_BUCKETS];
+	int64_t tc_oldest;
+	struct delay_resp_batch delay_resp;
+	/* receive filter installed on the transport */
+	struct transport_filter filter;
+	/* event messages awaiting their transmit time stamp */
+	TAILQ_HEAD(txq, tx_pending) tx_pending;
 	/* unicast client mode */
 	struct unicast_master_table *unicast_master_table;
 	/* unicast service mode */
@@ -169,12 +220,15 @@ void fc_clear(struct foreign_clock *fc);
 void flush_delay_req(struct port *p);
 void flush_last_sync(struct port *p);
 int port_capable(struct port *p);
-int port_clr_tmo(int fd);
+int port_clr_tmo(struct wheel_timer *t);
 int port_delay_request(struct port *p);
 void port_disable(struct port *p);
 int port_initialize(struct port *p);
 int port_is_enabled(struct port *p);
-void port_link_status(void *ctx, int index, int linkup);
+enum fsm_event port_rx_batch(struct port *p, int fd,
+			     enum fsm_event (*rx_msg)(struct port *p,
+						      struct ptp_message *msg,
+						      int cnt));
 int port_set_announce_tmo(struct port *p);
 int port_set_delay_tmo(struct port *p);
 int port_set_qualification_tmo(struct port *p);
@@ -184,11 +238,16 @@ struct ptp_message *port_signaling_uc_construct(struct port *p,
 						struct address *address,
 						struct PortIdentity *tpid);
 int port_tx_announce(struct port *p, struct address *dst);
+int port_tx_announce_batch(struct port *p, struct address **dst, int n);
+struct tx_pending *port_tx_defer(struct port *p, struct ptp_message *msg,
+				 int (*complete)(struct port *p,
+						 struct tx_pending *txp));
 int port_tx_interval_request(struct port *p,
 			     Integer8 announceInterval,
 			     Integer8 timeSyncInterval,
 			     Integer8 linkDelayInterval);
 int port_tx_sync(struct port *p, struct address *dst);
+int port_tx_sync_batch(struct port *p, struct address **dst, int n);
 int process_announce(struct port *p, struct ptp_message *m);
 void process_delay_resp(struct port *p, struct ptp_message *m);
 void process_follow_up(struct port *p, struct ptp_message *m);
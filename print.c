@@ -16,14 +16,60 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "print.h"
 
+#define RECORD_SIZE	512
+#define MAX_TEXT	1024
+
+/*
+ * In the asynchronous mode, print() only copies the time stamp, the
+ * level, the format and the arguments into a record of a preallocated
+ * ring, and a background thread formats and emits the messages.
+ *
+ * The ring is a bounded queue of fixed size records, each carrying a
+ * sequence number. A producer claims a record by advancing the head
+ * with a compare and swap, and hands it over by setting its sequence
+ * number to the position plus one. The consumer gives the record back
+ * by setting the sequence number to the position of its next round.
+ */
+struct record {
+	unsigned long seq;
+	struct timespec ts;
+	/* The format, or NULL if the text was formatted in place. */
+	const char *format;
+	int level;
+	int err;
+	unsigned char args[];
+};
+
+#define ARGS_SIZE	(RECORD_SIZE - offsetof(struct record, args))
+
+static struct {
+	unsigned char *records;
+	unsigned long mask;
+	unsigned long head;
+	unsigned long tail;
+	unsigned long dropped;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int waiting;
+	int stop;
+} ring;
+
 static int verbose = 0;
 static int print_level = LOG_INFO;
 static int use_syslog = 1;
@@ -55,35 +101,500 @@ void print_set_verbose(int value)
 	verbose = value ? 1 : 0;
 }
 
-void print(int level, char const *format, ...)
+static void print_emit(int level, struct timespec *ts, const char *buf)
 {
-	struct timespec ts;
-	va_list ap;
-	char buf[1024];
 	FILE *f;
 
-	if (level > print_level)
-		return;
-
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-
-	va_start(ap, format);
-	vsnprintf(buf, sizeof(buf), format, ap);
-	va_end(ap);
-
 	if (verbose) {
 		f = level >= LOG_NOTICE ? stdout : stderr;
 		fprintf(f, "%s[%lld.%03ld]: %s%s%s\n",
 			progname ? progname : "",
-			(long long)ts.tv_sec, ts.tv_nsec / 1000000,
+			(long long)ts->tv_sec, ts->tv_nsec / 1000000,
 			message_tag ? message_tag : "", message_tag ? " " : "",
 			buf);
 		fflush(f);
 	}
 	if (use_syslog) {
 		syslog(level, "[%lld.%03ld] %s%s%s",
-		       (long long)ts.tv_sec, ts.tv_nsec / 1000000,
+		       (long long)ts->tv_sec, ts->tv_nsec / 1000000,
 		       message_tag ? message_tag : "", message_tag ? " " : "",
 		       buf);
 	}
 }
+
+static struct record *ring_record(unsigned long pos)
+{
+	return (struct record *) (ring.records + (pos & ring.mask) * RECORD_SIZE);
+}
+
+enum arg_type {
+	ARG_NONE,
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_SIZE,
+	ARG_INTMAX,
+	ARG_PTRDIFF,
+	ARG_DOUBLE,
+	ARG_LDOUBLE,
+	ARG_PTR,
+	ARG_STR,
+};
+
+/*
+ * Parses one conversion specification, starting after the '%'. Returns
+ * a pointer past the conversion character, or NULL at the end of the
+ * format. The number of '*' arguments is stored in 'stars'.
+ */
+static const char *parse_spec(const char *p, enum arg_type *type, int *stars)
+{
+	int length = 0;
+
+	*stars = 0;
+	p += strspn(p, "-+ #0'");
+	if (*p == '*') {
+		(*stars)++;
+		p++;
+	}
+	p += strspn(p, "0123456789");
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			(*stars)++;
+			p++;
+		}
+		p += strspn(p, "0123456789");
+	}
+	while (*p && strchr("hlLqjzt", *p)) {
+		switch (*p) {
+		case 'l':
+			length = length == 'l' ? 'q' : 'l';
+			break;
+		case 'h':
+			break;
+		default:
+			length = *p;
+			break;
+		}
+		p++;
+	}
+	switch (*p) {
+	case 'd':
+	case 'i':
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+	case 'c':
+		switch (length) {
+		case 'l':
+			*type = ARG_LONG;
+			break;
+		case 'q':
+		case 'L':
+			*type = ARG_LLONG;
+			break;
+		case 'z':
+			*type = ARG_SIZE;
+			break;
+		case 'j':
+			*type = ARG_INTMAX;
+			break;
+		case 't':
+			*type = ARG_PTRDIFF;
+			break;
+		default:
+			*type = ARG_INT;
+			break;
+		}
+		break;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		*type = length == 'L' ? ARG_LDOUBLE : ARG_DOUBLE;
+		break;
+	case 'p':
+		*type = ARG_PTR;
+		break;
+	case 's':
+		*type = ARG_STR;
+		break;
+	case '\0':
+		return NULL;
+	default:
+		/* %m and %% take no argument. */
+		*type = ARG_NONE;
+		break;
+	}
+	return p + 1;
+}
+
+#define PUT(type, val)						\
+	do {							\
+		type v = (val);					\
+		if (len + sizeof(v) > ARGS_SIZE)		\
+			return -1;				\
+		memcpy(r->args + len, &v, sizeof(v));		\
+		len += sizeof(v);				\
+	} while (0)
+
+/* Returns zero on success, or -1 if the arguments do not fit. */
+static int record_args(struct record *r, const char *format, va_list ap)
+{
+	const char *p = format, *str;
+	enum arg_type type;
+	size_t len = 0, n;
+	int stars;
+
+	while ((p = strchr(p, '%')) != NULL) {
+		p = parse_spec(p + 1, &type, &stars);
+		if (!p)
+			break;
+		while (stars--)
+			PUT(int, va_arg(ap, int));
+		switch (type) {
+		case ARG_NONE:
+			break;
+		case ARG_INT:
+			PUT(int, va_arg(ap, int));
+			break;
+		case ARG_LONG:
+			PUT(long, va_arg(ap, long));
+			break;
+		case ARG_LLONG:
+			PUT(long long, va_arg(ap, long long));
+			break;
+		case ARG_SIZE:
+			PUT(size_t, va_arg(ap, size_t));
+			break;
+		case ARG_INTMAX:
+			PUT(intmax_t, va_arg(ap, intmax_t));
+			break;
+		case ARG_PTRDIFF:
+			PUT(ptrdiff_t, va_arg(ap, ptrdiff_t));
+			break;
+		case ARG_DOUBLE:
+			PUT(double, va_arg(ap, double));
+			break;
+		case ARG_LDOUBLE:
+			PUT(long double, va_arg(ap, long double));
+			break;
+		case ARG_PTR:
+			PUT(void *, va_arg(ap, void *));
+			break;
+		case ARG_STR:
+			/* Strings are copied, as they may not live long. */
+			str = va_arg(ap, const char *);
+			if (!str)
+				str = "(null)";
+			n = strlen(str) + 1;
+			if (len + n > ARGS_SIZE)
+				return -1;
+			memcpy(r->args + len, str, n);
+			len += n;
+			break;
+		}
+	}
+	return 0;
+}
+
+#define GET(type, var)						\
+	do {							\
+		memcpy(&var, args, sizeof(type));		\
+		args += sizeof(type);				\
+	} while (0)
+
+#define EMIT(val)						\
+	snprintf(buf + off, size - off, spec, val)
+
+static void format_record(struct record *r, char *buf, size_t size)
+{
+	const unsigned char *args = r->args;
+	const char *p = r->format, *q, *end;
+	char spec[64], *s;
+	enum arg_type type;
+	size_t off = 0;
+	int i, stars, star[2];
+
+	buf[0] = '\0';
+	while (*p && off < size - 1) {
+		q = strchr(p, '%');
+		if (!q)
+			q = p + strlen(p);
+		while (p < q && off < size - 1)
+			buf[off++] = *p++;
+		buf[off] = '\0';
+		if (!*p || off >= size - 1)
+			break;
+
+		end = parse_spec(p + 1, &type, &stars);
+		if (!end || end - p >= (int) sizeof(spec) - 2 * 12)
+			break;
+		for (i = 0; i < stars; i++)
+			GET(int, star[i]);
+
+		/* Rebuild the specification with the '*' values filled in. */
+		s = spec;
+		for (i = 0, q = p; q < end; q++) {
+			if (*q == '*')
+				s += sprintf(s, "%d", star[i++]);
+			else
+				*s++ = *q;
+		}
+		*s = '\0';
+		p = end;
+
+		errno = r->err;
+		switch (type) {
+		case ARG_NONE:
+			off += EMIT(0);
+			break;
+		case ARG_INT: {
+			int v;
+			GET(int, v);
+			off += EMIT(v);
+			break;
+		}
+		case ARG_LONG: {
+			long v;
+			GET(long, v);
+			off += EMIT(v);
+			break;
+		}
+		case ARG_LLONG: {
+			long long v;
+			GET(long long, v);
+			off += EMIT(v);
+			break;
+		}
+		case ARG_SIZE: {
+			size_t v;
+			GET(size_t, v);
+			off += EMIT(v);
+			break;
+		}
+		case ARG_INTMAX: {
+			intmax_t v;
+			GET(intmax_t, v);
+			off += EMIT(v);
+			break;
+		}
+		case ARG_PTRDIFF: {
+			ptrdiff_t v;
+			GET(ptrdiff_t, v);
+			off += EMIT(v);
+			break;
+		}
+		case ARG_DOUBLE: {
+			double v;
+			GET(double, v);
+			off += EMIT(v);
+			break;
+		}
+		case ARG_LDOUBLE: {
+			long double v;
+			GET(long double, v);
+			off += EMIT(v);
+			break;
+		}
+		case ARG_PTR: {
+			void *v;
+			GET(void *, v);
+			off += EMIT(v);
+			break;
+		}
+		case ARG_STR:
+			off += EMIT((const char *) args);
+			args += strlen((const char *) args) + 1;
+			break;
+		}
+	}
+	if (off > size - 1)
+		off = size - 1;
+	buf[off] = '\0';
+}
+
+static void ring_emit(struct record *r)
+{
+	char buf[MAX_TEXT];
+
+	if (r->format) {
+		format_record(r, buf, sizeof(buf));
+		print_emit(r->level, &r->ts, buf);
+	} else {
+		print_emit(r->level, &r->ts, (const char *) r->args);
+	}
+}
+
+static void *ring_run(void *arg)
+{
+	unsigned long dropped, reported = 0, seq;
+	struct timespec ts, tmo;
+	struct record *r;
+	char buf[64];
+
+	while (1) {
+		r = ring_record(ring.tail);
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		if (seq == ring.tail + 1) {
+			ring_emit(r);
+			__atomic_store_n(&r->seq, ring.tail + ring.mask + 1,
+					 __ATOMIC_RELEASE);
+			ring.tail++;
+			continue;
+		}
+
+		dropped = __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED);
+		if (dropped != reported) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			snprintf(buf, sizeof(buf),
+				 "print: dropped %lu messages, %lu in total",
+				 dropped - reported, dropped);
+			print_emit(LOG_WARNING, &ts, buf);
+			reported = dropped;
+		}
+
+		/* The ring is empty, wait for a producer to wake us up. */
+		pthread_mutex_lock(&ring.lock);
+		if (ring.stop) {
+			pthread_mutex_unlock(&ring.lock);
+			break;
+		}
+		__atomic_store_n(&ring.waiting, 1, __ATOMIC_SEQ_CST);
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		if (seq != ring.tail + 1) {
+			clock_gettime(CLOCK_REALTIME, &tmo);
+			tmo.tv_nsec += 100000000;
+			if (tmo.tv_nsec >= 1000000000) {
+				tmo.tv_sec++;
+				tmo.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&ring.cond, &ring.lock, &tmo);
+		}
+		__atomic_store_n(&ring.waiting, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&ring.lock);
+	}
+	return NULL;
+}
+
+static void ring_stop(void)
+{
+	pthread_mutex_lock(&ring.lock);
+	ring.stop = 1;
+	pthread_cond_signal(&ring.cond);
+	pthread_mutex_unlock(&ring.lock);
+	pthread_join(ring.thread, NULL);
+}
+
+int print_set_async(int size)
+{
+	sigset_t mask, orig;
+	unsigned long n, i;
+	int err;
+
+	if (size <= 0 || ring.records) {
+		return 0;
+	}
+	for (n = 1; n < (unsigned long) size; n <<= 1)
+		;
+	ring.records = calloc(n, RECORD_SIZE);
+	if (!ring.records) {
+		return -1;
+	}
+	ring.mask = n - 1;
+	for (i = 0; i < n; i++) {
+		ring_record(i)->seq = i;
+	}
+	pthread_mutex_init(&ring.lock, NULL);
+	pthread_cond_init(&ring.cond, NULL);
+
+	/* Leave the signals to the main thread. */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &orig);
+	err = pthread_create(&ring.thread, NULL, ring_run, NULL);
+	pthread_sigmask(SIG_SETMASK, &orig, NULL);
+	if (err) {
+		free(ring.records);
+		ring.records = NULL;
+		return -1;
+	}
+	/* Flush the ring when the program exits. */
+	atexit(ring_stop);
+	return 0;
+}
+
+static void print_async(int level, struct timespec *ts, char const *format,
+			va_list ap)
+{
+	unsigned long pos, seq;
+	struct record *r;
+	va_list aq;
+	long diff;
+
+	pos = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+	while (1) {
+		r = ring_record(pos);
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		diff = (long) seq - (long) pos;
+		if (!diff) {
+			if (__atomic_compare_exchange_n(&ring.head, &pos,
+							pos + 1, 1,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			__atomic_fetch_add(&ring.dropped, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+		}
+	}
+
+	r->ts = *ts;
+	r->level = level;
+	r->err = errno;
+	r->format = format;
+	va_copy(aq, ap);
+	if (record_args(r, format, aq)) {
+		/* Too long for a record, so format it here. */
+		vsnprintf((char *) r->args, ARGS_SIZE, format, ap);
+		r->format = NULL;
+	}
+	va_end(aq);
+	/* Ordered before the check of the consumer's waiting flag. */
+	__atomic_store_n(&r->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&ring.waiting, __ATOMIC_SEQ_CST)) {
+		pthread_cond_signal(&ring.cond);
+	}
+}
+
+void print(int level, char const *format, ...)
+{
+	struct timespec ts;
+	va_list ap;
+	char buf[MAX_TEXT];
+
+	if (level > print_level)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	if (ring.records) {
+		va_start(ap, format);
+		print_async(level, &ts, format, ap);
+		va_end(ap);
+		return;
+	}
+
+	va_start(ap, format);
+	vsnprintf(buf, sizeof(buf), format, ap);
+	va_end(ap);
+
+	print_emit(level, &ts, buf);
+}
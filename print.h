@@ -38,6 +38,15 @@ void print_set_syslog(int value);
 void print_set_level(int level);
 void print_set_verbose(int value);
 
+/**
+ * Switches print() to the asynchronous mode, where messages are queued
+ * in a ring and formatted and emitted by a background thread.
+ * @param size  The number of records in the ring, rounded up to a power
+ *              of two. Zero keeps printing synchronous.
+ * @return      Zero on success, non-zero otherwise.
+ */
+int print_set_async(int size);
+
 #define pr_emerg(x...)   print(LOG_EMERG, x)
 #define pr_alert(x...)   print(LOG_ALERT, x)
 #define pr_crit(x...)    print(LOG_CRIT, x)
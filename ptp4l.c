@@ -25,6 +25,7 @@
 
 #include "clock.h"
 #include "config.h"
+#include "msg.h"
 #include "ntpshm.h"
 #include "pi.h"
 #include "print.h"
@@ -186,12 +187,22 @@ int main(int argc, char *argv[])
 	print_set_verbose(config_get_int(cfg, NULL, "verbose"));
 	print_set_syslog(config_get_int(cfg, NULL, "use_syslog"));
 	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+	if (print_set_async(config_get_int(cfg, NULL, "logging_ring_size"))) {
+		fprintf(stderr, "failed to start the logging thread\n");
+		goto out;
+	}
 
 	assume_two_step = config_get_int(cfg, NULL, "assume_two_step");
 	sk_check_fupsync = config_get_int(cfg, NULL, "check_fup_sync");
 	sk_tx_timeout = config_get_int(cfg, NULL, "tx_timestamp_timeout");
 	sk_hwts_filter_mode = config_get_int(cfg, NULL, "hwts_filter");
 
+	if (msg_pool_init(config_get_int(cfg, NULL, "msg_pool_size"),
+			  config_get_int(cfg, NULL, "msg_pool_strict"))) {
+		fprintf(stderr, "failed to allocate the message pool\n");
+		goto out;
+	}
+
 	if (config_get_int(cfg, NULL, "clock_servo") == CLOCK_SERVO_NTPSHM) {
 		config_set_int(cfg, "kernel_leap", 0);
 		config_set_int(cfg, "sanity_freq_limit", 0);
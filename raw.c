@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -45,6 +46,7 @@
 #include "sk.h"
 #include "transport_private.h"
 #include "util.h"
+#include "xdp.h"
 
 struct raw {
 	struct transport t;
@@ -55,6 +57,17 @@ struct raw {
 	int egress_vlan_tagged;
 	int egress_vlan_id;
 	int egress_vlan_prio;
+	/*
+	 * With AF_XDP, FD_GENERAL holds 'xfd', an epoll set of the AF_XDP
+	 * socket and 'gfd', and 'gfd' transmits. The port polls a single
+	 * descriptor per message class, while the XDP program redirects
+	 * only one queue, so general messages arrive on both sockets. The
+	 * nested set wakes the port for either, and a read tries the
+	 * AF_XDP ring first and then the packet socket.
+	 */
+	struct xdp_rx *xdp;
+	int gfd;
+	int xfd;
 };
 
 /* Ethernet frame header including VLAN tag */
@@ -69,6 +82,7 @@ struct tagged_frame_header {
 #define OP_JUN  (BPF_JMP | BPF_JA)
 #define OP_LDB  (BPF_LD  | BPF_B   | BPF_ABS)
 #define OP_LDH  (BPF_LD  | BPF_H   | BPF_ABS)
+#define OP_LDXK (BPF_LDX | BPF_W   | BPF_IMM)
 #define OP_RETK (BPF_RET | BPF_K)
 
 #define PTP_GEN_BIT 0x08 /* indicates general message, if set in message type */
@@ -91,6 +105,22 @@ static struct sock_filter raw_filter[N_RAW_FILTER] = {
 	{OP_RETK, 0, 0, 0           }, /*reject*/
 };
 
+/* Locates the PTP header for transport_attach_filter(). */
+#define N_RAW_PREFIX    10
+
+static const struct sock_filter raw_prefix[N_RAW_PREFIX] = {
+	{OP_LDH,  0, 0, OFF_ETYPE            },
+	{OP_JEQ,  0, 4, ETH_P_8021Q          }, /*f goto non-vlan block*/
+	{OP_LDH,  0, 0, OFF_ETYPE + 4        },
+	{OP_JEQ,  0, 5, ETH_P_1588           }, /*f goto reject*/
+	{OP_LDXK, 0, 0, ETH_HLEN + VLAN_HLEN },
+	{OP_JUN,  0, 0, 4                    }, /*goto PTP header*/
+	{OP_JEQ,  0, 2, ETH_P_1588           }, /*f goto reject*/
+	{OP_LDXK, 0, 0, ETH_HLEN             },
+	{OP_JUN,  0, 0, 1                    }, /*goto PTP header*/
+	{OP_RETK, 0, 0, 0                    }, /*reject*/
+};
+
 static int raw_configure(int fd, int event, int index,
 			 unsigned char *addr1, unsigned char *addr2, int enable)
 {
@@ -155,11 +185,93 @@ static int raw_configure(int fd, int event, int index,
 
 static int raw_close(struct transport *t, struct fdarray *fda)
 {
+	struct raw *raw = container_of(t, struct raw, t);
+
 	close(fda->fd[0]);
-	close(fda->fd[1]);
+	if (raw->xdp) {
+		close(raw->xfd);
+		xdp_rx_destroy(raw->xdp);
+		raw->xdp = NULL;
+		close(raw->gfd);
+	} else {
+		close(fda->fd[1]);
+	}
 	return 0;
 }
 
+static int raw_general_fd(struct raw *raw, struct fdarray *fda)
+{
+	return raw->xdp ? raw->gfd : fda->fd[FD_GENERAL];
+}
+
+/*
+ * Moves the reception of general messages to an AF_XDP socket. The
+ * XDP program only redirects the frames of one queue, and those of
+ * the other queues still reach the packet socket, so both are polled
+ * through an epoll set of their own. The packet socket also transmits.
+ */
+static void raw_xdp_open(struct raw *raw, const char *name, int gfd,
+			 struct fdarray *fda)
+{
+	struct epoll_event ev;
+	enum xdp_mode mode;
+	int queue, xfd;
+
+	mode = config_get_int(raw->t.cfg, name, "xdp_mode");
+	if (mode == XDP_MODE_OFF) {
+		return;
+	}
+	queue = config_get_int(raw->t.cfg, name, "xdp_queue");
+	raw->xdp = xdp_rx_create(name, queue, mode);
+	if (!raw->xdp) {
+		pr_warning("%s: receiving general messages without AF_XDP",
+			   name);
+		return;
+	}
+	xfd = epoll_create1(EPOLL_CLOEXEC);
+	if (xfd < 0) {
+		pr_err("epoll_create1 failed: %m");
+		goto no_epoll;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = xdp_rx_fd(raw->xdp);
+	if (epoll_ctl(xfd, EPOLL_CTL_ADD, ev.data.fd, &ev)) {
+		pr_err("epoll_ctl failed: %m");
+		goto no_ctl;
+	}
+	ev.data.fd = gfd;
+	if (epoll_ctl(xfd, EPOLL_CTL_ADD, gfd, &ev)) {
+		pr_err("epoll_ctl failed: %m");
+		goto no_ctl;
+	}
+	raw->gfd = gfd;
+	raw->xfd = xfd;
+	raw->t.lends = 1;
+	fda->fd[FD_GENERAL] = xfd;
+	return;
+
+no_ctl:
+	close(xfd);
+no_epoll:
+	xdp_rx_destroy(raw->xdp);
+	raw->xdp = NULL;
+	pr_warning("%s: receiving general messages without AF_XDP", name);
+}
+
+static int raw_set_filter(struct transport *t, struct fdarray *fda,
+			  struct transport_filter *f)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	struct fdarray event = *fda;
+
+	/* The AF_XDP socket takes no socket filters. */
+	if (raw->xdp) {
+		event.fd[FD_GENERAL] = raw->gfd;
+	}
+	return transport_attach_filter(&event, raw_prefix, N_RAW_PREFIX, f);
+}
+
 static int open_socket(const char *name, int event, unsigned char *ptp_dst_mac,
 		       unsigned char *p2p_dst_mac, int socket_priority)
 {
@@ -271,6 +383,10 @@ static int raw_open(struct transport *t, struct interface *iface,
 
 	fda->fd[FD_EVENT] = efd;
 	fda->fd[FD_GENERAL] = gfd;
+	raw_xdp_open(raw, name, gfd, fda);
+	if (!raw->xdp) {
+		transport_uring_open(t, name, ETH_HLEN, fda);
+	}
 	return 0;
 
 no_timestamping:
@@ -282,6 +398,65 @@ no_mac:
 	return -1;
 }
 
+/* Returns the pointer at the offset of 'p' from 'from' within 'to'. */
+static void *raw_rebase(void *p, struct ptp_message *from,
+			struct ptp_message *to)
+{
+	return (unsigned char *) to + ((unsigned char *) p -
+				       (unsigned char *) from);
+}
+
+/*
+ * Takes the frames received by the AF_XDP socket. The frames only
+ * carry general messages, which need no time stamps. When the message
+ * of an entry may be lent, the message holding the frame takes its
+ * place and the replaced one is lent in return, otherwise the payload
+ * is copied and the message holding the frame is lent again.
+ */
+static int raw_xdp_recv(struct raw *raw, struct ptp_message **msg,
+			void **buf, int *len, struct address **addr,
+			struct hw_timestamp **hwts, int n)
+{
+	struct xdp_frame frame[TRANSPORT_BATCH_MAX];
+	struct ptp_message *lent, *m;
+	unsigned char *payload;
+	struct eth_hdr *hdr;
+	int cnt, hlen, i;
+
+	cnt = xdp_rx_recv(raw->xdp, frame, n);
+	for (i = 0; i < cnt; i++) {
+		hdr = (struct eth_hdr *) frame[i].data;
+		if (ETH_P_8021Q == ntohs(hdr->type)) {
+			hlen = sizeof(struct vlan_hdr);
+		} else {
+			hlen = sizeof(struct eth_hdr);
+		}
+		if (frame[i].len - hlen < len[i]) {
+			len[i] = frame[i].len - hlen;
+		}
+		mac_to_addr(addr[i], hdr->src);
+		payload = frame[i].data + hlen;
+		m = msg ? msg[i] : NULL;
+		lent = frame[i].msg;
+		if (!m || !msg_lendable(m)) {
+			memcpy(buf[i], payload, len[i]);
+			xdp_rx_lend(raw->xdp, lent);
+			continue;
+		}
+		lent->address = *addr[i];
+		lent->hwts.type = m->hwts.type;
+		buf[i] = raw_rebase(buf[i], m, lent);
+		addr[i] = raw_rebase(addr[i], m, lent);
+		hwts[i] = raw_rebase(hwts[i], m, lent);
+		if (payload != buf[i]) {
+			memmove(buf[i], payload, len[i]);
+		}
+		msg[i] = lent;
+		xdp_rx_lend(raw->xdp, m);
+	}
+	return cnt ? cnt : -EAGAIN;
+}
+
 static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts)
 {
@@ -290,6 +465,14 @@ static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 	struct eth_hdr *hdr;
 	struct raw *raw = container_of(t, struct raw, t);
 
+	if (raw->xdp && fd == raw->xfd) {
+		cnt = raw_xdp_recv(raw, NULL, &buf, &buflen, &addr, &hwts, 1);
+		if (cnt != -EAGAIN) {
+			return cnt < 0 ? cnt : buflen;
+		}
+		fd = raw->gfd;
+	}
+
 	if (raw->vlan) {
 		hlen = sizeof(struct vlan_hdr);
 	} else {
@@ -299,7 +482,7 @@ static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 	buflen += hlen;
 	hdr = (struct eth_hdr *) ptr;
 
-	cnt = sk_receive(fd, ptr, buflen, addr, hwts, MSG_DONTWAIT);
+	cnt = transport_sk_receive(t, fd, ptr, buflen, addr, hwts, MSG_DONTWAIT);
 
 	if (cnt >= 0)
 		cnt -= hlen;
@@ -320,36 +503,97 @@ static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 	return cnt;
 }
 
-static int raw_send(struct transport *t, struct fdarray *fda,
-		    enum transport_event event, int peer, void *buf, int len,
-		    struct address *addr, struct hw_timestamp *hwts)
+/*
+ * Every frame of a batch is received behind a header of the length
+ * expected when the batch started. A frame whose header turns out to
+ * be longer or shorter has its payload moved into place, and frames
+ * too short to carry a header are passed on empty.
+ */
+static int raw_recv_batch(struct transport *t, int fd, struct ptp_message **msg,
+			  void **buf, int *len, struct address **addr,
+			  struct hw_timestamp **hwts, int n)
 {
 	struct raw *raw = container_of(t, struct raw, t);
-	ssize_t cnt;
-	unsigned char pkt[1600], *ptr = buf;
+	int i, cnt, flen, hlen, cap[TRANSPORT_BATCH_MAX];
+	void *frame[TRANSPORT_BATCH_MAX];
 	struct eth_hdr *hdr;
-	struct tagged_frame_header *tag_hdr;
-	int fd = -1;
 
-	switch (event) {
-	case TRANS_GENERAL:
-		fd = fda->fd[FD_GENERAL];
-		break;
-	case TRANS_EVENT:
-	case TRANS_ONESTEP:
-	case TRANS_P2P1STEP:
-	case TRANS_DEFER_EVENT:
-		fd = fda->fd[FD_EVENT];
-		break;
+	if (raw->xdp && fd == raw->xfd) {
+		cnt = raw_xdp_recv(raw, msg, buf, len, addr, hwts, n);
+		if (cnt != -EAGAIN) {
+			return cnt;
+		}
+		fd = raw->gfd;
+	}
+	if (raw->vlan) {
+		hlen = sizeof(struct vlan_hdr);
+	} else {
+		hlen = sizeof(struct eth_hdr);
+	}
+	for (i = 0; i < n; i++) {
+		frame[i] = (unsigned char *) buf[i] - hlen;
+		cap[i] = len[i];
+		len[i] += hlen;
 	}
 
-	if (!addr)
-		addr = peer ? &raw->p2p_addr : &raw->ptp_addr;
+	cnt = transport_sk_receive_batch(t, fd, msg, frame, len, addr, hwts,
+					 n);
+	if (cnt < 0)
+		return cnt;
+
+	for (i = 0; i < cnt; i++) {
+		buf[i] = (unsigned char *) frame[i] + hlen;
+		if (len[i] < 0)
+			continue;
+		hdr = frame[i];
+		if (len[i] < sizeof(struct eth_hdr)) {
+			len[i] = 0;
+			continue;
+		}
+		if (ETH_P_8021Q == ntohs(hdr->type)) {
+			flen = sizeof(struct vlan_hdr);
+			if (!raw->vlan) {
+				pr_notice("raw: switching to VLAN mode");
+				raw->vlan = 1;
+			}
+		} else {
+			flen = sizeof(struct eth_hdr);
+			if (raw->vlan && ETH_P_1588 == ntohs(hdr->type)) {
+				pr_notice("raw: disabling VLAN mode");
+				raw->vlan = 0;
+			}
+		}
+		if (len[i] < flen) {
+			len[i] = 0;
+			continue;
+		}
+		len[i] -= flen;
+		if (len[i] > cap[i]) {
+			len[i] = cap[i];
+		}
+		if (flen != hlen) {
+			memmove(buf[i], (unsigned char *) frame[i] + flen,
+				len[i]);
+		}
+	}
+	return cnt;
+}
+
+/*
+ * Prepends the Ethernet header in the head room of the message
+ * buffer. Returns the start of the frame and updates 'len'.
+ */
+static unsigned char *raw_frame(struct raw *raw, void *buf, int *len,
+				struct address *addr)
+{
+	struct tagged_frame_header *tag_hdr;
+	unsigned char *ptr = buf;
+	struct eth_hdr *hdr;
 
 	/* To send frames with 802.1Q tag. */
 	if (raw->egress_vlan_tagged) {
 		ptr -= sizeof(*tag_hdr);
-		len += sizeof(*tag_hdr);
+		*len += sizeof(*tag_hdr);
 		tag_hdr = (struct tagged_frame_header *) ptr;
 		addr_to_mac(&tag_hdr->ether_header.ether_dhost, addr);
 		addr_to_mac(&tag_hdr->ether_header.ether_shost, &raw->src_addr);
@@ -358,21 +602,74 @@ static int raw_send(struct transport *t, struct fdarray *fda,
 		tag_hdr->enc_ethertype = htons(ETH_P_1588);
 	} else {
 		ptr -= sizeof(*hdr);
-		len += sizeof(*hdr);
+		*len += sizeof(*hdr);
 		hdr = (struct eth_hdr *) ptr;
 		addr_to_mac(&hdr->dst, addr);
 		addr_to_mac(&hdr->src, &raw->src_addr);
 		hdr->type = htons(ETH_P_1588);
 	}
+	return ptr;
+}
+
+static int raw_send(struct transport *t, struct fdarray *fda,
+		    enum transport_event event, int peer, void *buf, int len,
+		    struct address *addr, struct hw_timestamp *hwts)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	ssize_t cnt;
+	unsigned char pkt[1600], *ptr;
+	int fd = -1;
+
+	switch (event) {
+	case TRANS_GENERAL:
+		fd = raw_general_fd(raw, fda);
+		break;
+	case TRANS_EVENT:
+	case TRANS_ONESTEP:
+	case TRANS_P2P1STEP:
+	case TRANS_DEFER_EVENT:
+		fd = fda->fd[FD_EVENT];
+		break;
+	}
 
-	cnt = send(fd, ptr, len, 0);
+	if (!addr)
+		addr = peer ? &raw->p2p_addr : &raw->ptp_addr;
+
+	ptr = raw_frame(raw, buf, &len, addr);
+
+	cnt = transport_sk_sendto(t, fd, ptr, len, NULL, 0);
 	if (cnt < 1) {
 		return -errno;
 	}
 	/*
 	 * Get the time stamp right away.
 	 */
-	return event == TRANS_EVENT ? sk_receive(fd, pkt, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
+	return event == TRANS_EVENT ?
+		transport_sk_receive(t, fd, pkt, len, NULL, hwts, MSG_ERRQUEUE) :
+		cnt;
+}
+
+static int raw_send_batch(struct transport *t, struct fdarray *fda,
+			  enum transport_event event, void **buf, int *len,
+			  struct address **addr, int n)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	struct mmsghdr mmsg[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	int i, fd, flen;
+
+	fd = event == TRANS_GENERAL ? raw_general_fd(raw, fda) : fda->fd[FD_EVENT];
+
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+	for (i = 0; i < n; i++) {
+		flen = len[i];
+		iov[i].iov_base = raw_frame(raw, buf[i], &flen,
+					    addr[i] ? addr[i] : &raw->ptp_addr);
+		iov[i].iov_len = flen;
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+	return transport_sk_sendmmsg(t, fd, mmsg, n);
 }
 
 static void raw_release(struct transport *t)
@@ -404,7 +701,10 @@ struct transport *raw_transport_create(void)
 	raw->t.close   = raw_close;
 	raw->t.open    = raw_open;
 	raw->t.recv    = raw_recv;
+	raw->t.recv_batch = raw_recv_batch;
 	raw->t.send    = raw_send;
+	raw->t.send_batch = raw_send_batch;
+	raw->t.set_filter = raw_set_filter;
 	raw->t.release = raw_release;
 	raw->t.physical_addr = raw_physical_addr;
 	raw->t.protocol_addr = raw_protocol_addr;
@@ -227,18 +227,23 @@ static int rtnl_linkinfo_parse(int master_index, struct rtattr *rta)
 	return index;
 }
 
-int rtnl_link_status(int fd, const char *device, rtnl_callback cb, void *ctx)
+/*
+ * Reads one batch of kernel messages and reports the RTM_NEWLINK
+ * events, either for the interface 'index' via 'cb', or for every
+ * interface via 'icb' when 'index' is -1.
+ */
+static int rtnl_link_recv(int fd, int index, rtnl_callback cb,
+			  rtnl_index_callback icb, void *ctx)
 {
 	struct rtattr *tb[IFLA_MAX+1];
 	struct ifinfomsg *info = NULL;
-	int index, len, link_up;
+	int len, link_up, slave_index;
 	struct sockaddr_nl sa;
-	int slave_index = -1;
 	struct nlmsghdr *nh;
 	struct msghdr msg;
 	struct iovec iov;
+	char *name;
 
-	index = if_nametoindex(device);
 	if (!rtnl_buf) {
 		rtnl_len = BUF_SIZE;
 		rtnl_buf = malloc(rtnl_len);
@@ -285,26 +290,44 @@ int rtnl_link_status(int fd, const char *device, rtnl_callback cb, void *ctx)
 			continue;
 
 		info = NLMSG_DATA(nh);
-		if (index != info->ifi_index)
+		if (index != -1 && index != info->ifi_index)
 			continue;
 
 		link_up = info->ifi_flags & IFF_RUNNING ? 1 : 0;
-		pr_debug("interface index %d is %s", index,
+		pr_debug("interface index %d is %s", info->ifi_index,
 			 link_up ? "up" : "down");
 
 		rtnl_rtattr_parse(tb, IFLA_MAX, IFLA_RTA(info),
 				  IFLA_PAYLOAD(nh));
 
+		slave_index = -1;
 		if (tb[IFLA_LINKINFO])
-			slave_index = rtnl_linkinfo_parse(index, tb[IFLA_LINKINFO]);
+			slave_index = rtnl_linkinfo_parse(info->ifi_index,
+							  tb[IFLA_LINKINFO]);
 
 		if (cb)
 			cb(ctx, link_up, slave_index);
+
+		if (icb) {
+			name = tb[IFLA_IFNAME] ?
+				rta_getattr_str(tb[IFLA_IFNAME]) : NULL;
+			icb(ctx, info->ifi_index, name, link_up, slave_index);
+		}
 	}
 
 	return 0;
 }
 
+int rtnl_link_status(int fd, const char *device, rtnl_callback cb, void *ctx)
+{
+	return rtnl_link_recv(fd, if_nametoindex(device), cb, NULL, ctx);
+}
+
+int rtnl_link_status_all(int fd, rtnl_index_callback cb, void *ctx)
+{
+	return rtnl_link_recv(fd, -1, NULL, cb, ctx);
+}
+
 static int genl_send_msg(int fd, int family_id, int genl_cmd, int genl_version,
 		  int rta_type, void *rta_data, int rta_len)
 {
@@ -24,6 +24,9 @@
 
 typedef void (*rtnl_callback)(void *ctx, int linkup, int ts_index);
 
+typedef void (*rtnl_index_callback)(void *ctx, int index, const char *name,
+				    int linkup, int ts_index);
+
 /**
  * Close a RT netlink socket.
  * @param fd  A socket obtained via rtnl_open().
@@ -59,6 +62,16 @@ int rtnl_link_query(int fd, const char *device);
  */
 int rtnl_link_status(int fd, const char *device, rtnl_callback cb, void *ctx);
 
+/**
+ * Read kernel messages looking for link up/down events on any interface.
+ * @param fd     Readable socket obtained via rtnl_open().
+ * @param cb     Callback function to be invoked on each event, with the
+ *               interface index and, when present, the interface name.
+ * @param ctx    Private context passed to the callback.
+ * @return       Zero on success, non-zero otherwise.
+ */
+int rtnl_link_status_all(int fd, rtnl_index_callback cb, void *ctx);
+
 /**
  * Open a RT netlink socket for monitoring link state.
  * @return    A valid socket, or -1 on error.
@@ -43,7 +43,7 @@ struct servo *servo_create(struct config *cfg, enum servo_type type,
 		servo = pi_servo_create(cfg, fadj, sw_ts);
 		break;
 	case CLOCK_SERVO_LINREG:
-		servo = linreg_servo_create(fadj);
+		servo = linreg_servo_create(cfg, fadj);
 		break;
 	case CLOCK_SERVO_NTPSHM:
 		servo = ntpshm_servo_create(cfg);
@@ -327,48 +327,13 @@ int sk_interface_addr(const char *name, int family, struct address *addr)
 static short sk_events = POLLPRI;
 static short sk_revents = POLLPRI;
 
-int sk_receive(int fd, void *buf, int buflen,
-	       struct address *addr, struct hw_timestamp *hwts, int flags)
+int sk_timestamps(struct msghdr *msg, struct hw_timestamp *hwts)
 {
-	char control[256];
-	int cnt = 0, res = 0, level, type;
-	struct cmsghdr *cm;
-	struct iovec iov = { buf, buflen };
-	struct msghdr msg;
 	struct timespec *sw, *ts = NULL;
+	struct cmsghdr *cm;
+	int level, type;
 
-	memset(control, 0, sizeof(control));
-	memset(&msg, 0, sizeof(msg));
-	if (addr) {
-		msg.msg_name = &addr->ss;
-		msg.msg_namelen = sizeof(addr->ss);
-	}
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_control = control;
-	msg.msg_controllen = sizeof(control);
-
-	if (flags == MSG_ERRQUEUE) {
-		struct pollfd pfd = { fd, sk_events, 0 };
-		res = poll(&pfd, 1, sk_tx_timeout);
-		if (res < 1) {
-			pr_err(res ? "poll for tx timestamp failed: %m" :
-			             "timed out while polling for tx timestamp");
-			pr_err("increasing tx_timestamp_timeout may correct "
-			       "this issue, but it is likely caused by a driver bug");
-			return -errno;
-		} else if (!(pfd.revents & sk_revents)) {
-			pr_err("poll for tx timestamp woke up on non ERR event");
-			return -1;
-		}
-	}
-
-	cnt = recvmsg(fd, &msg, flags);
-	if (cnt < 0) {
-		pr_err("recvmsg%sfailed: %m",
-		       flags == MSG_ERRQUEUE ? " tx timestamp " : " ");
-	}
-	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+	for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
 		level = cm->cmsg_level;
 		type  = cm->cmsg_type;
 		if (SOL_SOCKET == level && SO_TIMESTAMPING == type) {
@@ -388,12 +353,9 @@ int sk_receive(int fd, void *buf, int buflen,
 		}
 	}
 
-	if (addr)
-		addr->len = msg.msg_namelen;
-
 	if (!ts) {
 		memset(&hwts->ts, 0, sizeof(hwts->ts));
-		return cnt < 1 ? -errno : cnt;
+		return 0;
 	}
 
 	switch (hwts->type) {
@@ -409,9 +371,124 @@ int sk_receive(int fd, void *buf, int buflen,
 		hwts->ts = timespec_to_tmv(ts[1]);
 		break;
 	}
+	return 0;
+}
+
+int sk_txts_wait(int fd, int timeout)
+{
+	struct pollfd pfd = { fd, sk_events, 0 };
+	int res;
+
+	res = poll(&pfd, 1, timeout);
+	if (res < 1) {
+		pr_err(res ? "poll for tx timestamp failed: %m" :
+		             "timed out while polling for tx timestamp");
+		pr_err("increasing tx_timestamp_timeout may correct "
+		       "this issue, but it is likely caused by a driver bug");
+		return res ? -errno : -ETIMEDOUT;
+	} else if (!(pfd.revents & sk_revents)) {
+		pr_err("poll for tx timestamp woke up on non ERR event");
+		return -1;
+	}
+	return 0;
+}
+
+int sk_receive(int fd, void *buf, int buflen,
+	       struct address *addr, struct hw_timestamp *hwts, int flags)
+{
+	char control[256];
+	int cnt = 0, err, res = 0;
+	struct iovec iov = { buf, buflen };
+	struct msghdr msg;
+
+	memset(control, 0, sizeof(control));
+	memset(&msg, 0, sizeof(msg));
+	if (addr) {
+		msg.msg_name = &addr->ss;
+		msg.msg_namelen = sizeof(addr->ss);
+	}
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (flags == MSG_ERRQUEUE) {
+		res = sk_txts_wait(fd, sk_tx_timeout);
+		if (res) {
+			return res;
+		}
+	}
+
+	cnt = recvmsg(fd, &msg, flags);
+	if (cnt < 0 && !(flags == (MSG_ERRQUEUE | MSG_DONTWAIT) &&
+			 errno == EAGAIN)) {
+		pr_err("recvmsg%sfailed: %m",
+		       flags & MSG_ERRQUEUE ? " tx timestamp " : " ");
+	}
+	err = sk_timestamps(&msg, hwts);
+	if (err) {
+		return err;
+	}
+	if (addr)
+		addr->len = msg.msg_namelen;
+
 	return cnt < 1 ? -errno : cnt;
 }
 
+int sk_receive_batch(int fd, void **buf, int *len, struct address **addr,
+		     struct hw_timestamp **hwts, int n)
+{
+	char control[TRANSPORT_BATCH_MAX][256];
+	struct mmsghdr mmsg[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	int i, cnt, err;
+
+	if (n > TRANSPORT_BATCH_MAX) {
+		n = TRANSPORT_BATCH_MAX;
+	}
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = len[i];
+		mmsg[i].msg_hdr.msg_name = &addr[i]->ss;
+		mmsg[i].msg_hdr.msg_namelen = sizeof(addr[i]->ss);
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+		mmsg[i].msg_hdr.msg_control = control[i];
+		mmsg[i].msg_hdr.msg_controllen = sizeof(control[i]);
+	}
+
+	cnt = recvmmsg(fd, mmsg, n, MSG_DONTWAIT, NULL);
+	if (cnt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return -EAGAIN;
+	}
+	if (cnt < 1) {
+		pr_err("recvmmsg failed: %m");
+		return cnt < 0 ? -errno : -EAGAIN;
+	}
+	for (i = 0; i < cnt; i++) {
+		err = sk_timestamps(&mmsg[i].msg_hdr, hwts[i]);
+		len[i] = err ? err : (int) mmsg[i].msg_len;
+		addr[i]->len = mmsg[i].msg_hdr.msg_namelen;
+	}
+	return cnt;
+}
+
+int sk_sendmmsg(int fd, struct mmsghdr *msgvec, int vlen)
+{
+	int cnt, sent = 0;
+
+	while (sent < vlen) {
+		cnt = sendmmsg(fd, msgvec + sent, vlen - sent, 0);
+		if (cnt < 1) {
+			pr_err("sendmmsg failed: %m");
+			return sent ? sent : -errno;
+		}
+		sent += cnt;
+	}
+	return sent;
+}
+
 int sk_set_priority(int fd, int family, uint8_t dscp)
 {
 	int level, optname, tos;
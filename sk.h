@@ -95,6 +95,15 @@ int sk_interface_macaddr(const char *name, struct address *mac);
  */
 int sk_interface_addr(const char *name, int family, struct address *addr);
 
+/**
+ * Waits for a transmit time stamp on the error queue of a socket.
+ * @param fd       An open socket.
+ * @param timeout  Time to wait in milliseconds.
+ * @return         Zero if a time stamp is queued, or a negative error
+ *                 code, -ETIMEDOUT if none arrived in time.
+ */
+int sk_txts_wait(int fd, int timeout);
+
 /**
  * Read a message from a socket.
  * @param fd      An open socket.
@@ -103,12 +112,53 @@ int sk_interface_addr(const char *name, int family, struct address *addr);
  * @param addr    Pointer to a buffer to receive the message's source
  *                address. May be NULL.
  * @param hwts    Pointer to a buffer to receive the message's time stamp.
- * @param flags   Flags to pass to RECV(2).
+ * @param flags   Flags to pass to RECV(2). When MSG_ERRQUEUE is given
+ *                alone, the call polls for up to sk_tx_timeout
+ *                milliseconds. Adding MSG_DONTWAIT returns -EAGAIN at
+ *                once if no time stamp is queued.
  * @return
  */
 int sk_receive(int fd, void *buf, int buflen,
 	       struct address *addr, struct hw_timestamp *hwts, int flags);
 
+/**
+ * Read a batch of messages from a socket with a single system call,
+ * without blocking.
+ * @param fd      An open socket.
+ * @param buf     Array of buffers to receive the messages.
+ * @param len     On entry, the size of each buffer in bytes. On return,
+ *                the length of each message received, or a negative
+ *                error code if the message's time stamp was malformed.
+ * @param addr    Array of buffers to receive the source addresses.
+ * @param hwts    Array of buffers to receive the time stamps.
+ * @param n       Number of entries in each array, at most
+ *                TRANSPORT_BATCH_MAX.
+ * @return        The number of messages received, or negative error code.
+ */
+int sk_receive_batch(int fd, void **buf, int *len, struct address **addr,
+		     struct hw_timestamp **hwts, int n);
+
+/**
+ * Extracts the time stamps from the control messages of a datagram.
+ * @param msg     The header of the received datagram.
+ * @param hwts    Receives the time stamps. The type field selects which
+ *                of the SO_TIMESTAMPING values is taken.
+ * @return        Zero on success, or negative error code if a time stamp
+ *                message is malformed.
+ */
+int sk_timestamps(struct msghdr *msg, struct hw_timestamp *hwts);
+
+/**
+ * Send a batch of messages with a single system call, retrying
+ * after partial transmission.
+ * @param fd      An open socket.
+ * @param msgvec  Array of message headers to send.
+ * @param vlen    Number of entries in 'msgvec'.
+ * @return        The number of messages sent, or negative error code if
+ *                none could be sent.
+ */
+int sk_sendmmsg(int fd, struct mmsghdr *msgvec, int vlen);
+
 /**
  * Set DSCP value for socket.
  * @param fd     An open socket.
@@ -23,6 +23,11 @@
 #include "tc.h"
 #include "tmv.h"
 
+/* Forwarded messages age out in buckets of a quarter second. */
+#define TC_AGE_PERIOD (NSEC2SEC / 4)
+/* Number of periods a remembered message stays current. */
+#define TC_AGE_LIMIT 4
+
 enum tc_match {
 	TC_MISMATCH,
 	TC_SYNC_FUP,
@@ -37,6 +42,7 @@ static int tc_match_delay(int ingress_port, struct ptp_message *resp,
 static int tc_match_syfup(int ingress_port, struct ptp_message *msg,
 			  struct tc_txd *txd);
 static void tc_recycle(struct tc_txd *txd);
+static void tc_expire(struct port *q, int64_t now);
 
 static struct tc_txd *tc_allocate(void)
 {
@@ -51,6 +57,90 @@ static struct tc_txd *tc_allocate(void)
 	return txd;
 }
 
+static int64_t tc_epoch(struct timespec *ts)
+{
+	return (ts->tv_sec * NSEC2SEC + ts->tv_nsec) / TC_AGE_PERIOD;
+}
+
+/*
+ * Sync and Follow_Up share one key, as do Delay_Req and Delay_Resp,
+ * where the latter is keyed by its requestingPortIdentity.
+ */
+static struct tci *tc_bucket(struct port *p, struct PortIdentity *pid,
+			     UInteger16 seqid, int type)
+{
+	unsigned int i, h = pid->portNumber;
+
+	for (i = 0; i < sizeof(pid->clockIdentity.id); i++) {
+		h = h * 31 + pid->clockIdentity.id[i];
+	}
+	h = h * 31 + seqid;
+	h = h * 31 + type;
+	return &p->tc_index[h % TC_INDEX_SIZE];
+}
+
+static int tc_stash(struct port *p, int ingress_port,
+		    struct ptp_message *msg, tmv_t residence)
+{
+	int type = msg_type(msg) == DELAY_REQ ? DELAY_REQ : SYNC;
+	int64_t epoch = tc_epoch(&msg->ts.host);
+	struct tc_txd *txd;
+
+	tc_expire(p, epoch);
+	txd = tc_allocate();
+	if (!txd) {
+		return -1;
+	}
+	msg_get(msg);
+	txd->msg = msg;
+	txd->residence = residence;
+	txd->ingress_port = ingress_port;
+	/* Late arrivals join the oldest bucket still current. */
+	if (epoch < p->tc_oldest) {
+		epoch = p->tc_oldest;
+	}
+	txd->age = epoch % TC_AGE_BUCKETS;
+	TAILQ_INSERT_TAIL(&p->tc_age[txd->age], txd, list);
+	LIST_INSERT_HEAD(tc_bucket(p, &msg->header.sourcePortIdentity,
+				   msg->header.sequenceId, type),
+			 txd, index);
+	return 0;
+}
+
+static void tc_release(struct port *p, struct tc_txd *txd)
+{
+	LIST_REMOVE(txd, index);
+	TAILQ_REMOVE(&p->tc_age[txd->age], txd, list);
+	msg_put(txd->msg);
+	tc_recycle(txd);
+}
+
+static void tc_flush_bucket(struct port *p, int age)
+{
+	struct tc_txd *txd;
+
+	while ((txd = TAILQ_FIRST(&p->tc_age[age])) != NULL) {
+		tc_release(p, txd);
+	}
+}
+
+/* Drops the buckets that have grown older than the age limit. */
+static void tc_expire(struct port *q, int64_t now)
+{
+	int i;
+
+	if (now - q->tc_oldest >= TC_AGE_BUCKETS) {
+		for (i = 0; i < TC_AGE_BUCKETS; i++) {
+			tc_flush_bucket(q, i);
+		}
+		q->tc_oldest = now - TC_AGE_LIMIT;
+		return;
+	}
+	for (; q->tc_oldest < now - TC_AGE_LIMIT; q->tc_oldest++) {
+		tc_flush_bucket(q, q->tc_oldest % TC_AGE_BUCKETS);
+	}
+}
+
 static int tc_blocked(struct port *q, struct port *p, struct ptp_message *m)
 {
 	enum port_state s;
@@ -135,21 +225,14 @@ egress:
 static void tc_complete_request(struct port *q, struct port *p,
 				struct ptp_message *req, tmv_t residence)
 {
-	struct tc_txd *txd = tc_allocate();
-	if (!txd) {
-		port_dispatch(p, EV_FAULT_DETECTED, 0);
-		return;
-	}
 #ifdef DEBUG
 	pr_err("stash delay request from port %hd to %hd seqid %hu residence %lu",
 	       portnum(q), portnum(p), ntohs(req->header.sequenceId),
 	       (unsigned long) tmv_to_nanoseconds(residence));
 #endif
-	msg_get(req);
-	txd->msg = req;
-	txd->residence = residence;
-	txd->ingress_port = portnum(q);
-	TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
+	if (tc_stash(p, portnum(q), req, residence)) {
+		port_dispatch(p, EV_FAULT_DETECTED, 0);
+	}
 }
 
 static void tc_complete_response(struct port *q, struct port *p,
@@ -164,7 +247,9 @@ static void tc_complete_response(struct port *q, struct port *p,
 	pr_err("complete delay response from port %hd to %hd seqid %hu",
 	       portnum(q), portnum(p), ntohs(resp->header.sequenceId));
 #endif
-	TAILQ_FOREACH(txd, &q->tc_transmitted, list) {
+	LIST_FOREACH(txd, tc_bucket(q, &resp->delay_resp.requestingPortIdentity,
+				    resp->header.sequenceId, DELAY_REQ),
+		     index) {
 		type = tc_match_delay(portnum(p), resp, txd);
 		if (type == TC_DELAY_REQRESP) {
 			residence = txd->residence;
@@ -184,9 +269,7 @@ static void tc_complete_response(struct port *q, struct port *p,
 	}
 	/* Restore original correction value for next egress port. */
 	resp->header.correction = host2net64(c1);
-	TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-	msg_put(txd->msg);
-	tc_recycle(txd);
+	tc_release(q, txd);
 }
 
 static void tc_complete_syfup(struct port *q, struct port *p,
@@ -198,7 +281,9 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 	Integer64 c1, c2;
 	int cnt;
 
-	TAILQ_FOREACH(txd, &p->tc_transmitted, list) {
+	LIST_FOREACH(txd, tc_bucket(p, &msg->header.sourcePortIdentity,
+				    msg->header.sequenceId, SYNC),
+		     index) {
 		type = tc_match_syfup(portnum(q), msg, txd);
 		switch (type) {
 		case TC_MISMATCH:
@@ -220,16 +305,9 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 	}
 
 	if (type == TC_MISMATCH) {
-		txd = tc_allocate();
-		if (!txd) {
+		if (tc_stash(p, portnum(q), msg, residence)) {
 			port_dispatch(p, EV_FAULT_DETECTED, 0);
-			return;
 		}
-		msg_get(msg);
-		txd->msg = msg;
-		txd->residence = residence;
-		txd->ingress_port = portnum(q);
-		TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
 		return;
 	}
 
@@ -245,9 +323,7 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 	}
 	/* Restore original correction value for next egress port. */
 	fup->header.correction = host2net64(c1);
-	TAILQ_REMOVE(&p->tc_transmitted, txd, list);
-	msg_put(txd->msg);
-	tc_recycle(txd);
+	tc_release(p, txd);
 }
 
 static void tc_complete(struct port *q, struct port *p,
@@ -267,23 +343,35 @@ static void tc_complete(struct port *q, struct port *p,
 	}
 }
 
-static int tc_current(struct ptp_message *m, struct timespec now)
+static tmv_t tc_residence(struct port *q, tmv_t ingress, tmv_t egress)
 {
-	int64_t t1, t2, tmo;
+	tmv_t residence;
+	double rr;
 
-	tmo = 1LL * NSEC2SEC;
-	t1 = m->ts.host.tv_sec * NSEC2SEC + m->ts.host.tv_nsec;
-	t2 = now.tv_sec * NSEC2SEC + now.tv_nsec;
+	residence = tmv_sub(egress, ingress);
+	rr = clock_rate_ratio(q->clock);
+	if (rr != 1.0) {
+		residence = dbl_tmv(tmv_dbl(residence) * rr);
+	}
+	return residence;
+}
+
+static int tc_fwd_event_complete(struct port *p, struct tx_pending *txp)
+{
+	tmv_t residence;
 
-	return t2 - t1 < tmo;
+	residence = tc_residence(txp->ingress, txp->ingress_ts,
+				 txp->msg->hwts.ts);
+	tc_complete(txp->ingress, p, txp->msg, residence);
+	return 0;
 }
 
 static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 {
 	tmv_t egress, ingress = msg->hwts.ts, residence;
+	struct tx_pending *txp;
 	struct port *p;
 	int cnt, err;
-	double rr;
 	Integer64 corr;
 
 	clock_gettime(CLOCK_MONOTONIC, &msg->ts.host);
@@ -315,7 +403,17 @@ static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 		if (tc_blocked(q, p, msg)) {
 			continue;
 		}
-		err = transport_txts(&p->fda, msg);
+		if (p->tx_timestamp_async) {
+			txp = port_tx_defer(p, msg, tc_fwd_event_complete);
+			if (!txp) {
+				port_dispatch(p, EV_FAULT_DETECTED, 0);
+				continue;
+			}
+			txp->ingress = q;
+			txp->ingress_ts = ingress;
+			continue;
+		}
+		err = transport_txts(p->trp, &p->fda, msg);
 		if (err || !msg_sots_valid(msg)) {
 			pr_err("failed to fetch txts on port %hd to %hd event",
 				portnum(q), portnum(p));
@@ -324,11 +422,7 @@ static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 		}
 		ts_add(&msg->hwts.ts, p->tx_timestamp_offset);
 		egress = msg->hwts.ts;
-		residence = tmv_sub(egress, ingress);
-		rr = clock_rate_ratio(q->clock);
-		if (rr != 1.0) {
-			residence = dbl_tmv(tmv_dbl(residence) * rr);
-		}
+		residence = tc_residence(q, ingress, egress);
 		tc_complete(q, p, msg, residence);
 	}
 
@@ -395,14 +489,24 @@ void tc_cleanup(void)
 	}
 }
 
+void tc_init(struct port *q)
+{
+	int i;
+
+	for (i = 0; i < TC_INDEX_SIZE; i++) {
+		LIST_INIT(&q->tc_index[i]);
+	}
+	for (i = 0; i < TC_AGE_BUCKETS; i++) {
+		TAILQ_INIT(&q->tc_age[i]);
+	}
+}
+
 void tc_flush(struct port *q)
 {
-	struct tc_txd *txd;
+	int i;
 
-	while ((txd = TAILQ_FIRST(&q->tc_transmitted)) != NULL) {
-		TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-		msg_put(txd->msg);
-		tc_recycle(txd);
+	for (i = 0; i < TC_AGE_BUCKETS; i++) {
+		tc_flush_bucket(q, i);
 	}
 }
 
@@ -590,16 +694,7 @@ int tc_ignore(struct port *p, struct ptp_message *m)
 void tc_prune(struct port *q)
 {
 	struct timespec now;
-	struct tc_txd *txd;
 
 	clock_gettime(CLOCK_MONOTONIC, &now);
-
-	while ((txd = TAILQ_FIRST(&q->tc_transmitted)) != NULL) {
-		if (tc_current(txd->msg, now)) {
-			break;
-		}
-		TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-		msg_put(txd->msg);
-		tc_recycle(txd);
-	}
+	tc_expire(q, tc_epoch(&now));
 }
@@ -23,6 +23,12 @@
 #include "msg.h"
 #include "port_private.h"
 
+/**
+ * Initializes the table of remembered residence times.
+ * @param q    Port whose table should be initialized
+ */
+void tc_init(struct port *q);
+
 /**
  * Flushes the list of remembered residence times.
  * @param q    Port whose list should be flushed
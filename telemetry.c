@@ -0,0 +1,129 @@
+/**
+ * @file telemetry.c
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "print.h"
+#include "telemetry.h"
+
+struct telemetry {
+	struct telemetry_header *header;
+	struct telemetry_record *records;
+	size_t length;
+	uint64_t mask;
+};
+
+struct telemetry *telemetry_create(struct config *config)
+{
+	const char *path = config_get_string(config, NULL, "telemetry_file");
+	int fd, size = config_get_int(config, NULL, "telemetry_size");
+	struct telemetry *t;
+	uint64_t n;
+	void *map;
+
+	t = calloc(1, sizeof(*t));
+	if (!t) {
+		return NULL;
+	}
+	if (!path[0]) {
+		return t;
+	}
+	for (n = 1; n < size; n <<= 1) {
+		;
+	}
+	t->length = sizeof(*t->header) + n * sizeof(*t->records);
+	t->mask = n - 1;
+
+	/*
+	 * Readers may still map the file of an earlier run, and truncating
+	 * it would fault them. Replace the file instead, and let readers
+	 * ignore the new one until the magic number appears.
+	 */
+	if (unlink(path) && errno != ENOENT) {
+		pr_err("failed to remove %s: %m", path);
+		goto no_file;
+	}
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		pr_err("failed to open %s: %m", path);
+		goto no_file;
+	}
+	if (ftruncate(fd, t->length)) {
+		pr_err("failed to resize %s: %m", path);
+		goto no_map;
+	}
+	map = mmap(NULL, t->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		pr_err("failed to map %s: %m", path);
+		goto no_map;
+	}
+	close(fd);
+
+	t->header = map;
+	t->records = (struct telemetry_record *) (t->header + 1);
+	t->header->version = TELEMETRY_VERSION;
+	t->header->record_size = sizeof(*t->records);
+	t->header->size = n;
+	__atomic_store_n(&t->header->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+	return t;
+
+no_map:
+	close(fd);
+no_file:
+	free(t);
+	return NULL;
+}
+
+void telemetry_destroy(struct telemetry *t)
+{
+	if (t->header) {
+		munmap(t->header, t->length);
+	}
+	free(t);
+}
+
+void telemetry_sample(struct telemetry *t, const char *source,
+		      int64_t ingress, int64_t offset, int64_t delay,
+		      double freq, int state)
+{
+	struct telemetry_record *r;
+	uint64_t pos;
+
+	if (!t->header) {
+		return;
+	}
+	pos = __atomic_fetch_add(&t->header->head, 1, __ATOMIC_RELAXED);
+	r = &t->records[pos & t->mask];
+
+	__atomic_store_n(&r->seq, 2 * pos + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	r->ingress = ingress;
+	r->offset = offset;
+	r->delay = delay;
+	r->freq = freq;
+	r->state = state;
+	strncpy(r->source, source ? source : "", sizeof(r->source) - 1);
+	r->source[sizeof(r->source) - 1] = '\0';
+	__atomic_store_n(&r->seq, 2 * pos + 2, __ATOMIC_RELEASE);
+}
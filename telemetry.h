@@ -0,0 +1,105 @@
+/**
+ * @file telemetry.h
+ * @brief Publishes servo samples in a memory mapped ring file.
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_TELEMETRY_H
+#define HAVE_TELEMETRY_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+#define TELEMETRY_MAGIC		0x4c455450 /* "PTEL" */
+#define TELEMETRY_VERSION	1
+#define TELEMETRY_SOURCE_SIZE	16
+
+/*
+ * The file starts with a header, followed by a power of two number of
+ * records. Sample number N is stored in record N modulo the size.
+ *
+ * A reader checks the magic and version, then loads the head, which
+ * counts the samples claimed by the writers so far. To copy sample N,
+ * it loads the record's sequence number, which is 2 * N + 2 once the
+ * sample is complete, copies the record, and loads the sequence number
+ * again. The copy is valid if both loads returned 2 * N + 2. Any other
+ * value means that the sample is still being written or has already
+ * been overwritten.
+ *
+ * A writer replaces the file when it starts, so a reader that mapped
+ * the file of an earlier run keeps its mapping and needs to open the
+ * path again to follow the new one.
+ */
+struct telemetry_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t size;
+	uint32_t reserved;
+	uint64_t head;
+};
+
+struct telemetry_record {
+	uint64_t seq;
+	/* Local time of the sample in nanoseconds. */
+	int64_t ingress;
+	/* Offset from the master in nanoseconds. */
+	int64_t offset;
+	/* Path delay in nanoseconds, or -1 if not known. */
+	int64_t delay;
+	/* Frequency adjustment in ppb. */
+	double freq;
+	/* One of the servo_state values. */
+	int32_t state;
+	uint32_t reserved;
+	/* The synchronized clock, NUL terminated. */
+	char source[TELEMETRY_SOURCE_SIZE];
+};
+
+/** Opaque type */
+struct telemetry;
+
+/**
+ * Creates a telemetry ring as configured by the telemetry_file and
+ * telemetry_size options. When no file is configured, the returned
+ * instance silently discards the samples.
+ * @param config  The configuration.
+ * @return        A pointer to a new instance on success, NULL otherwise.
+ */
+struct telemetry *telemetry_create(struct config *config);
+
+/**
+ * Destroys a telemetry ring. The file is left in place for readers.
+ * @param t  A pointer obtained via @ref telemetry_create().
+ */
+void telemetry_destroy(struct telemetry *t);
+
+/**
+ * Publishes a servo sample. Safe to call from several threads.
+ * @param t        A pointer obtained via @ref telemetry_create().
+ * @param source   The name of the synchronized clock.
+ * @param ingress  The local time of the sample in nanoseconds.
+ * @param offset   The offset from the master in nanoseconds.
+ * @param delay    The path delay in nanoseconds, or -1.
+ * @param freq     The frequency adjustment in ppb.
+ * @param state    The servo state.
+ */
+void telemetry_sample(struct telemetry *t, const char *source,
+		      int64_t ingress, int64_t offset, int64_t delay,
+		      double freq, int state);
+
+#endif
@@ -120,6 +120,7 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 	struct portDS *p;
 	struct port_ds_np *pdsnp;
 	struct time_status_np *tsn;
+	struct msg_pool_stats_np *mps;
 	struct grandmaster_settings_np *gsn;
 	struct subscribe_events_np *sen;
 	struct port_properties_np *ppn;
@@ -289,6 +290,16 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 		scaled_ns_n2h(&tsn->lastGmPhaseChange);
 		tsn->gmPresent = ntohl(tsn->gmPresent);
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		if (data_len != sizeof(struct msg_pool_stats_np))
+			goto bad_length;
+		mps = (struct msg_pool_stats_np *) m->data;
+		mps->allocations = net2host64(mps->allocations);
+		mps->misses = net2host64(mps->misses);
+		mps->size = ntohl(mps->size);
+		mps->in_use = ntohl(mps->in_use);
+		mps->high_water = ntohl(mps->high_water);
+		break;
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		if (data_len != sizeof(struct grandmaster_settings_np))
 			goto bad_length;
@@ -356,6 +367,7 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 	struct portDS *p;
 	struct port_ds_np *pdsnp;
 	struct time_status_np *tsn;
+	struct msg_pool_stats_np *mps;
 	struct grandmaster_settings_np *gsn;
 	struct subscribe_events_np *sen;
 	struct port_properties_np *ppn;
@@ -413,6 +425,14 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 		scaled_ns_h2n(&tsn->lastGmPhaseChange);
 		tsn->gmPresent = htonl(tsn->gmPresent);
 		break;
+	case TLV_MSG_POOL_STATS_NP:
+		mps = (struct msg_pool_stats_np *) m->data;
+		mps->allocations = host2net64(mps->allocations);
+		mps->misses = host2net64(mps->misses);
+		mps->size = htonl(mps->size);
+		mps->in_use = htonl(mps->in_use);
+		mps->high_water = htonl(mps->high_water);
+		break;
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		gsn = (struct grandmaster_settings_np *) m->data;
 		gsn->clockQuality.offsetScaledLogVariance =
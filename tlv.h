@@ -100,6 +100,7 @@ enum management_action {
 #define TLV_GRANDMASTER_SETTINGS_NP			0xC001
 #define TLV_SUBSCRIBE_EVENTS_NP				0xC003
 #define TLV_SYNCHRONIZATION_UNCERTAIN_NP		0xC006
+#define TLV_MSG_POOL_STATS_NP				0xC080
 
 /* Port management ID values */
 #define TLV_NULL_MANAGEMENT				0x0000
@@ -324,6 +325,14 @@ struct grandmaster_settings_np {
 	Enumeration8 time_source;
 } PACKED;
 
+struct msg_pool_stats_np {
+	UInteger64    allocations;
+	UInteger64    misses;
+	UInteger32    size;
+	UInteger32    in_use;
+	UInteger32    high_water;
+} PACKED;
+
 struct port_ds_np {
 	UInteger32    neighborPropDelayThresh; /*nanoseconds*/
 	Integer32     asCapable;
@@ -18,7 +18,13 @@
  */
 
 #include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
 
+#include "config.h"
+#include "print.h"
+#include "sk.h"
 #include "transport.h"
 #include "transport_private.h"
 #include "raw.h"
@@ -26,9 +32,24 @@
 #include "udp6.h"
 #include "uds.h"
 
+/* The backends always operate on their sockets. */
+static struct fdarray *transport_fds(struct transport *t, struct fdarray *fda)
+{
+	return t->ring ? &t->sk : fda;
+}
+
 int transport_close(struct transport *t, struct fdarray *fda)
 {
-	return t->close(t, fda);
+	struct fdarray sk;
+
+	t->lends = 0;
+	if (!t->ring) {
+		return t->close(t, fda);
+	}
+	sk = t->sk;
+	uring_destroy(t->ring);
+	t->ring = NULL;
+	return t->close(t, &sk);
 }
 
 int transport_open(struct transport *t, struct interface *iface,
@@ -42,12 +63,36 @@ int transport_recv(struct transport *t, int fd, struct ptp_message *msg)
 	return t->recv(t, fd, msg, sizeof(msg->data), &msg->address, &msg->hwts);
 }
 
+int transport_recv_batch(struct transport *t, int fd, struct ptp_message **msg,
+			 int *cnt, int n)
+{
+	struct hw_timestamp *hwts[TRANSPORT_BATCH_MAX];
+	struct address *addr[TRANSPORT_BATCH_MAX];
+	void *buf[TRANSPORT_BATCH_MAX];
+	int i;
+
+	if (n > TRANSPORT_BATCH_MAX) {
+		return -EINVAL;
+	}
+	if (!t->recv_batch || (n == 1 && !t->lends)) {
+		cnt[0] = transport_recv(t, fd, msg[0]);
+		return cnt[0] < 0 ? cnt[0] : 1;
+	}
+	for (i = 0; i < n; i++) {
+		buf[i] = msg[i];
+		cnt[i] = sizeof(msg[i]->data);
+		addr[i] = &msg[i]->address;
+		hwts[i] = &msg[i]->hwts;
+	}
+	return t->recv_batch(t, fd, msg, buf, cnt, addr, hwts, n);
+}
+
 int transport_send(struct transport *t, struct fdarray *fda,
 		   enum transport_event event, struct ptp_message *msg)
 {
 	int len = ntohs(msg->header.messageLength);
 
-	return t->send(t, fda, event, 0, msg, len, NULL, &msg->hwts);
+	return t->send(t, transport_fds(t, fda), event, 0, msg, len, NULL, &msg->hwts);
 }
 
 int transport_peer(struct transport *t, struct fdarray *fda,
@@ -55,7 +100,7 @@ int transport_peer(struct transport *t, struct fdarray *fda,
 {
 	int len = ntohs(msg->header.messageLength);
 
-	return t->send(t, fda, event, 1, msg, len, NULL, &msg->hwts);
+	return t->send(t, transport_fds(t, fda), event, 1, msg, len, NULL, &msg->hwts);
 }
 
 int transport_sendto(struct transport *t, struct fdarray *fda,
@@ -63,20 +108,300 @@ int transport_sendto(struct transport *t, struct fdarray *fda,
 {
 	int len = ntohs(msg->header.messageLength);
 
-	return t->send(t, fda, event, 0, msg, len, &msg->address, &msg->hwts);
+	return t->send(t, transport_fds(t, fda), event, 0, msg, len, &msg->address, &msg->hwts);
+}
+
+int transport_send_batch(struct transport *t, struct fdarray *fda,
+			 enum transport_event event, struct ptp_message **msg,
+			 int n)
+{
+	struct address *addr[TRANSPORT_BATCH_MAX];
+	void *buf[TRANSPORT_BATCH_MAX];
+	int i, cnt, len[TRANSPORT_BATCH_MAX];
+
+	if (n > TRANSPORT_BATCH_MAX) {
+		return -EINVAL;
+	}
+	fda = transport_fds(t, fda);
+	for (i = 0; i < n; i++) {
+		buf[i] = msg[i];
+		len[i] = ntohs(msg[i]->header.messageLength);
+		addr[i] = msg[i]->address.len ? &msg[i]->address : NULL;
+	}
+	if (t->send_batch) {
+		return t->send_batch(t, fda, event, buf, len, addr, n);
+	}
+	for (i = 0; i < n; i++) {
+		cnt = t->send(t, fda, event, 0, buf[i], len[i], addr[i],
+			      &msg[i]->hwts);
+		if (cnt <= 0) {
+			return i ? i : cnt;
+		}
+	}
+	return n;
+}
+
+#define FILTER_MAX	64
+
+/* Jump targets of the filter program, besides the next instruction. */
+#define JMP_ACCEPT	-1
+#define JMP_REJECT	-2
+
+/* Scratch memory slots. */
+#define MEM_OFFSET	0
+#define MEM_TYPE_BIT	1
+
+#define EVENT_TYPES	0x000f
+#define GENERAL_TYPES	0xff00
+
+struct filter_prog {
+	struct sock_filter insn[FILTER_MAX];
+	int jt[FILTER_MAX];
+	int jf[FILTER_MAX];
+	int n;
+};
+
+static void emit(struct filter_prog *fp, __u16 code, int jt, int jf, __u32 k)
+{
+	fp->insn[fp->n].code = code;
+	fp->insn[fp->n].k = k;
+	fp->jt[fp->n] = jt;
+	fp->jf[fp->n] = jf;
+	fp->n++;
+}
+
+static int resolve(int pc, int target, int accept, int reject)
+{
+	switch (target) {
+	case JMP_ACCEPT:
+		return accept - pc - 1;
+	case JMP_REJECT:
+		return reject - pc - 1;
+	}
+	return target;
+}
+
+static int attach_filter(int fd, const struct sock_filter *pre, int n,
+			 struct transport_filter *f, uint16_t types)
+{
+	struct filter_prog fp;
+	struct sock_fprog prg;
+	int accept, i, reject;
+	uint8_t *id;
+
+	if (fd < 0) {
+		return 0;
+	}
+	if (n > FILTER_MAX / 2) {
+		return -1;
+	}
+	memset(&fp, 0, sizeof(fp));
+	memcpy(fp.insn, pre, n * sizeof(*pre));
+	for (i = 0; i < n; i++) {
+		fp.jt[i] = pre[i].jt;
+		fp.jf[i] = pre[i].jf;
+	}
+	fp.n = n;
+
+	emit(&fp, BPF_STX, 0, 0, MEM_OFFSET);
+	if (f->transport_specific >= 0) {
+		emit(&fp, BPF_LD | BPF_B | BPF_IND, 0, 0, 0);
+		emit(&fp, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xf0);
+		emit(&fp, BPF_JMP | BPF_JEQ | BPF_K, 0, JMP_REJECT,
+		     f->transport_specific);
+	}
+	/* messageType is a bit index into the mask of accepted types. */
+	emit(&fp, BPF_LD | BPF_B | BPF_IND, 0, 0, 0);
+	emit(&fp, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x0f);
+	emit(&fp, BPF_MISC | BPF_TAX, 0, 0, 0);
+	emit(&fp, BPF_LD | BPF_IMM, 0, 0, 1);
+	emit(&fp, BPF_ALU | BPF_LSH | BPF_X, 0, 0, 0);
+	emit(&fp, BPF_ST, 0, 0, MEM_TYPE_BIT);
+	emit(&fp, BPF_JMP | BPF_JSET | BPF_K, 0, JMP_REJECT, types);
+	emit(&fp, BPF_LDX | BPF_MEM, 0, 0, MEM_OFFSET);
+	if (f->domain >= 0) {
+		emit(&fp, BPF_LD | BPF_B | BPF_IND, 0, 0, 4);
+		emit(&fp, BPF_JMP | BPF_JEQ | BPF_K, 0, JMP_REJECT, f->domain);
+	}
+	if (f->source_types & types) {
+		id = f->source.clockIdentity.id;
+		emit(&fp, BPF_LD | BPF_MEM, 0, 0, MEM_TYPE_BIT);
+		emit(&fp, BPF_JMP | BPF_JSET | BPF_K, 0, JMP_ACCEPT,
+		     f->source_types);
+		emit(&fp, BPF_LD | BPF_W | BPF_IND, 0, 0, 20);
+		emit(&fp, BPF_JMP | BPF_JEQ | BPF_K, 0, JMP_REJECT,
+		     (uint32_t) id[0] << 24 | id[1] << 16 | id[2] << 8 | id[3]);
+		emit(&fp, BPF_LD | BPF_W | BPF_IND, 0, 0, 24);
+		emit(&fp, BPF_JMP | BPF_JEQ | BPF_K, 0, JMP_REJECT,
+		     (uint32_t) id[4] << 24 | id[5] << 16 | id[6] << 8 | id[7]);
+		emit(&fp, BPF_LD | BPF_H | BPF_IND, 0, 0, 28);
+		emit(&fp, BPF_JMP | BPF_JEQ | BPF_K, 0, JMP_REJECT,
+		     f->source.portNumber);
+	}
+	accept = fp.n;
+	emit(&fp, BPF_RET | BPF_K, 0, 0, 0xffffffff);
+	reject = fp.n;
+	emit(&fp, BPF_RET | BPF_K, 0, 0, 0);
+
+	for (i = 0; i < fp.n; i++) {
+		fp.insn[i].jt = resolve(i, fp.jt[i], accept, reject);
+		fp.insn[i].jf = resolve(i, fp.jf[i], accept, reject);
+	}
+	prg.len = fp.n;
+	prg.filter = fp.insn;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prg, sizeof(prg))) {
+		pr_err("setsockopt SO_ATTACH_FILTER failed: %m");
+		return -1;
+	}
+	return 0;
+}
+
+int transport_attach_filter(struct fdarray *fda, const struct sock_filter *pre,
+			    int n, struct transport_filter *f)
+{
+	if (attach_filter(fda->fd[FD_EVENT], pre, n, f,
+			  f->types & EVENT_TYPES)) {
+		return -1;
+	}
+	return attach_filter(fda->fd[FD_GENERAL], pre, n, f,
+			     f->types & GENERAL_TYPES);
+}
+
+int transport_set_filter(struct transport *t, struct fdarray *fda,
+			 struct transport_filter *f)
+{
+	if (t->set_filter) {
+		return t->set_filter(t, transport_fds(t, fda), f);
+	}
+	return 0;
 }
 
-int transport_txts(struct fdarray *fda,
+int transport_txts(struct transport *t, struct fdarray *fda,
 		   struct ptp_message *msg)
 {
 	int cnt, len = ntohs(msg->header.messageLength);
 	struct hw_timestamp *hwts = &msg->hwts;
 	unsigned char pkt[1600];
 
-	cnt = sk_receive(fda->fd[FD_EVENT], pkt, len, NULL, hwts, MSG_ERRQUEUE);
+	fda = transport_fds(t, fda);
+	cnt = transport_sk_receive(t, fda->fd[FD_EVENT], pkt, len, NULL, hwts,
+				   MSG_ERRQUEUE);
 	return cnt > 0 ? 0 : cnt;
 }
 
+int transport_txts_next(struct transport *t, struct fdarray *fda, void *buf,
+			int buflen, struct hw_timestamp *hwts, int timeout)
+{
+	int err;
+
+	if (t->ring) {
+		return uring_txts(t->ring, buf, buflen, hwts, timeout);
+	}
+	fda = transport_fds(t, fda);
+	if (timeout) {
+		err = sk_txts_wait(fda->fd[FD_EVENT], timeout);
+		if (err) {
+			return err;
+		}
+	}
+	return sk_receive(fda->fd[FD_EVENT], buf, buflen, NULL, hwts,
+			  MSG_ERRQUEUE | MSG_DONTWAIT);
+}
+
+int transport_txts_pending(struct transport *t)
+{
+	return t->ring ? uring_txts_pending(t->ring) : 0;
+}
+
+void transport_uring_open(struct transport *t, const char *name, int lead,
+			  struct fdarray *fda)
+{
+	enum uring_mode mode;
+
+	t->ring = NULL;
+	if (!t->cfg) {
+		return;
+	}
+	mode = config_get_int(t->cfg, name, "io_uring");
+	if (mode == URING_OFF) {
+		return;
+	}
+	t->ring = uring_create(fda->fd[FD_EVENT], fda->fd[FD_GENERAL], lead,
+			       mode);
+	if (!t->ring) {
+		pr_warning("%s: using the sockets without io_uring", name);
+		return;
+	}
+	t->lends = 1;
+	t->sk = *fda;
+	fda->fd[FD_EVENT] = uring_fd(t->ring);
+	fda->fd[FD_GENERAL] = -1;
+}
+
+int transport_sk_receive(struct transport *t, int fd, void *buf, int buflen,
+			 struct address *addr, struct hw_timestamp *hwts,
+			 int flags)
+{
+	int cnt;
+
+	if (!t->ring) {
+		return sk_receive(fd, buf, buflen, addr, hwts, flags);
+	}
+	if (flags & MSG_ERRQUEUE) {
+		return uring_txts(t->ring, buf, buflen, hwts,
+				  flags & MSG_DONTWAIT ? 0 : sk_tx_timeout);
+	}
+	cnt = uring_recv(t->ring, NULL, &buf, &buflen, &addr, &hwts, 1);
+	if (cnt < 0) {
+		return cnt;
+	}
+	return cnt ? buflen : -EAGAIN;
+}
+
+int transport_sk_receive_batch(struct transport *t, int fd,
+			       struct ptp_message **msg, void **buf, int *len,
+			       struct address **addr,
+			       struct hw_timestamp **hwts, int n)
+{
+	if (!t->ring) {
+		return sk_receive_batch(fd, buf, len, addr, hwts, n);
+	}
+	return uring_recv(t->ring, msg, buf, len, addr, hwts, n);
+}
+
+int transport_sk_sendmmsg(struct transport *t, int fd, struct mmsghdr *mmsg,
+			  int n)
+{
+	if (!t->ring) {
+		return sk_sendmmsg(fd, mmsg, n);
+	}
+	return uring_sendmmsg(t->ring, fd, mmsg, n);
+}
+
+int transport_sk_sendto(struct transport *t, int fd, void *buf, int len,
+			struct sockaddr *sa, socklen_t salen)
+{
+	struct iovec iov = { buf, len };
+	struct mmsghdr mmsg;
+	int cnt;
+
+	if (!t->ring) {
+		return sendto(fd, buf, len, 0, sa, salen);
+	}
+	memset(&mmsg, 0, sizeof(mmsg));
+	mmsg.msg_hdr.msg_name = sa;
+	mmsg.msg_hdr.msg_namelen = salen;
+	mmsg.msg_hdr.msg_iov = &iov;
+	mmsg.msg_hdr.msg_iovlen = 1;
+	cnt = uring_sendmmsg(t->ring, fd, &mmsg, 1);
+	if (cnt < 1) {
+		errno = cnt < 0 ? -cnt : EAGAIN;
+		return -1;
+	}
+	return len;
+}
+
 int transport_physical_addr(struct transport *t, uint8_t *addr)
 {
 	if (t->physical_addr) {
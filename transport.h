@@ -101,18 +101,126 @@ int transport_peer(struct transport *t, struct fdarray *fda,
 int transport_sendto(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, struct ptp_message *msg);
 
+#define TRANSPORT_BATCH_MAX 64
+
+/**
+ * Receives a batch of PTP messages from one of the transport's
+ * descriptors, using as few system calls as the transport allows.
+ * The call does not block, and at least one message is expected to
+ * be pending.
+ *
+ * @param t	The transport.
+ * @param fd	The descriptor to read from.
+ * @param msg	Array of messages to fill, with the time stamping mode
+ *		already set in each message's hwts field. A transport
+ *		receiving into messages lent from the pool may replace
+ *		entries by the messages it received into, and keeps the
+ *		replaced ones.
+ * @param cnt	Array filled with the length of each message received,
+ *		or a negative error code for that message.
+ * @param n	Number of messages, at most TRANSPORT_BATCH_MAX.
+ * @return	Number of messages received, or negative value in case of
+ *		an error.
+ */
+int transport_recv_batch(struct transport *t, int fd, struct ptp_message **msg,
+			 int *cnt, int n);
+
+/**
+ * Sends a batch of PTP messages, each to the address stored in the
+ * message, using as few system calls as the transport allows. Messages
+ * without an address go to the default (usually multicast) address.
+ *
+ * Transmit time stamps are never collected by this function. Event
+ * messages sent with TRANS_DEFER_EVENT obtain their time stamps via
+ * transport_txts_next().
+ *
+ * @param t	The transport.
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param event	One of the @ref transport_event enumeration values,
+ *		other than TRANS_EVENT.
+ * @param msg	Array of messages to send, in network byte order.
+ * @param n	Number of messages, at most TRANSPORT_BATCH_MAX.
+ * @return	Number of messages sent, or negative value in case of
+ *		an error.
+ */
+int transport_send_batch(struct transport *t, struct fdarray *fda,
+			 enum transport_event event, struct ptp_message **msg,
+			 int n);
+
+/**
+ * Describes the PTP messages a port wants to receive. Transports which
+ * support it drop all other messages in the kernel.
+ */
+struct transport_filter {
+	/* Accepted message types, one bit (1 << messageType) each. */
+	uint16_t types;
+	/* Accepted types which must also come from 'source'. */
+	uint16_t source_types;
+	struct PortIdentity source;
+	/* Accepted domainNumber, or -1 for any domain. */
+	int domain;
+	/* Accepted transportSpecific (upper nibble), or -1 for any. */
+	int transport_specific;
+};
+
+/**
+ * Installs a receive filter on the transport's descriptors, replacing
+ * any filter installed before.
+ * @param t	The transport.
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param f	The messages to accept.
+ * @return	Zero on success, or negative value in case of an error.
+ *		Transports without filtering support return zero.
+ */
+int transport_set_filter(struct transport *t, struct fdarray *fda,
+			 struct transport_filter *f);
+
 /**
  * Fetches the transmit time stamp for a PTP message that was sent
  * with the TRANS_DEFER_EVENT flag.
  *
+ * @param t	The transport.
  * @param fda	The array of descriptors filled in by transport_open.
  * @param msg	The message previously sent using transport_send(),
  *              transport_peer(), or transport_sendto().
  * @return	Zero on success, or negative value in case of an error.
  */
-int transport_txts(struct fdarray *fda,
+int transport_txts(struct transport *t, struct fdarray *fda,
 		   struct ptp_message *msg);
 
+/**
+ * Fetches the next queued transmit time stamp.
+ *
+ * This is used for messages sent with the TRANS_DEFER_EVENT flag
+ * whose time stamps are collected once the event socket signals
+ * that its error queue is readable, or after a batch of messages
+ * has been sent.
+ *
+ * @param t	The transport.
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param buf	Buffer to receive the looped back frame.
+ * @param buflen	Size of 'buf' in bytes.
+ * @param hwts	Receives the time stamp. The type field must be set.
+ * @param timeout	Milliseconds to wait for the time stamp, or zero to
+ *		return at once.
+ * @return	Number of bytes received, -EAGAIN if no time stamp is
+ *		queued, -ETIMEDOUT if none arrived in time, or another
+ *		negative value in case of an error.
+ */
+int transport_txts_next(struct transport *t, struct fdarray *fda, void *buf,
+			int buflen, struct hw_timestamp *hwts, int timeout);
+
+/**
+ * Tells whether transmit time stamps were collected together with the
+ * received messages. This happens when the transport runs on an
+ * io_uring, whose descriptor signals both, instead of the error queue
+ * of the event socket.
+ *
+ * @param t	The transport.
+ * @return	Non-zero if transport_txts_next() has a time stamp ready.
+ */
+int transport_txts_pending(struct transport *t);
+
 /**
  * Returns the transport's type.
  */
@@ -21,14 +21,20 @@
 #define HAVE_TRANSPORT_PRIVATE_H
 
 #include <time.h>
+#include <linux/filter.h>
 
 #include "address.h"
 #include "fd.h"
 #include "transport.h"
+#include "uring.h"
 
 struct transport {
 	enum transport_type type;
 	struct config *cfg;
+	struct uring *ring;
+	struct fdarray sk;
+	/* Set while batches may be received into lent messages. */
+	int lends;
 
 	int (*close)(struct transport *t, struct fdarray *fda);
 
@@ -38,10 +44,29 @@ struct transport {
 	int (*recv)(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	/*
+	 * Receives into the buffers of the messages in 'msg'. A backend
+	 * receiving into messages lent from the pool may replace entries
+	 * of 'msg' by the messages it received into, together with the
+	 * corresponding 'buf', 'addr' and 'hwts' entries, and keeps the
+	 * messages it replaced. The offset of each buffer from the start
+	 * of its message is preserved.
+	 */
+	int (*recv_batch)(struct transport *t, int fd, struct ptp_message **msg,
+			  void **buf, int *len, struct address **addr,
+			  struct hw_timestamp **hwts, int n);
+
 	int (*send)(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	int (*send_batch)(struct transport *t, struct fdarray *fda,
+			  enum transport_event event, void **buf, int *len,
+			  struct address **addr, int n);
+
+	int (*set_filter)(struct transport *t, struct fdarray *fda,
+			  struct transport_filter *f);
+
 	void (*release)(struct transport *t);
 
 	int (*physical_addr)(struct transport *t, uint8_t *addr);
@@ -49,4 +74,59 @@ struct transport {
 	int (*protocol_addr)(struct transport *t, uint8_t *addr);
 };
 
+/**
+ * Builds a classic BPF program implementing a receive filter and
+ * attaches it to the event and general descriptors. Event messages
+ * are only accepted on FD_EVENT and general messages on FD_GENERAL.
+ * Descriptors set to -1 are skipped.
+ *
+ * @param fda	The descriptors to filter.
+ * @param pre	Instructions which locate the PTP header. They either
+ *		return, or fall through with the header offset in X.
+ * @param n	Number of instructions in 'pre'.
+ * @param f	The messages to accept.
+ * @return	Zero on success, or negative value in case of an error.
+ */
+int transport_attach_filter(struct fdarray *fda, const struct sock_filter *pre,
+			    int n, struct transport_filter *f);
+
+/**
+ * Moves the socket I/O of an opened transport to an io_uring, if the
+ * io_uring option of the interface asks for it. The descriptors in
+ * 'fda' are replaced by the one signaling completions, while the
+ * backend keeps seeing its sockets in the descriptor array passed to
+ * the send and filter methods. Falls back to the plain sockets on
+ * failure.
+ *
+ * @param t	The transport.
+ * @param name	The name of the interface.
+ * @param lead	The length of the headers the sockets deliver in front
+ *		of the PTP message.
+ * @param fda	The descriptors filled in by the open method.
+ */
+void transport_uring_open(struct transport *t, const char *name, int lead,
+			  struct fdarray *fda);
+
+/**
+ * Wrappers of sk_receive(), sk_receive_batch() and sk_sendmmsg() for
+ * use by the backends, which go through the io_uring when one is
+ * active. The single send returns like SENDTO(2). The batch receive
+ * takes the messages owning the buffers, or NULL, and may replace them
+ * as described for the recv_batch method.
+ */
+int transport_sk_receive(struct transport *t, int fd, void *buf, int buflen,
+			 struct address *addr, struct hw_timestamp *hwts,
+			 int flags);
+
+int transport_sk_receive_batch(struct transport *t, int fd,
+			       struct ptp_message **msg, void **buf, int *len,
+			       struct address **addr,
+			       struct hw_timestamp **hwts, int n);
+
+int transport_sk_sendmmsg(struct transport *t, int fd, struct mmsghdr *mmsg,
+			  int n);
+
+int transport_sk_sendto(struct transport *t, int fd, void *buf, int len,
+			struct sockaddr *sa, socklen_t salen);
+
 #endif
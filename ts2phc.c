@@ -146,6 +146,11 @@ int main(int argc, char *argv[])
 	print_set_verbose(config_get_int(cfg, NULL, "verbose"));
 	print_set_syslog(config_get_int(cfg, NULL, "use_syslog"));
 	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+	if (print_set_async(config_get_int(cfg, NULL, "logging_ring_size"))) {
+		fprintf(stderr, "failed to start the logging thread\n");
+		ts2phc_cleanup(cfg, master);
+		return -1;
+	}
 
 	STAILQ_FOREACH(iface, &cfg->interfaces, list) {
 		if (1 == config_get_int(cfg, interface_name(iface), "ts2phc.master")) {
@@ -27,6 +27,13 @@
 #define MAX_RMC_AGE	5000000000ULL
 #define NMEA_TMO	2000 /*milliseconds*/
 
+struct nmea_snapshot {
+	struct timespec local_monotime;
+	struct timespec local_utctime;
+	struct timespec rmc_utctime;
+	bool rmc_fix_valid;
+};
+
 struct ts2phc_nmea_master {
 	struct ts2phc_master master;
 	struct config *config;
@@ -34,16 +41,48 @@ struct ts2phc_nmea_master {
 	time_t lsfile_mtime;
 	struct lstab *lstab;
 	pthread_t worker;
-	/* Protects anonymous struct fields, below, from concurrent access. */
-	pthread_mutex_t mutex;
-	struct {
-		struct timespec local_monotime;
-		struct timespec local_utctime;
-		struct timespec rmc_utctime;
-		bool rmc_fix_valid;
-	};
+	/*
+	 * The worker publishes the snapshot under a sequence count, which
+	 * is odd while an update is in progress. The reader retries until
+	 * it sees the same even count before and after copying, so that
+	 * the PPS path never waits for the worker.
+	 */
+	unsigned int seq;
+	struct nmea_snapshot snapshot;
+	unsigned long retries;
 };
 
+static void nmea_snapshot_write(struct ts2phc_nmea_master *m,
+				const struct nmea_snapshot *s)
+{
+	unsigned int seq = __atomic_load_n(&m->seq, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&m->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	m->snapshot = *s;
+	__atomic_store_n(&m->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Returns the number of times the copy had to be retried. */
+static int nmea_snapshot_read(struct ts2phc_nmea_master *m,
+			      struct nmea_snapshot *s)
+{
+	unsigned int seq;
+	int retries = 0;
+
+	while (1) {
+		seq = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1)) {
+			*s = m->snapshot;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (seq == __atomic_load_n(&m->seq, __ATOMIC_RELAXED))
+				break;
+		}
+		retries++;
+	}
+	return retries;
+}
+
 static int open_nmea_connection(const char *host, const char *port,
 				const char *serialport)
 {
@@ -70,6 +109,7 @@ static void *monitor_nmea_status(void *arg)
 	char *host, input[256], *port, *ptr, *uart;
 	struct ts2phc_nmea_master *master = arg;
 	struct timespec rxtime, tmo = { 2, 0 };
+	struct nmea_snapshot snapshot;
 	int cnt, num, parsed;
 	struct nmea_rmc rmc;
 	struct timex ntx;
@@ -124,13 +164,12 @@ static void *monitor_nmea_status(void *arg)
 		ptr = input;
 		do {
 			if (!nmea_parse(np, ptr, cnt, &rmc, &parsed)) {
-				pthread_mutex_lock(&master->mutex);
-				master->local_monotime = rxtime;
-				master->local_utctime.tv_sec = ntx.time.tv_sec;
-				master->local_utctime.tv_nsec = ntx.time.tv_usec;
-				master->rmc_utctime = rmc.ts;
-				master->rmc_fix_valid = rmc.fix_valid;
-				pthread_mutex_unlock(&master->mutex);
+				snapshot.local_monotime = rxtime;
+				snapshot.local_utctime.tv_sec = ntx.time.tv_sec;
+				snapshot.local_utctime.tv_nsec = ntx.time.tv_usec;
+				snapshot.rmc_utctime = rmc.ts;
+				snapshot.rmc_fix_valid = rmc.fix_valid;
+				nmea_snapshot_write(master, &snapshot);
 			}
 			cnt -= parsed;
 			ptr += parsed;
@@ -177,7 +216,6 @@ static void ts2phc_nmea_master_destroy(struct ts2phc_master *master)
 	struct ts2phc_nmea_master *m =
 		container_of(master, struct ts2phc_nmea_master, master);
 	pthread_join(m->worker, NULL);
-	pthread_mutex_destroy(&m->mutex);
 	lstab_destroy(m->lstab);
 	free(m);
 }
@@ -188,25 +226,27 @@ static int ts2phc_nmea_master_getppstime(struct ts2phc_master *master,
 	struct ts2phc_nmea_master *m =
 		container_of(master, struct ts2phc_nmea_master, master);
 	tmv_t delay_t1, delay_t2, duration_since_rmc, local_t1, local_t2, rmc;
-	int lstab_error = 0, tai_offset = 0;
+	int lstab_error = 0, retries, tai_offset = 0;
+	struct nmea_snapshot snapshot;
 	enum lstab_result result;
 	struct timespec now;
 	int64_t utc_time;
-	bool fix_valid;
 
 	clock_gettime(CLOCK_MONOTONIC, &now);
 	local_t2 = timespec_to_tmv(now);
 
-	pthread_mutex_lock(&m->mutex);
-
-	local_t1 = timespec_to_tmv(m->local_monotime);
-	delay_t2 = timespec_to_tmv(m->local_utctime);
-	rmc = timespec_to_tmv(m->rmc_utctime);
-	fix_valid = m->rmc_fix_valid;
+	retries = nmea_snapshot_read(m, &snapshot);
+	if (retries) {
+		m->retries += retries;
+		pr_debug("nmea: snapshot read retried %d times, %lu in total",
+			 retries, m->retries);
+	}
 
-	pthread_mutex_unlock(&m->mutex);
+	local_t1 = timespec_to_tmv(snapshot.local_monotime);
+	delay_t2 = timespec_to_tmv(snapshot.local_utctime);
+	rmc = timespec_to_tmv(snapshot.rmc_utctime);
 
-	if (!fix_valid) {
+	if (!snapshot.rmc_fix_valid) {
 		pr_debug("nmea: no valid rmc fix");
 		return -1;
 	}
@@ -277,7 +317,6 @@ struct ts2phc_master *ts2phc_nmea_master_create(struct config *cfg, const char *
 	master->master.destroy = ts2phc_nmea_master_destroy;
 	master->master.getppstime = ts2phc_nmea_master_getppstime;
 	master->config = cfg;
-	pthread_mutex_init(&master->mutex, NULL);
 	err = pthread_create(&master->worker, NULL, monitor_nmea_status, master);
 	if (err) {
 		pr_err("failed to create worker thread: %s", strerror(err));
@@ -83,6 +83,17 @@ static int mcast_join(int fd, int index, const struct sockaddr_in *sa)
 	return 0;
 }
 
+/* Socket filters see the datagram starting with the UDP header. */
+static const struct sock_filter udp_prefix[] = {
+	{BPF_LDX | BPF_W | BPF_IMM, 0, 0, 8},
+};
+
+static int udp_set_filter(struct transport *t, struct fdarray *fda,
+			 struct transport_filter *f)
+{
+	return transport_attach_filter(fda, udp_prefix, 1, f);
+}
+
 static int udp_close(struct transport *t, struct fdarray *fda)
 {
 	close(fda->fd[0]);
@@ -199,6 +210,7 @@ static int udp_open(struct transport *t, struct interface *iface,
 
 	fda->fd[FD_EVENT] = efd;
 	fda->fd[FD_GENERAL] = gfd;
+	transport_uring_open(t, name, 0, fda);
 	return 0;
 
 no_timestamping:
@@ -212,7 +224,17 @@ no_event:
 static int udp_recv(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts)
 {
-	return sk_receive(fd, buf, buflen, addr, hwts, MSG_DONTWAIT);
+	return transport_sk_receive(t, fd, buf, buflen, addr, hwts,
+				    MSG_DONTWAIT);
+}
+
+static int udp_recv_batch(struct transport *t, int fd,
+			  struct ptp_message **msg, void **buf, int *len,
+			  struct address **addr, struct hw_timestamp **hwts,
+			  int n)
+{
+	return transport_sk_receive_batch(t, fd, msg, buf, len, addr, hwts,
+					  n);
 }
 
 static int udp_send(struct transport *t, struct fdarray *fda,
@@ -255,7 +277,7 @@ static int udp_send(struct transport *t, struct fdarray *fda,
 	if (event == TRANS_ONESTEP)
 		len += 2;
 
-	cnt = sendto(fd, buf, len, 0, &addr->sa, sizeof(addr->sin));
+	cnt = transport_sk_sendto(t, fd, buf, len, &addr->sa, sizeof(addr->sin));
 	if (cnt < 1) {
 		pr_err("sendto failed: %m");
 		return -errno;
@@ -263,7 +285,40 @@ static int udp_send(struct transport *t, struct fdarray *fda,
 	/*
 	 * Get the time stamp right away.
 	 */
-	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
+	return event == TRANS_EVENT ?
+		transport_sk_receive(t, fd, junk, len, NULL, hwts, MSG_ERRQUEUE) :
+		cnt;
+}
+
+static int udp_send_batch(struct transport *t, struct fdarray *fda,
+			  enum transport_event event, void **buf, int *len,
+			  struct address **addr, int n)
+{
+	struct mmsghdr mmsg[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	struct address mcast;
+	int i, fd;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	memset(&mcast, 0, sizeof(mcast));
+	mcast.sin.sin_family = AF_INET;
+	mcast.sin.sin_addr = mcast_addr[MC_PRIMARY];
+	mcast.len = sizeof(mcast.sin);
+
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+	for (i = 0; i < n; i++) {
+		struct address *a = addr[i] ? addr[i] : &mcast;
+
+		a->sin.sin_port = htons(event ? EVENT_PORT : GENERAL_PORT);
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = event == TRANS_ONESTEP ? len[i] + 2 : len[i];
+		mmsg[i].msg_hdr.msg_name = &a->sa;
+		mmsg[i].msg_hdr.msg_namelen = sizeof(a->sin);
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+	return transport_sk_sendmmsg(t, fd, mmsg, n);
 }
 
 static void udp_release(struct transport *t)
@@ -304,7 +359,10 @@ struct transport *udp_transport_create(void)
 	udp->t.close = udp_close;
 	udp->t.open  = udp_open;
 	udp->t.recv  = udp_recv;
+	udp->t.recv_batch = udp_recv_batch;
 	udp->t.send  = udp_send;
+	udp->t.send_batch = udp_send_batch;
+	udp->t.set_filter = udp_set_filter;
 	udp->t.release = udp_release;
 	udp->t.physical_addr = udp_physical_addr;
 	udp->t.protocol_addr = udp_protocol_addr;
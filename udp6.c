@@ -94,6 +94,17 @@ static int mc_join(int fd, int index, const struct sockaddr_in6 *sa)
 	return 0;
 }
 
+/* Socket filters see the datagram starting with the UDP header. */
+static const struct sock_filter udp6_prefix[] = {
+	{BPF_LDX | BPF_W | BPF_IMM, 0, 0, 8},
+};
+
+static int udp6_set_filter(struct transport *t, struct fdarray *fda,
+			  struct transport_filter *f)
+{
+	return transport_attach_filter(fda, udp6_prefix, 1, f);
+}
+
 static int udp6_close(struct transport *t, struct fdarray *fda)
 {
 	close(fda->fd[0]);
@@ -216,6 +227,7 @@ static int udp6_open(struct transport *t, struct interface *iface,
 
 	fda->fd[FD_EVENT] = efd;
 	fda->fd[FD_GENERAL] = gfd;
+	transport_uring_open(t, name, 0, fda);
 	return 0;
 
 no_timestamping:
@@ -229,7 +241,17 @@ no_event:
 static int udp6_recv(struct transport *t, int fd, void *buf, int buflen,
 		     struct address *addr, struct hw_timestamp *hwts)
 {
-	return sk_receive(fd, buf, buflen, addr, hwts, MSG_DONTWAIT);
+	return transport_sk_receive(t, fd, buf, buflen, addr, hwts,
+				    MSG_DONTWAIT);
+}
+
+static int udp6_recv_batch(struct transport *t, int fd,
+			   struct ptp_message **msg, void **buf, int *len,
+			   struct address **addr, struct hw_timestamp **hwts,
+			   int n)
+{
+	return transport_sk_receive_batch(t, fd, msg, buf, len, addr, hwts,
+					  n);
 }
 
 static int udp6_send(struct transport *t, struct fdarray *fda,
@@ -270,7 +292,7 @@ static int udp6_send(struct transport *t, struct fdarray *fda,
 
 	len += 2; /* Extend the payload by two, for UDP checksum corrections. */
 
-	cnt = sendto(fd, buf, len, 0, &addr->sa, sizeof(addr->sin6));
+	cnt = transport_sk_sendto(t, fd, buf, len, &addr->sa, sizeof(addr->sin6));
 	if (cnt < 1) {
 		pr_err("sendto failed: %m");
 		return -errno;
@@ -278,7 +300,44 @@ static int udp6_send(struct transport *t, struct fdarray *fda,
 	/*
 	 * Get the time stamp right away.
 	 */
-	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
+	return event == TRANS_EVENT ?
+		transport_sk_receive(t, fd, junk, len, NULL, hwts, MSG_ERRQUEUE) :
+		cnt;
+}
+
+static int udp6_send_batch(struct transport *t, struct fdarray *fda,
+			   enum transport_event event, void **buf, int *len,
+			   struct address **addr, int n)
+{
+	struct udp6 *udp6 = container_of(t, struct udp6, t);
+	struct mmsghdr mmsg[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	struct address mcast;
+	int i, fd;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	memset(&mcast, 0, sizeof(mcast));
+	mcast.sin6.sin6_family = AF_INET6;
+	mcast.sin6.sin6_addr = udp6->mc6_addr[MC_PRIMARY];
+	if (is_link_local(&mcast.sin6.sin6_addr))
+		mcast.sin6.sin6_scope_id = udp6->index;
+	mcast.len = sizeof(mcast.sin6);
+
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+	for (i = 0; i < n; i++) {
+		struct address *a = addr[i] ? addr[i] : &mcast;
+
+		a->sin6.sin6_port = htons(event ? EVENT_PORT : GENERAL_PORT);
+		/* Extend the payload by two, for UDP checksum corrections. */
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = len[i] + 2;
+		mmsg[i].msg_hdr.msg_name = &a->sa;
+		mmsg[i].msg_hdr.msg_namelen = sizeof(a->sin6);
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+	return transport_sk_sendmmsg(t, fd, mmsg, n);
 }
 
 static void udp6_release(struct transport *t)
@@ -320,7 +379,10 @@ struct transport *udp6_transport_create(void)
 	udp6->t.close   = udp6_close;
 	udp6->t.open    = udp6_open;
 	udp6->t.recv    = udp6_recv;
+	udp6->t.recv_batch = udp6_recv_batch;
 	udp6->t.send    = udp6_send;
+	udp6->t.send_batch = udp6_send_batch;
+	udp6->t.set_filter = udp6_set_filter;
 	udp6->t.release = udp6_release;
 	udp6->t.physical_addr = udp6_physical_addr;
 	udp6->t.protocol_addr = udp6_protocol_addr;
@@ -28,6 +28,7 @@
 #include "address.h"
 #include "contain.h"
 #include "print.h"
+#include "sk.h"
 #include "transport_private.h"
 #include "uds.h"
 
@@ -125,6 +126,29 @@ static int uds_send(struct transport *t, struct fdarray *fda,
 	return cnt;
 }
 
+static int uds_send_batch(struct transport *t, struct fdarray *fda,
+			  enum transport_event event, void **buf, int *len,
+			  struct address **addr, int n)
+{
+	struct uds *uds = container_of(t, struct uds, t);
+	struct mmsghdr mmsg[TRANSPORT_BATCH_MAX];
+	struct iovec iov[TRANSPORT_BATCH_MAX];
+	int i;
+
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+	for (i = 0; i < n; i++) {
+		struct address *a = addr[i] ? addr[i] : &uds->address;
+
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = len[i];
+		mmsg[i].msg_hdr.msg_name = &a->sa;
+		mmsg[i].msg_hdr.msg_namelen = a->len;
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+	return sk_sendmmsg(fda->fd[FD_GENERAL], mmsg, n);
+}
+
 static void uds_release(struct transport *t)
 {
 	struct uds *uds = container_of(t, struct uds, t);
@@ -141,6 +165,7 @@ struct transport *uds_transport_create(void)
 	uds->t.open    = uds_open;
 	uds->t.recv    = uds_recv;
 	uds->t.send    = uds_send;
+	uds->t.send_batch = uds_send_batch;
 	uds->t.release = uds_release;
 	return &uds->t;
 }
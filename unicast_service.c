@@ -28,13 +28,17 @@
 #include "port_private.h"
 #include "pqueue.h"
 #include "print.h"
+#include "stats.h"
 #include "unicast_service.h"
 #include "util.h"
 
 #define QUEUE_LEN 16
+#define CLIENT_INDEX_SIZE 256
 
 struct unicast_client_address {
 	LIST_ENTRY(unicast_client_address) list;
+	LIST_ENTRY(unicast_client_address) index;
+	struct unicast_service_interval *interval;
 	struct PortIdentity portIdentity;
 	unsigned int message_types;
 	struct address addr;
@@ -51,7 +55,18 @@ struct unicast_service_interval {
 
 struct unicast_service {
 	LIST_HEAD(usi, unicast_service_interval) intervals;
+	/* clients of all intervals, hashed by transport address */
+	LIST_HEAD(uci, unicast_client_address) index[CLIENT_INDEX_SIZE];
 	struct pqueue *queue;
+	/* transmit batch statistics */
+	struct stats *batch_size;
+	struct stats *batch_latency;
+	/* number of granted message types over all clients */
+	unsigned int grants;
+	/* time spent processing grant requests */
+	struct stats *grant_latency;
+	time_t stats_tmo;
+	int stats_interval;
 };
 
 static struct timespec log_to_timespec(int log_seconds);
@@ -80,6 +95,37 @@ static int attach_grant(struct ptp_message *msg,
 	return 0;
 }
 
+static struct uci *client_bucket(struct port *p, struct address *addr)
+{
+	unsigned int h = addrhash(transport_type(p->trp), addr);
+
+	return &p->unicast_service->index[h % CLIENT_INDEX_SIZE];
+}
+
+static void client_free(struct unicast_service *us,
+			struct unicast_client_address *client)
+{
+	us->grants -= __builtin_popcount(client->message_types);
+	LIST_REMOVE(client, list);
+	LIST_REMOVE(client, index);
+	free(client);
+}
+
+/* Ends the service of the given message types, freeing idle clients. */
+static void client_clear(struct unicast_service *us,
+			 struct unicast_client_address *client,
+			 unsigned int mask)
+{
+	if (!(client->message_types & mask)) {
+		return;
+	}
+	client->message_types &= ~mask;
+	us->grants--;
+	if (!client->message_types) {
+		client_free(us, client);
+	}
+}
+
 static int compare_timeout(void *ain, void *bin)
 {
 	struct unicast_service_interval *a, *b;
@@ -157,18 +203,69 @@ static void timespec_normalize(struct timespec *ts)
 	}
 }
 
+static void unicast_service_batch_stats(struct unicast_service *us,
+					struct timespec *start, int n)
+{
+	struct timespec end;
+	int64_t ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = (end.tv_sec - start->tv_sec) * NS_PER_SEC +
+		end.tv_nsec - start->tv_nsec;
+	stats_add_value(us->batch_size, n);
+	stats_add_value(us->batch_latency, ns);
+	*start = end;
+}
+
+static void unicast_service_report(struct port *p)
+{
+	struct unicast_service *us = p->unicast_service;
+	struct stats_result size, latency, grant;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec < us->stats_tmo) {
+		return;
+	}
+	us->stats_tmo = now.tv_sec + us->stats_interval;
+
+	if (!stats_get_result(us->grant_latency, &grant)) {
+		pr_info("port %hu: unicast grants %u requests %u "
+			"processing %9.0f +/- %7.0f max %9.0f ns", portnum(p),
+			us->grants, stats_get_num_values(us->grant_latency),
+			grant.mean, grant.stddev, grant.max);
+		stats_reset(us->grant_latency);
+	}
+	if (stats_get_result(us->batch_size, &size) ||
+	    stats_get_result(us->batch_latency, &latency)) {
+		return;
+	}
+	pr_info("port %hu: unicast batches %u size %5.1f max %3.0f "
+		"latency %9.0f +/- %7.0f max %9.0f ns", portnum(p),
+		stats_get_num_values(us->batch_size), size.mean, size.max,
+		latency.mean, latency.stddev, latency.max);
+	stats_reset(us->batch_size);
+	stats_reset(us->batch_latency);
+}
+
+/*
+ * Sends the messages for one interval in batches, first all of the
+ * Announce messages, and then all of the Sync messages.
+ */
 static int unicast_service_clients(struct port *p,
 				   struct unicast_service_interval *interval)
 {
+	struct address *ann[TRANSPORT_BATCH_MAX], *syn[TRANSPORT_BATCH_MAX];
 	struct unicast_client_address *client, *next;
-	struct timespec now;
-	int err = 0;
+	int err = 0, nann = 0, nsyn = 0;
+	struct timespec now, start;
 
 	err = clock_gettime(CLOCK_MONOTONIC, &now);
 	if (err) {
 		pr_err("clock_gettime failed: %m");
 		return err;
 	}
+	start = now;
 	LIST_FOREACH_SAFE(client, &interval->clients, list, next) {
 		pr_debug("%s wants 0x%x", pid2str(&client->portIdentity),
 			 client->message_types);
@@ -176,20 +273,43 @@ static int unicast_service_clients(struct port *p,
 			pr_debug("%s service of 0x%x expired",
 				 pid2str(&client->portIdentity),
 				 client->message_types);
-			LIST_REMOVE(client, list);
-			free(client);
+			client_free(p->unicast_service, client);
 			continue;
 		}
 		if (client->message_types & (1 << ANNOUNCE)) {
-			if (port_tx_announce(p, &client->addr)) {
+			ann[nann++] = &client->addr;
+		}
+		if (client->message_types & (1 << SYNC)) {
+			syn[nsyn++] = &client->addr;
+		}
+		if (nann == TRANSPORT_BATCH_MAX) {
+			if (port_tx_announce_batch(p, ann, nann)) {
 				err = -1;
 			}
+			unicast_service_batch_stats(p->unicast_service,
+						    &start, nann);
+			nann = 0;
 		}
-		if (client->message_types & (1 << SYNC)) {
-			if (port_tx_sync(p, &client->addr)) {
+		if (nsyn == TRANSPORT_BATCH_MAX) {
+			if (port_tx_sync_batch(p, syn, nsyn)) {
 				err = -1;
 			}
+			unicast_service_batch_stats(p->unicast_service,
+						    &start, nsyn);
+			nsyn = 0;
+		}
+	}
+	if (nann) {
+		if (port_tx_announce_batch(p, ann, nann)) {
+			err = -1;
 		}
+		unicast_service_batch_stats(p->unicast_service, &start, nann);
+	}
+	if (nsyn) {
+		if (port_tx_sync_batch(p, syn, nsyn)) {
+			err = -1;
+		}
+		unicast_service_batch_stats(p->unicast_service, &start, nsyn);
 	}
 	return err;
 }
@@ -218,20 +338,18 @@ static void unicast_service_extend(struct unicast_client_address *client,
 static int unicast_service_rearm_timer(struct port *p)
 {
 	struct unicast_service_interval *interval;
-	struct itimerspec tmo;
-	int fd;
+	struct wheel_timer *t;
 
-	fd = p->fda.fd[FD_UNICAST_SRV_TIMER];
-	memset(&tmo, 0, sizeof(tmo));
+	t = p->timer[FD_UNICAST_SRV_TIMER];
 	interval = pqueue_peek(p->unicast_service->queue);
 	if (interval) {
-		tmo.it_value = interval->tmo;
 		pr_debug("arming timer tmo={%lld,%ld}",
 			 (long long)interval->tmo.tv_sec, interval->tmo.tv_nsec);
-	} else {
-		pr_debug("stopping unicast service timer");
+		return wheel_timer_set_abs(t, &interval->tmo);
 	}
-	return timerfd_settime(fd, TFD_TIMER_ABSTIME, &tmo, NULL);
+	pr_debug("stopping unicast service timer");
+	wheel_timer_clear(t);
+	return 0;
 }
 
 static int unicast_service_reply(struct port *p, struct ptp_message *dst,
@@ -259,21 +377,16 @@ out:
 	return err;
 }
 
-/* public methods */
-
-int unicast_service_add(struct port *p, struct ptp_message *m,
-			struct tlv_extra *extra)
+static int unicast_service_register(struct port *p, struct ptp_message *m,
+				    struct tlv_extra *extra)
 {
-	struct unicast_client_address *client = NULL, *ctmp, *next;
 	struct unicast_service_interval *interval = NULL, *itmp;
+	struct unicast_client_address *client = NULL, *ctmp, *next;
+	struct unicast_service *us = p->unicast_service;
 	struct request_unicast_xmit_tlv *req;
 	unsigned int mask;
 	uint8_t mtype;
 
-	if (!p->unicast_service) {
-		return SERVICE_DISABLED;
-	}
-
 	req = (struct request_unicast_xmit_tlv *) extra->tlv;
 	mtype = req->message_type >> 4;
 	mask = 1 << mtype;
@@ -289,42 +402,40 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 		return SERVICE_DENIED;
 	}
 
-	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		/*
-		 * Remember the interval of interest.
-		 */
+	/*
+	 * Remember the interval of interest.
+	 */
+	LIST_FOREACH(itmp, &us->intervals, list) {
 		if (itmp->log_period == req->logInterMessagePeriod) {
 			interval = itmp;
+			break;
 		}
-		/*
-		 * Find any client records, and remove any stale contract.
-		 */
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (interval == itmp) {
-				if (ctmp->message_types & mask) {
-					/* Contract is unchanged. */
-					unicast_service_extend(ctmp, req);
-					return SERVICE_GRANTED;
-				}
-				/* This is the one to use. */
-				client = ctmp;
-				continue;
-			}
-			/* Clear any stale contracts. */
-			ctmp->message_types &= ~mask;
-			if (!ctmp->message_types) {
-				LIST_REMOVE(ctmp, list);
-				free(ctmp);
+	}
+
+	/*
+	 * Find any client records, and remove any stale contract.
+	 */
+	LIST_FOREACH_SAFE(ctmp, client_bucket(p, &m->address), index, next) {
+		if (!addreq(transport_type(p->trp), &ctmp->addr, &m->address)) {
+			continue;
+		}
+		if (ctmp->interval == interval) {
+			if (ctmp->message_types & mask) {
+				/* Contract is unchanged. */
+				unicast_service_extend(ctmp, req);
+				return SERVICE_GRANTED;
 			}
+			/* This is the one to use. */
+			client = ctmp;
+			continue;
 		}
+		/* Clear any stale contracts. */
+		client_clear(us, ctmp, mask);
 	}
 
 	if (client) {
 		client->message_types |= mask;
+		us->grants++;
 		unicast_service_extend(client, req);
 		return SERVICE_GRANTED;
 	}
@@ -345,8 +456,8 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 			return SERVICE_DENIED;
 		}
 		initialize_interval(interval, req->logInterMessagePeriod);
-		LIST_INSERT_HEAD(&p->unicast_service->intervals, interval, list);
-		if (pqueue_insert(p->unicast_service->queue, interval)) {
+		LIST_INSERT_HEAD(&us->intervals, interval, list);
+		if (pqueue_insert(us->queue, interval)) {
 			LIST_REMOVE(interval, list);
 			free(interval);
 			free(client);
@@ -354,10 +465,33 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 		}
 		unicast_service_rearm_timer(p);
 	}
+	client->interval = interval;
 	LIST_INSERT_HEAD(&interval->clients, client, list);
+	LIST_INSERT_HEAD(client_bucket(p, &client->addr), client, index);
+	us->grants++;
 	return SERVICE_GRANTED;
 }
 
+/* public methods */
+
+int unicast_service_add(struct port *p, struct ptp_message *m,
+			struct tlv_extra *extra)
+{
+	struct timespec start, end;
+	int result;
+
+	if (!p->unicast_service) {
+		return SERVICE_DISABLED;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	result = unicast_service_register(p, m, extra);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	stats_add_value(p->unicast_service->grant_latency,
+			(end.tv_sec - start.tv_sec) * NS_PER_SEC +
+			end.tv_nsec - start.tv_nsec);
+	return result;
+}
+
 void unicast_service_cleanup(struct port *p)
 {
 	struct unicast_service_interval *itmp, *inext;
@@ -375,6 +509,9 @@ void unicast_service_cleanup(struct port *p)
 		free(itmp);
 	}
 	pqueue_destroy(p->unicast_service->queue);
+	stats_destroy(p->unicast_service->batch_size);
+	stats_destroy(p->unicast_service->batch_latency);
+	stats_destroy(p->unicast_service->grant_latency);
 	free(p->unicast_service);
 }
 
@@ -399,6 +536,7 @@ int unicast_service_grant(struct port *p, struct ptp_message *m,
 int unicast_service_initialize(struct port *p)
 {
 	struct config *cfg = clock_config(p->clock);
+	int i, interval;
 
 	if (!config_get_int(cfg, p->name, "unicast_listen")) {
 		return 0;
@@ -411,24 +549,50 @@ int unicast_service_initialize(struct port *p)
 		return -1;
 	}
 	LIST_INIT(&p->unicast_service->intervals);
+	for (i = 0; i < CLIENT_INDEX_SIZE; i++) {
+		LIST_INIT(&p->unicast_service->index[i]);
+	}
 
 	p->unicast_service->queue = pqueue_create(QUEUE_LEN, compare_timeout);
 	if (!p->unicast_service->queue) {
-		free(p->unicast_service);
-		return -1;
+		goto no_queue;
+	}
+	p->unicast_service->batch_size = stats_create();
+	if (!p->unicast_service->batch_size) {
+		goto no_size;
 	}
+	p->unicast_service->batch_latency = stats_create();
+	if (!p->unicast_service->batch_latency) {
+		goto no_latency;
+	}
+	p->unicast_service->grant_latency = stats_create();
+	if (!p->unicast_service->grant_latency) {
+		goto no_grant;
+	}
+	interval = config_get_int(cfg, NULL, "summary_interval");
+	p->unicast_service->stats_interval = interval > 0 ? 1 << interval : 1;
 	p->inhibit_multicast_service =
 		config_get_int(cfg, p->name, "inhibit_multicast_service");
 
 	return 0;
+
+no_grant:
+	stats_destroy(p->unicast_service->batch_latency);
+no_latency:
+	stats_destroy(p->unicast_service->batch_size);
+no_size:
+	pqueue_destroy(p->unicast_service->queue);
+no_queue:
+	free(p->unicast_service);
+	p->unicast_service = NULL;
+	return -1;
 }
 
 void unicast_service_remove(struct port *p, struct ptp_message *m,
 			    struct tlv_extra *extra)
 {
-	struct unicast_client_address *ctmp, *next;
 	struct cancel_unicast_xmit_tlv *cancel;
-	struct unicast_service_interval *itmp;
+	struct unicast_client_address *ctmp;
 	unsigned int mask;
 	uint8_t mtype;
 
@@ -452,20 +616,13 @@ void unicast_service_remove(struct port *p, struct ptp_message *m,
 		return;
 	}
 
-	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (ctmp->message_types & mask) {
-				ctmp->message_types &= ~mask;
-				if (!ctmp->message_types) {
-					LIST_REMOVE(ctmp, list);
-					free(ctmp);
-				}
-				return;
-			}
+	LIST_FOREACH(ctmp, client_bucket(p, &m->address), index) {
+		if (!addreq(transport_type(p->trp), &ctmp->addr, &m->address)) {
+			continue;
+		}
+		if (ctmp->message_types & mask) {
+			client_clear(p->unicast_service, ctmp, mask);
+			return;
 		}
 	}
 }
@@ -524,6 +681,9 @@ int unicast_service_timer(struct port *p)
 		pqueue_insert(p->unicast_service->queue, interval);
 	}
 
+	if (master) {
+		unicast_service_report(p);
+	}
 	if (unicast_service_rearm_timer(p)) {
 		err = -1;
 	}
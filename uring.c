@@ -0,0 +1,1004 @@
+/**
+ * @file uring.c
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "print.h"
+#include "uring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fd.h"
+#include "sk.h"
+
+#define SQ_ENTRIES	128
+#define CQ_ENTRIES	1024
+#define SQ_IDLE_MS	1000
+
+#define NUM_BUFS	128 /* lent messages, a power of two */
+#define BUF_GROUP	0
+#define NAME_LEN	sizeof(struct sockaddr_storage)
+#define CTRL_LEN	256
+#define PAYLOAD_OFF	(sizeof(struct io_uring_recvmsg_out) + NAME_LEN + CTRL_LEN)
+#define DATA_LEN	sizeof(((struct ptp_message *) 0)->data)
+
+/* Receive requests failing this often in a row are not restarted. */
+#define RX_EINVAL_MAX	3
+
+#define NUM_SLOTS	64
+#define NUM_TXTS	16
+#define PKT_LEN		1600
+
+#define CANCEL_WAIT_MS	100
+#define CANCEL_TRIES	10
+
+/* The kind of request is kept in the upper half of the user data. */
+enum tag {
+	TAG_RX = 1,
+	TAG_TX,
+	TAG_TXTS,
+	TAG_CANCEL,
+};
+
+#define USER_DATA(tag, index)	((__u64) (tag) << 32 | (index))
+
+struct rx_entry {
+	int index;
+	int len;
+	uint16_t bid;
+};
+
+struct txts_entry {
+	int len;
+	size_t ctrl_len;
+	unsigned char pkt[PKT_LEN];
+	unsigned char ctrl[CTRL_LEN];
+};
+
+struct send_slot {
+	struct msghdr msg;
+	struct iovec iov;
+	struct sockaddr_storage name;
+	unsigned char data[PKT_LEN];
+};
+
+struct ring {
+	int fd;
+	int sqpoll;
+	void *map;
+	size_t map_len;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_flags;
+	unsigned int *sq_array;
+	unsigned int sq_entries;
+	unsigned int sqt;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+/*
+ * Only the receive ring signals the eventfd. The completions of the
+ * transmissions have their own ring, which is reaped when sending, so
+ * that they do not wake up the event loop.
+ */
+struct uring {
+	int efd;
+	int sk[2];
+	int closing;
+	struct ring rx_ring;
+	struct ring tx_ring;
+
+	/*
+	 * Messages lent to the kernel as the buffers of the multishot
+	 * receives, indexed by buffer ID. The kernel writes the header of
+	 * the completion, the name and the control data into the room in
+	 * front of the message, followed by 'lead' bytes of the frame
+	 * before the data field.
+	 */
+	struct io_uring_buf_ring *br;
+	size_t br_len;
+	struct ptp_message *lent[NUM_BUFS];
+	int lead;
+	uint16_t br_tail;
+	struct msghdr rx_msg;
+	struct sockaddr_storage rx_name;
+	unsigned char rx_ctrl[CTRL_LEN];
+	int rx_armed[2];
+	int rx_einval[2];
+	int rx_err;
+
+	/* Received messages not yet taken, each holding a buffer. */
+	struct rx_entry rx[NUM_BUFS];
+	unsigned int rx_head;
+	unsigned int rx_tail;
+
+	/* The request on the error queue and the collected time stamps. */
+	struct msghdr err_msg;
+	struct iovec err_iov;
+	unsigned char err_pkt[PKT_LEN];
+	unsigned char err_ctrl[CTRL_LEN];
+	int err_armed;
+	struct txts_entry txts[NUM_TXTS];
+	unsigned int txts_head;
+	unsigned int txts_tail;
+
+	struct send_slot slot[NUM_SLOTS];
+	int free_slot[NUM_SLOTS];
+	int nfree;
+	int tx_err;
+};
+
+static int sys_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		     unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		       NULL, 0);
+}
+
+static int sys_register(int fd, unsigned int opcode, void *arg,
+			unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static unsigned int rx_count(struct uring *u)
+{
+	return u->rx_tail - u->rx_head;
+}
+
+static unsigned int txts_count(struct uring *u)
+{
+	return u->txts_tail - u->txts_head;
+}
+
+static void eventfd_drain(struct uring *u)
+{
+	eventfd_t cnt;
+
+	eventfd_read(u->efd, &cnt);
+}
+
+/*
+ * Messages left behind by a partial read keep the descriptor readable
+ * for the next round of the event loop. Time stamps are not signaled
+ * again, as nobody might be waiting for them.
+ */
+static void eventfd_resignal(struct uring *u)
+{
+	if (rx_count(u)) {
+		eventfd_write(u->efd, 1);
+	}
+}
+
+static int submit(struct ring *r)
+{
+	unsigned int flags = 0, to_submit;
+	int err;
+
+	__atomic_store_n(r->sq_tail, r->sqt, __ATOMIC_RELEASE);
+
+	if (r->sqpoll) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (!(__atomic_load_n(r->sq_flags, __ATOMIC_RELAXED) &
+		      IORING_SQ_NEED_WAKEUP)) {
+			return 0;
+		}
+		to_submit = 0;
+		flags = IORING_ENTER_SQ_WAKEUP;
+	} else {
+		to_submit = r->sqt - __atomic_load_n(r->sq_head,
+						     __ATOMIC_ACQUIRE);
+		if (!to_submit) {
+			return 0;
+		}
+	}
+	err = sys_enter(r->fd, to_submit, 0, flags);
+	if (err < 0) {
+		pr_err("io_uring_enter failed: %m");
+		return -errno;
+	}
+	return 0;
+}
+
+static struct io_uring_sqe *get_sqe(struct ring *r)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head, index;
+
+	head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	if (r->sqt - head >= r->sq_entries) {
+		submit(r);
+		head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+		if (r->sqt - head >= r->sq_entries) {
+			return NULL;
+		}
+	}
+	index = r->sqt & *r->sq_mask;
+	sqe = &r->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_array[index] = index;
+	r->sqt++;
+	return sqe;
+}
+
+static unsigned char *buf_start(struct uring *u, struct ptp_message *m)
+{
+	return (unsigned char *) m - u->lead - PAYLOAD_OFF;
+}
+
+/* Lends a message to the kernel under a buffer ID. */
+static void buf_lend(struct uring *u, uint16_t bid, struct ptp_message *m)
+{
+	struct io_uring_buf *b;
+
+	b = &u->br->bufs[u->br_tail & (NUM_BUFS - 1)];
+	b->addr = (__u64) (uintptr_t) buf_start(u, m);
+	b->len = PAYLOAD_OFF + u->lead + DATA_LEN;
+	b->bid = bid;
+	u->lent[bid] = m;
+	u->br_tail++;
+}
+
+static void buf_publish(struct uring *u)
+{
+	__atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+static void arm_rx(struct uring *u, int index)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = get_sqe(&u->rx_ring);
+	if (!sqe) {
+		return;
+	}
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = u->sk[index];
+	sqe->addr = (__u64) (uintptr_t) &u->rx_msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BUF_GROUP;
+	sqe->user_data = USER_DATA(TAG_RX, index);
+	u->rx_armed[index] = 1;
+}
+
+static void arm_txts(struct uring *u)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = get_sqe(&u->rx_ring);
+	if (!sqe) {
+		return;
+	}
+	memset(u->err_ctrl, 0, sizeof(u->err_ctrl));
+	memset(&u->err_msg, 0, sizeof(u->err_msg));
+	u->err_iov.iov_base = u->err_pkt;
+	u->err_iov.iov_len = sizeof(u->err_pkt);
+	u->err_msg.msg_iov = &u->err_iov;
+	u->err_msg.msg_iovlen = 1;
+	u->err_msg.msg_control = u->err_ctrl;
+	u->err_msg.msg_controllen = sizeof(u->err_ctrl);
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = u->sk[FD_EVENT];
+	sqe->addr = (__u64) (uintptr_t) &u->err_msg;
+	sqe->len = 1;
+	sqe->msg_flags = MSG_ERRQUEUE;
+	sqe->user_data = USER_DATA(TAG_TXTS, 0);
+	u->err_armed = 1;
+}
+
+/*
+ * Restarts the receive requests which have ended, as long as there is
+ * room for what they would complete.
+ */
+static void arm(struct uring *u)
+{
+	int i;
+
+	if (u->closing) {
+		return;
+	}
+	for (i = 0; i < 2; i++) {
+		if (!u->rx_armed[i] && rx_count(u) < NUM_BUFS &&
+		    u->rx_einval[i] < RX_EINVAL_MAX) {
+			arm_rx(u, i);
+		}
+	}
+	if (!u->err_armed && txts_count(u) < NUM_TXTS) {
+		arm_txts(u);
+	}
+	submit(&u->rx_ring);
+}
+
+static void complete_rx(struct uring *u, int index, struct io_uring_cqe *cqe)
+{
+	struct rx_entry *e;
+
+	if (!(cqe->flags & IORING_CQE_F_MORE)) {
+		u->rx_armed[index] = 0;
+	}
+	if (cqe->res < 0) {
+		if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+			pr_err("io_uring: receive failed: %s",
+			       strerror(-cqe->res));
+		}
+		/*
+		 * A request the kernel rejects would otherwise be
+		 * restarted on every completion. Give up and let the
+		 * port see the error.
+		 */
+		if (cqe->res == -EINVAL &&
+		    ++u->rx_einval[index] == RX_EINVAL_MAX) {
+			pr_err("io_uring: not restarting the receive");
+			u->rx_err = cqe->res;
+		}
+		return;
+	}
+	u->rx_einval[index] = 0;
+	if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+		return;
+	}
+	e = &u->rx[u->rx_tail & (NUM_BUFS - 1)];
+	e->index = index;
+	e->len = cqe->res;
+	e->bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	u->rx_tail++;
+}
+
+static void complete_txts(struct uring *u, struct io_uring_cqe *cqe)
+{
+	struct txts_entry *e;
+
+	u->err_armed = 0;
+	if (cqe->res < 0) {
+		if (cqe->res != -ECANCELED) {
+			pr_err("io_uring: recvmsg tx timestamp failed: %s",
+			       strerror(-cqe->res));
+		}
+		return;
+	}
+	e = &u->txts[u->txts_tail & (NUM_TXTS - 1)];
+	e->len = cqe->res;
+	e->ctrl_len = u->err_msg.msg_controllen;
+	memcpy(e->pkt, u->err_pkt, e->len);
+	memcpy(e->ctrl, u->err_ctrl, sizeof(e->ctrl));
+	u->txts_tail++;
+}
+
+/*
+ * The sockets would have returned a failed send to the caller, so the
+ * first error is kept for the next call of uring_sendmmsg().
+ */
+static void complete_tx(struct uring *u, int index, struct io_uring_cqe *cqe)
+{
+	u->free_slot[u->nfree++] = index;
+	if (cqe->res < 0) {
+		pr_err("io_uring: send failed: %s", strerror(-cqe->res));
+		if (!u->tx_err) {
+			u->tx_err = cqe->res;
+		}
+	}
+}
+
+static void reap(struct uring *u, struct ring *r)
+{
+	unsigned int head, tail;
+	struct io_uring_cqe *cqe;
+	int index;
+
+	head = *r->cq_head;
+	tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		cqe = &r->cqes[head & *r->cq_mask];
+		index = cqe->user_data & 0xffffffff;
+		switch (cqe->user_data >> 32) {
+		case TAG_RX:
+			complete_rx(u, index, cqe);
+			break;
+		case TAG_TX:
+			complete_tx(u, index, cqe);
+			break;
+		case TAG_TXTS:
+			complete_txts(u, cqe);
+			break;
+		}
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static int ring_map(struct ring *r, struct io_uring_params *p)
+{
+	size_t sq_len, cq_len;
+	unsigned char *map;
+
+	sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+	cq_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	r->map_len = sq_len > cq_len ? sq_len : cq_len;
+	r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->map == MAP_FAILED) {
+		r->map = NULL;
+		return -1;
+	}
+	map = r->map;
+	r->sq_head = (unsigned int *) (map + p->sq_off.head);
+	r->sq_tail = (unsigned int *) (map + p->sq_off.tail);
+	r->sq_mask = (unsigned int *) (map + p->sq_off.ring_mask);
+	r->sq_flags = (unsigned int *) (map + p->sq_off.flags);
+	r->sq_array = (unsigned int *) (map + p->sq_off.array);
+	r->sq_entries = p->sq_entries;
+	r->sqt = *r->sq_tail;
+	r->cq_head = (unsigned int *) (map + p->cq_off.head);
+	r->cq_tail = (unsigned int *) (map + p->cq_off.tail);
+	r->cq_mask = (unsigned int *) (map + p->cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *) (map + p->cq_off.cqes);
+
+	r->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Sets up a ring. With SQPOLL, a ring given by 'wq_fd' shares its
+ * kernel thread with the new one.
+ */
+static int ring_setup(struct ring *r, unsigned int entries,
+		      unsigned int cq_entries, enum uring_mode mode, int wq_fd)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	if (cq_entries) {
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = cq_entries;
+	}
+	if (mode == URING_SQPOLL) {
+		p.flags |= IORING_SETUP_SQPOLL;
+		p.sq_thread_idle = SQ_IDLE_MS;
+		if (wq_fd >= 0) {
+			p.flags |= IORING_SETUP_ATTACH_WQ;
+			p.wq_fd = wq_fd;
+		}
+		r->sqpoll = 1;
+	}
+	r->fd = sys_setup(entries, &p);
+	if (r->fd < 0) {
+		pr_err("io_uring_setup failed: %m");
+		return -1;
+	}
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		pr_err("io_uring: kernel lacks single mmap support");
+		return -1;
+	}
+	if (ring_map(r, &p)) {
+		pr_err("io_uring: mmap failed: %m");
+		return -1;
+	}
+	return 0;
+}
+
+static void ring_destroy(struct ring *r)
+{
+	if (r->fd >= 0) {
+		close(r->fd);
+	}
+	if (r->sqes) {
+		munmap(r->sqes, r->sqes_len);
+	}
+	if (r->map) {
+		munmap(r->map, r->map_len);
+	}
+}
+
+/*
+ * The probe lists the supported opcodes, but not whether recvmsg takes
+ * IORING_RECV_MULTISHOT. That flag arrived in the release which added
+ * IORING_OP_SEND_ZC, so the latter stands in for it.
+ */
+static int ops_probe(struct uring *u)
+{
+	static const int ops[] = {
+		IORING_OP_RECVMSG,
+		IORING_OP_SENDMSG,
+		IORING_OP_ASYNC_CANCEL,
+		IORING_OP_SEND_ZC,
+	};
+	struct io_uring_probe *p;
+	unsigned int i;
+	size_t len;
+	int err = 0;
+
+	len = sizeof(*p) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+	p = calloc(1, len);
+	if (!p) {
+		return -1;
+	}
+	if (sys_register(u->rx_ring.fd, IORING_REGISTER_PROBE, p,
+			 IORING_OP_LAST)) {
+		pr_err("io_uring: probing the operations failed: %m");
+		free(p);
+		return -1;
+	}
+	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		if (ops[i] > p->last_op ||
+		    !(p->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+			err = -1;
+		}
+	}
+	if (err) {
+		pr_err("io_uring: kernel lacks multishot recvmsg support");
+	}
+	free(p);
+	return err;
+}
+
+/*
+ * Lends NUM_BUFS preallocated messages to the kernel. Their storage
+ * holds the completion header, the name and the control data in
+ * front of each message, which allows the received messages to be
+ * passed up without copying.
+ */
+static int buffers_register(struct uring *u)
+{
+	struct io_uring_buf_reg reg;
+	struct ptp_message *m;
+	int i;
+
+	if (PAYLOAD_OFF + u->lead > MSG_LEND_HEADROOM) {
+		return -1;
+	}
+	u->br_len = NUM_BUFS * sizeof(struct io_uring_buf);
+	u->br = mmap(NULL, u->br_len, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (u->br == MAP_FAILED) {
+		u->br = NULL;
+		return -1;
+	}
+	for (i = 0; i < NUM_BUFS; i++) {
+		m = msg_allocate();
+		if (m && !msg_lendable(m)) {
+			msg_put(m);
+			m = NULL;
+		}
+		if (!m) {
+			pr_err("io_uring: not enough preallocated messages, "
+			       "see msg_pool_size");
+			return -1;
+		}
+		u->lent[i] = m;
+	}
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (__u64) (uintptr_t) u->br;
+	reg.ring_entries = NUM_BUFS;
+	reg.bgid = BUF_GROUP;
+	if (sys_register(u->rx_ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1)) {
+		pr_err("io_uring: registering buffer ring failed: %m");
+		return -1;
+	}
+	for (i = 0; i < NUM_BUFS; i++) {
+		buf_lend(u, i, u->lent[i]);
+	}
+	buf_publish(u);
+
+	memset(&u->rx_msg, 0, sizeof(u->rx_msg));
+	u->rx_msg.msg_name = &u->rx_name;
+	u->rx_msg.msg_namelen = NAME_LEN;
+	u->rx_msg.msg_control = u->rx_ctrl;
+	u->rx_msg.msg_controllen = CTRL_LEN;
+	return 0;
+}
+
+static int cancel_submit(struct ring *r)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = get_sqe(r);
+	if (!sqe) {
+		return -1;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+	sqe->user_data = USER_DATA(TAG_CANCEL, 0);
+	return submit(r);
+}
+
+/*
+ * The kernel may still write into the buffers until the requests
+ * are gone, so wait for their final completions before freeing them.
+ * Returns non-zero if requests may remain.
+ */
+static int cancel(struct uring *u)
+{
+	struct pollfd pfd[2] = {
+		{ u->efd, POLLIN, 0 },
+		{ u->tx_ring.fd, POLLIN, 0 },
+	};
+	int i;
+
+	u->closing = 1;
+	if (cancel_submit(&u->rx_ring) || cancel_submit(&u->tx_ring)) {
+		return -1;
+	}
+	for (i = 0; i < CANCEL_TRIES; i++) {
+		eventfd_drain(u);
+		reap(u, &u->rx_ring);
+		reap(u, &u->tx_ring);
+		if (!u->rx_armed[0] && !u->rx_armed[1] && !u->err_armed &&
+		    u->nfree == NUM_SLOTS) {
+			return 0;
+		}
+		poll(pfd, 2, CANCEL_WAIT_MS);
+	}
+	pr_warning("io_uring: requests still pending at close");
+	return -1;
+}
+
+struct uring *uring_create(int efd, int gfd, int lead, enum uring_mode mode)
+{
+	struct uring *u;
+	int i;
+
+	u = calloc(1, sizeof(*u));
+	if (!u) {
+		return NULL;
+	}
+	u->rx_ring.fd = -1;
+	u->tx_ring.fd = -1;
+	u->efd = -1;
+	u->sk[FD_EVENT] = efd;
+	u->sk[FD_GENERAL] = gfd;
+	u->lead = lead;
+	for (i = 0; i < NUM_SLOTS; i++) {
+		u->free_slot[i] = i;
+	}
+	u->nfree = NUM_SLOTS;
+
+	if (ring_setup(&u->rx_ring, SQ_ENTRIES, CQ_ENTRIES, mode, -1) ||
+	    ring_setup(&u->tx_ring, NUM_SLOTS, 0, mode, u->rx_ring.fd) ||
+	    ops_probe(u)) {
+		goto failed;
+	}
+	u->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (u->efd < 0) {
+		pr_err("eventfd failed: %m");
+		goto failed;
+	}
+	if (sys_register(u->rx_ring.fd, IORING_REGISTER_EVENTFD, &u->efd, 1)) {
+		pr_err("io_uring: registering eventfd failed: %m");
+		goto failed;
+	}
+	if (buffers_register(u)) {
+		goto failed;
+	}
+	arm(u);
+	return u;
+failed:
+	uring_destroy(u);
+	return NULL;
+}
+
+void uring_destroy(struct uring *u)
+{
+	int i, pending = 0;
+
+	if (u->rx_ring.sqes && u->tx_ring.sqes) {
+		pending = cancel(u);
+	}
+	ring_destroy(&u->rx_ring);
+	ring_destroy(&u->tx_ring);
+	if (u->efd >= 0) {
+		close(u->efd);
+	}
+	if (u->br) {
+		munmap(u->br, u->br_len);
+	}
+	/* Messages the kernel might still write into are leaked. */
+	for (i = 0; i < NUM_BUFS && !pending; i++) {
+		if (u->lent[i]) {
+			msg_put(u->lent[i]);
+		}
+	}
+	free(u);
+}
+
+int uring_fd(struct uring *u)
+{
+	return u->efd;
+}
+
+/* Returns the pointer at the offset of 'p' from 'from' within 'to'. */
+static void *rebase(void *p, struct ptp_message *from, struct ptp_message *to)
+{
+	return (unsigned char *) to + ((unsigned char *) p -
+				       (unsigned char *) from);
+}
+
+int uring_recv(struct uring *u, struct ptp_message **msg, void **buf,
+	       int *len, struct address **addr, struct hw_timestamp **hwts,
+	       int n)
+{
+	struct ptp_message *lent, *m;
+	struct io_uring_recvmsg_out *out;
+	unsigned char *ptr, *name;
+	struct msghdr hdr;
+	struct rx_entry *e;
+	int cnt, err, i;
+	size_t namelen;
+
+	eventfd_drain(u);
+	reap(u, &u->rx_ring);
+	if (u->rx_err && !rx_count(u)) {
+		return u->rx_err;
+	}
+
+	for (i = 0; i < n && rx_count(u); ) {
+		e = &u->rx[u->rx_head & (NUM_BUFS - 1)];
+		u->rx_head++;
+		lent = u->lent[e->bid];
+		if (e->len < PAYLOAD_OFF) {
+			/* Truncated by the kernel, drop it. */
+			pr_debug("io_uring: dropping truncated message");
+			buf_lend(u, e->bid, lent);
+			continue;
+		}
+		m = msg ? msg[i] : NULL;
+		if (m && msg_lendable(m)) {
+			/* Pass up the message received into instead. */
+			lent->hwts.type = m->hwts.type;
+			buf[i] = rebase(buf[i], m, lent);
+			addr[i] = rebase(addr[i], m, lent);
+			hwts[i] = rebase(hwts[i], m, lent);
+			msg[i] = lent;
+		} else {
+			m = lent;
+		}
+		ptr = buf_start(u, lent);
+		out = (struct io_uring_recvmsg_out *) ptr;
+		name = ptr + sizeof(*out);
+
+		namelen = out->namelen < NAME_LEN ? out->namelen : NAME_LEN;
+		memcpy(&addr[i]->ss, name, namelen);
+		addr[i]->len = namelen;
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_control = name + NAME_LEN;
+		hdr.msg_controllen = out->controllen;
+		err = sk_timestamps(&hdr, hwts[i]);
+
+		cnt = e->len - PAYLOAD_OFF;
+		if (cnt > out->payloadlen) {
+			cnt = out->payloadlen;
+		}
+		if (cnt > len[i]) {
+			cnt = len[i];
+		}
+		/* Only now that the name and control data have been read. */
+		if (buf[i] != ptr + PAYLOAD_OFF) {
+			memmove(buf[i], ptr + PAYLOAD_OFF, cnt);
+		}
+		len[i] = err ? err : cnt;
+
+		buf_lend(u, e->bid, m);
+		i++;
+	}
+	buf_publish(u);
+	arm(u);
+	eventfd_resignal(u);
+	return i;
+}
+
+int uring_sendmmsg(struct uring *u, int fd, struct mmsghdr *mmsg, int n)
+{
+	struct io_uring_sqe *sqe;
+	struct send_slot *s;
+	struct msghdr *m;
+	int cnt, err = 0, ret;
+	size_t i, len;
+
+	reap(u, &u->tx_ring);
+	if (u->tx_err) {
+		err = u->tx_err;
+		u->tx_err = 0;
+		return err;
+	}
+
+	for (cnt = 0; cnt < n; cnt++) {
+		m = &mmsg[cnt].msg_hdr;
+		if (!u->nfree) {
+			submit(&u->tx_ring);
+			reap(u, &u->tx_ring);
+		}
+		if (!u->nfree) {
+			pr_err("io_uring: no free send slot");
+			break;
+		}
+		for (len = 0, i = 0; i < m->msg_iovlen; i++) {
+			len += m->msg_iov[i].iov_len;
+		}
+		if (len > PKT_LEN || m->msg_namelen > sizeof(s->name)) {
+			err = -EMSGSIZE;
+			break;
+		}
+		sqe = get_sqe(&u->tx_ring);
+		if (!sqe) {
+			pr_err("io_uring: submission queue full");
+			break;
+		}
+		s = &u->slot[u->free_slot[--u->nfree]];
+		for (len = 0, i = 0; i < m->msg_iovlen; i++) {
+			memcpy(s->data + len, m->msg_iov[i].iov_base,
+			       m->msg_iov[i].iov_len);
+			len += m->msg_iov[i].iov_len;
+		}
+		memset(&s->msg, 0, sizeof(s->msg));
+		s->iov.iov_base = s->data;
+		s->iov.iov_len = len;
+		s->msg.msg_iov = &s->iov;
+		s->msg.msg_iovlen = 1;
+		if (m->msg_name) {
+			memcpy(&s->name, m->msg_name, m->msg_namelen);
+			s->msg.msg_name = &s->name;
+			s->msg.msg_namelen = m->msg_namelen;
+		}
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd = fd;
+		sqe->addr = (__u64) (uintptr_t) &s->msg;
+		sqe->len = 1;
+		sqe->user_data = USER_DATA(TAG_TX, s - u->slot);
+	}
+	ret = submit(&u->tx_ring);
+	if (cnt) {
+		return cnt;
+	}
+	if (err) {
+		return err;
+	}
+	return ret ? ret : -EAGAIN;
+}
+
+int uring_txts(struct uring *u, void *buf, int buflen,
+	       struct hw_timestamp *hwts, int timeout)
+{
+	struct pollfd pfd = { u->efd, POLLIN, 0 };
+	struct timespec now, end;
+	struct txts_entry *e;
+	struct msghdr msg;
+	int cnt, err, ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += timeout / 1000;
+	end.tv_nsec += (timeout % 1000) * 1000000;
+	if (end.tv_nsec >= 1000000000) {
+		end.tv_sec++;
+		end.tv_nsec -= 1000000000;
+	}
+	for (;;) {
+		eventfd_drain(u);
+		reap(u, &u->rx_ring);
+		arm(u);
+		if (txts_count(u)) {
+			break;
+		}
+		if (!timeout) {
+			eventfd_resignal(u);
+			return -EAGAIN;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		ms = (end.tv_sec - now.tv_sec) * 1000 +
+			(end.tv_nsec - now.tv_nsec) / 1000000;
+		if (ms <= 0 || poll(&pfd, 1, ms) < 1) {
+			pr_err("timed out while polling for tx timestamp");
+			pr_err("increasing tx_timestamp_timeout may correct "
+			       "this issue, but it is likely caused by a driver bug");
+			eventfd_resignal(u);
+			return -ETIMEDOUT;
+		}
+	}
+
+	e = &u->txts[u->txts_head & (NUM_TXTS - 1)];
+	cnt = e->len < buflen ? e->len : buflen;
+	memcpy(buf, e->pkt, cnt);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = e->ctrl;
+	msg.msg_controllen = e->ctrl_len;
+	err = sk_timestamps(&msg, hwts);
+	u->txts_head++;
+
+	arm(u);
+	eventfd_resignal(u);
+	return err ? err : cnt;
+}
+
+int uring_txts_pending(struct uring *u)
+{
+	reap(u, &u->rx_ring);
+	return txts_count(u) > 0;
+}
+
+#else /* HAVE_IO_URING */
+
+struct uring *uring_create(int efd, int gfd, int lead, enum uring_mode mode)
+{
+	pr_err("io_uring: not supported by the kernel headers");
+	return NULL;
+}
+
+void uring_destroy(struct uring *u)
+{
+}
+
+int uring_fd(struct uring *u)
+{
+	return -1;
+}
+
+int uring_recv(struct uring *u, struct ptp_message **msg, void **buf,
+	       int *len, struct address **addr, struct hw_timestamp **hwts,
+	       int n)
+{
+	return -EOPNOTSUPP;
+}
+
+int uring_sendmmsg(struct uring *u, int fd, struct mmsghdr *mmsg, int n)
+{
+	return -EOPNOTSUPP;
+}
+
+int uring_txts(struct uring *u, void *buf, int buflen,
+	       struct hw_timestamp *hwts, int wait)
+{
+	return -EOPNOTSUPP;
+}
+
+int uring_txts_pending(struct uring *u)
+{
+	return 0;
+}
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,123 @@
+/**
+ * @file uring.h
+ * @brief Socket I/O of the network transports through an io_uring.
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_URING_H
+#define HAVE_URING_H
+
+#include <sys/socket.h>
+
+#include "address.h"
+#include "msg.h"
+
+/*
+ * Both sockets of a transport are served by one pair of rings. Multishot
+ * receive requests keep reading messages into preallocated messages lent
+ * to the kernel as provided buffers, a request on the error queue of the
+ * event socket collects the transmit time stamps, and transmitted
+ * messages are copied into send slots and queued on a ring of their own.
+ * An eventfd signals the completions of the receive requests, but not
+ * those of the sends.
+ */
+
+enum uring_mode {
+	URING_OFF,
+	URING_ON,
+	URING_SQPOLL,
+};
+
+struct uring;
+
+/**
+ * Creates a ring for the event and general sockets of a transport.
+ * Fails if the kernel lacks multishot receives, or if the pool cannot
+ * lend enough preallocated messages.
+ * @param efd   The event socket.
+ * @param gfd   The general socket.
+ * @param lead  The number of bytes the sockets deliver in front of the
+ *              PTP message, which are received in front of the data
+ *              field of the lent messages.
+ * @param mode  URING_ON to submit requests with a system call per
+ *              send, or URING_SQPOLL to let a kernel thread poll for
+ *              them.
+ * @return      A pointer to a new instance on success, NULL otherwise.
+ */
+struct uring *uring_create(int efd, int gfd, int lead, enum uring_mode mode);
+
+/**
+ * Cancels the outstanding requests, frees the ring and releases the
+ * lent messages. The sockets are left open.
+ * @param u  Pointer obtained via uring_create().
+ */
+void uring_destroy(struct uring *u);
+
+/**
+ * Returns the descriptor which becomes readable on new completions.
+ * @param u  Pointer obtained via uring_create().
+ */
+int uring_fd(struct uring *u);
+
+/**
+ * Takes received messages, with the same semantics as sk_receive_batch().
+ * Does not block. Where 'msg' holds a message which may be lent, the
+ * lent message holding the received one takes its place, along with
+ * the entries of 'buf', 'addr' and 'hwts', and the replaced message is
+ * lent in its stead. Otherwise the message is copied into 'buf'.
+ * @param msg  The messages owning the buffers, or NULL.
+ * @return     The number of messages received, possibly zero, or a
+ *             negative error code, also once a receive request has
+ *             been given up.
+ */
+int uring_recv(struct uring *u, struct ptp_message **msg, void **buf,
+	       int *len, struct address **addr, struct hw_timestamp **hwts,
+	       int n);
+
+/**
+ * Queues messages for transmission on one of the sockets, with the same
+ * semantics as sk_sendmmsg(). The payloads and names are copied.
+ * @return  The number of messages queued, or a negative error code. A
+ *          send which failed after being queued is reported by the
+ *          next call, which then queues nothing.
+ */
+int uring_sendmmsg(struct uring *u, int fd, struct mmsghdr *mmsg, int n);
+
+/**
+ * Takes the next transmit time stamp from the error queue of the event
+ * socket, with the same semantics as sk_receive() with MSG_ERRQUEUE.
+ * @param u       Pointer obtained via uring_create().
+ * @param buf     Buffer to receive the looped back packet.
+ * @param buflen  Size of 'buf' in bytes.
+ * @param hwts    Receives the time stamp. The type field must be set.
+ * @param timeout Milliseconds to wait, or zero to return at once.
+ * @return        Number of bytes received, -EAGAIN if none is queued,
+ *                -ETIMEDOUT if none arrived in time, or another
+ *                negative error code.
+ */
+int uring_txts(struct uring *u, void *buf, int buflen,
+	       struct hw_timestamp *hwts, int timeout);
+
+/**
+ * Tells whether transmit time stamps have been collected. Completions
+ * are taken from the ring, but the descriptor is left signaled for the
+ * received messages among them.
+ * @param u  Pointer obtained via uring_create().
+ * @return   Non-zero if uring_txts() would return one without waiting.
+ */
+int uring_txts_pending(struct uring *u);
+
+#endif
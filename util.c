@@ -120,6 +120,34 @@ int addreq(enum transport_type type, struct address *a, struct address *b)
 	return memcmp(bufa, bufb, len) == 0 ? 1 : 0;
 }
 
+unsigned int addrhash(enum transport_type type, struct address *a)
+{
+	unsigned int h = 0;
+	unsigned char *buf;
+	int i, len;
+
+	switch (type) {
+	case TRANS_UDP_IPV4:
+		buf = (unsigned char *) &a->sin.sin_addr;
+		len = sizeof(a->sin.sin_addr);
+		break;
+	case TRANS_UDP_IPV6:
+		buf = (unsigned char *) &a->sin6.sin6_addr;
+		len = sizeof(a->sin6.sin6_addr);
+		break;
+	case TRANS_IEEE_802_3:
+		buf = (unsigned char *) &a->sll.sll_addr;
+		len = MAC_LEN;
+		break;
+	default:
+		return 0;
+	}
+	for (i = 0; i < len; i++) {
+		h = h * 31 + buf[i];
+	}
+	return h;
+}
+
 char *bin2str_impl(Octet *data, int len, char *buf, int buf_len)
 {
 	int i, offset = 0;
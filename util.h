@@ -57,6 +57,15 @@ const char *ts_str(enum timestamp_type ts);
  */
 int addreq(enum transport_type type, struct address *a, struct address *b);
 
+/**
+ * Hashes the part of a binary address that @ref addreq() compares, so
+ * that equal addresses yield equal hash values.
+ * @param type  One of the enumerated transport types.
+ * @param a     The address to hash.
+ * @return      The hash value.
+ */
+unsigned int addrhash(enum transport_type type, struct address *a);
+
 static inline uint16_t align16(uint16_t *p)
 {
 	uint16_t v;
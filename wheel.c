@@ -0,0 +1,312 @@
+/**
+ * @file wheel.c
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <unistd.h>
+
+#include "missing.h"
+#include "print.h"
+#include "tmv.h"
+#include "wheel.h"
+
+/*
+ * Each tick is 2^20 nanoseconds, or about one millisecond. Four levels
+ * of 64 slots cover about 4.9 hours, and longer timeouts wait in the
+ * last slot of the top level until they come into range.
+ *
+ * The timers keep their exact expiration times. The slots only sort
+ * them coarsely, and the kernel timer is armed to the nanosecond.
+ */
+#define TICK_SHIFT	20
+#define SLOT_BITS	6
+#define N_SLOTS		(1 << SLOT_BITS)
+#define SLOT_MASK	(N_SLOTS - 1)
+#define N_LEVELS	4
+#define MAX_DELTA	((1ULL << (SLOT_BITS * N_LEVELS)) - 1)
+
+struct wheel_timer {
+	LIST_ENTRY(wheel_timer) list;
+	struct wheel *wheel;
+	void *owner;
+	int id;
+	int level;
+	uint64_t expires;
+};
+
+LIST_HEAD(wheel_slot, wheel_timer);
+
+struct wheel {
+	int fd;
+	/* The tick up to which the wheel has been run. */
+	uint64_t tick;
+	/* The deadline programmed into the timerfd, or zero. */
+	uint64_t armed;
+	int count[N_LEVELS];
+	struct wheel_slot slot[N_LEVELS][N_SLOTS];
+};
+
+static uint64_t wheel_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static int wheel_program(struct wheel *w, uint64_t deadline)
+{
+	struct itimerspec tmo;
+
+	memset(&tmo, 0, sizeof(tmo));
+	tmo.it_value.tv_sec = deadline / NS_PER_SEC;
+	tmo.it_value.tv_nsec = deadline % NS_PER_SEC;
+	if (timerfd_settime(w->fd, TFD_TIMER_ABSTIME, &tmo, NULL)) {
+		pr_err("timerfd_settime failed: %m");
+		return -1;
+	}
+	w->armed = deadline;
+	return 0;
+}
+
+static void wheel_insert(struct wheel *w, struct wheel_timer *t)
+{
+	uint64_t delta, tick = t->expires >> TICK_SHIFT;
+	int level, index;
+
+	if (tick < w->tick) {
+		tick = w->tick;
+	}
+	delta = tick - w->tick;
+	if (delta > MAX_DELTA) {
+		delta = MAX_DELTA;
+		tick = w->tick + delta;
+	}
+	for (level = 0; level < N_LEVELS - 1; level++) {
+		if (delta < 1ULL << (SLOT_BITS * (level + 1))) {
+			break;
+		}
+	}
+	index = (tick >> (SLOT_BITS * level)) & SLOT_MASK;
+
+	LIST_INSERT_HEAD(&w->slot[level][index], t, list);
+	t->level = level;
+	w->count[level]++;
+}
+
+static void wheel_remove(struct wheel_timer *t)
+{
+	if (t->level < 0) {
+		return;
+	}
+	LIST_REMOVE(t, list);
+	t->wheel->count[t->level]--;
+	t->level = -1;
+}
+
+/*
+ * Moves the timers of the next slot of each upper level that has
+ * come around down to where they belong now.
+ */
+static void wheel_cascade(struct wheel *w)
+{
+	struct wheel_timer *t;
+	int level, index;
+
+	for (level = 1; level < N_LEVELS; level++) {
+		index = (w->tick >> (SLOT_BITS * level)) & SLOT_MASK;
+		while ((t = LIST_FIRST(&w->slot[level][index])) != NULL) {
+			wheel_remove(t);
+			wheel_insert(w, t);
+		}
+		if (index) {
+			break;
+		}
+	}
+}
+
+/*
+ * Finds the earliest expiration time. Within each level, the slots
+ * are ordered starting after the current position, so only the
+ * first occupied slot of each level needs to be searched.
+ */
+static uint64_t wheel_next(struct wheel *w)
+{
+	uint64_t next = 0;
+	struct wheel_timer *t;
+	int i, index, level;
+
+	for (level = 0; level < N_LEVELS; level++) {
+		if (!w->count[level]) {
+			continue;
+		}
+		index = (w->tick >> (SLOT_BITS * level)) & SLOT_MASK;
+		for (i = level ? 1 : 0; i <= N_SLOTS; i++) {
+			struct wheel_slot *slot;
+
+			slot = &w->slot[level][(index + i) & SLOT_MASK];
+			if (LIST_EMPTY(slot)) {
+				continue;
+			}
+			LIST_FOREACH(t, slot, list) {
+				if (!next || t->expires < next) {
+					next = t->expires;
+				}
+			}
+			break;
+		}
+	}
+	return next;
+}
+
+struct wheel *wheel_create(void)
+{
+	struct wheel *w;
+	int i, j;
+
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		return NULL;
+	}
+	w->fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (w->fd < 0) {
+		pr_err("timerfd_create failed: %m");
+		free(w);
+		return NULL;
+	}
+	for (i = 0; i < N_LEVELS; i++) {
+		for (j = 0; j < N_SLOTS; j++) {
+			LIST_INIT(&w->slot[i][j]);
+		}
+	}
+	w->tick = wheel_now() >> TICK_SHIFT;
+	return w;
+}
+
+void wheel_destroy(struct wheel *w)
+{
+	close(w->fd);
+	free(w);
+}
+
+int wheel_fd(struct wheel *w)
+{
+	return w->fd;
+}
+
+int wheel_expire(struct wheel *w, wheel_handler handler, void *ctx, int max)
+{
+	uint64_t next, now = wheel_now(), target = now >> TICK_SHIFT;
+	struct wheel_timer *t, *tmp;
+	int cnt = 0;
+
+	while (cnt < max) {
+		struct wheel_slot *slot = &w->slot[0][w->tick & SLOT_MASK];
+
+		LIST_FOREACH_SAFE(t, slot, list, tmp) {
+			if (cnt == max) {
+				break;
+			}
+			if (t->expires > now) {
+				continue;
+			}
+			wheel_remove(t);
+			handler(ctx, t->owner, t->id);
+			cnt++;
+		}
+		if (cnt == max || w->tick == target) {
+			break;
+		}
+		/* Skip ahead when the lowest level is empty. */
+		if (w->count[0] || ((w->tick | SLOT_MASK) + 1) > target) {
+			w->tick++;
+		} else {
+			w->tick = (w->tick | SLOT_MASK) + 1;
+		}
+		if (!(w->tick & SLOT_MASK)) {
+			wheel_cascade(w);
+		}
+	}
+
+	/*
+	 * Always reprogram the timer, even with the same deadline, in
+	 * order to clear the descriptor's readiness.
+	 */
+	next = cnt == max ? now : wheel_next(w);
+	if (next) {
+		wheel_program(w, next);
+	} else {
+		wheel_program(w, 0);
+	}
+	return cnt;
+}
+
+struct wheel_timer *wheel_timer_create(struct wheel *w, void *owner, int id)
+{
+	struct wheel_timer *t;
+
+	t = calloc(1, sizeof(*t));
+	if (!t) {
+		return NULL;
+	}
+	t->wheel = w;
+	t->owner = owner;
+	t->id = id;
+	t->level = -1;
+	return t;
+}
+
+void wheel_timer_destroy(struct wheel_timer *t)
+{
+	wheel_remove(t);
+	free(t);
+}
+
+static int wheel_timer_arm(struct wheel_timer *t, uint64_t expires)
+{
+	struct wheel *w = t->wheel;
+
+	wheel_remove(t);
+	if (!expires) {
+		return 0;
+	}
+	t->expires = expires;
+	wheel_insert(w, t);
+
+	/* The kernel only needs to know about the nearest deadline. */
+	if (!w->armed || expires < w->armed) {
+		return wheel_program(w, expires);
+	}
+	return 0;
+}
+
+int wheel_timer_set(struct wheel_timer *t, uint64_t ns)
+{
+	return wheel_timer_arm(t, ns ? wheel_now() + ns : 0);
+}
+
+int wheel_timer_set_abs(struct wheel_timer *t, const struct timespec *ts)
+{
+	return wheel_timer_arm(t, ts->tv_sec * NS_PER_SEC + ts->tv_nsec);
+}
+
+void wheel_timer_clear(struct wheel_timer *t)
+{
+	wheel_remove(t);
+}
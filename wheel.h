@@ -0,0 +1,112 @@
+/**
+ * @file wheel.h
+ * @brief Implements a hierarchical timer wheel driven by a single timerfd.
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_WHEEL_H
+#define HAVE_WHEEL_H
+
+#include <stdint.h>
+#include <time.h>
+
+/** Opaque type */
+struct wheel;
+
+/** Opaque type */
+struct wheel_timer;
+
+/**
+ * Callback invoked for each timer that expires.
+ * @param ctx    The context passed to @ref wheel_expire().
+ * @param owner  The owner given when the timer was created.
+ * @param id     The identifier given when the timer was created.
+ */
+typedef void (*wheel_handler)(void *ctx, void *owner, int id);
+
+/**
+ * Creates a new timer wheel.
+ * @return  A pointer to a new timer wheel on success, NULL otherwise.
+ */
+struct wheel *wheel_create(void);
+
+/**
+ * Destroys a timer wheel. All of its timers must already be destroyed.
+ * @param w  A pointer obtained via @ref wheel_create().
+ */
+void wheel_destroy(struct wheel *w);
+
+/**
+ * Obtains the file descriptor of a timer wheel. The descriptor
+ * becomes readable when the nearest armed timer is due, and the
+ * caller should then invoke @ref wheel_expire().
+ * @param w  A pointer obtained via @ref wheel_create().
+ * @return   A timerfd descriptor.
+ */
+int wheel_fd(struct wheel *w);
+
+/**
+ * Runs all of the timers that are due. Expired timers are disarmed
+ * before their handler is called, and the kernel timer is rearmed
+ * for the next deadline.
+ * @param w        A pointer obtained via @ref wheel_create().
+ * @param handler  Function to call for each expired timer.
+ * @param ctx      Context passed to the handler.
+ * @param max      The maximum number of timers to expire in this call.
+ * @return         The number of expired timers.
+ */
+int wheel_expire(struct wheel *w, wheel_handler handler, void *ctx, int max);
+
+/**
+ * Creates a new, disarmed timer.
+ * @param w      A pointer obtained via @ref wheel_create().
+ * @param owner  An opaque pointer passed back upon expiration.
+ * @param id     An identifier passed back upon expiration.
+ * @return       A pointer to a new timer on success, NULL otherwise.
+ */
+struct wheel_timer *wheel_timer_create(struct wheel *w, void *owner, int id);
+
+/**
+ * Destroys a timer.
+ * @param t  A pointer obtained via @ref wheel_timer_create().
+ */
+void wheel_timer_destroy(struct wheel_timer *t);
+
+/**
+ * Arms a timer to expire after a given time, replacing any previous
+ * setting. Passing zero disarms the timer.
+ * @param t   A pointer obtained via @ref wheel_timer_create().
+ * @param ns  The timeout in nanoseconds.
+ * @return    Zero on success, non-zero otherwise.
+ */
+int wheel_timer_set(struct wheel_timer *t, uint64_t ns);
+
+/**
+ * Arms a timer to expire at an absolute CLOCK_MONOTONIC time,
+ * replacing any previous setting. Passing zero disarms the timer.
+ * @param t   A pointer obtained via @ref wheel_timer_create().
+ * @param ts  The expiration time.
+ * @return    Zero on success, non-zero otherwise.
+ */
+int wheel_timer_set_abs(struct wheel_timer *t, const struct timespec *ts);
+
+/**
+ * Disarms a timer.
+ * @param t  A pointer obtained via @ref wheel_timer_create().
+ */
+void wheel_timer_clear(struct wheel_timer *t);
+
+#endif
@@ -0,0 +1,463 @@
+/**
+ * @file xdp.c
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+
+#include "print.h"
+#include "xdp.h"
+
+#ifdef HAVE_AF_XDP
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define NUM_FRAMES	128 /* lent messages, also the ring size, a power of two */
+#define RING_MASK	(NUM_FRAMES - 1)
+
+/*
+ * The chunks are placed freely within the UMEM, each one ending with
+ * the data of a lent message. The kernel leaves XDP_PACKET_HEADROOM
+ * and the UMEM head room free in front of a frame, which is chosen to
+ * limit the frames to the size of an Ethernet header and the data.
+ * This much of the room in front of a message is used.
+ */
+#define FRAME_SIZE	2048 /* the smallest chunk accepted */
+#define FRAME_MAX	(ETH_HLEN + sizeof(((struct ptp_message *) 0)->data))
+#define FRAME_HEADROOM	(FRAME_SIZE - XDP_PACKET_HEADROOM - FRAME_MAX)
+#define FRAME_LEAD	(FRAME_SIZE - sizeof(((struct ptp_message *) 0)->data))
+
+#define PTP_GEN_BIT	0x08
+#define VERIFIER_LOG	4096
+
+struct xdp_ring {
+	uint32_t *producer;
+	uint32_t *consumer;
+	void *desc;
+	void *map;
+	size_t map_len;
+};
+
+struct xdp_rx {
+	int fd;
+	int map_fd;
+	int prog_fd;
+	int link_fd;
+	unsigned char *umem;
+	struct xdp_ring fill;
+	struct xdp_ring comp;
+	struct xdp_ring rx;
+	TAILQ_HEAD(lent, ptp_message) lent;
+};
+
+#define INSN(c, d, s, o, i) \
+	((struct bpf_insn) { .code = (c), .dst_reg = (d), .src_reg = (s), \
+			     .off = (o), .imm = (i) })
+
+#define PROG_LEN	23
+#define PROG_PASS	21
+
+static int sys_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/*
+ * Redirects the general PTP messages, with or without a VLAN tag, to
+ * the socket registered for the receive queue in the map. Anything
+ * else, or frames from queues without a socket, pass to the stack.
+ */
+static void prog_build(struct bpf_insn *insn, int map_fd)
+{
+	int i = 0;
+
+	/* r6 = ctx, r2 = data, r3 = data_end */
+	insn[i++] = INSN(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0);
+	insn[i++] = INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 6,
+			 offsetof(struct xdp_md, data), 0);
+	insn[i++] = INSN(BPF_LDX | BPF_MEM | BPF_W, 3, 6,
+			 offsetof(struct xdp_md, data_end), 0);
+	/* The tagged header and the first PTP byte must be present. */
+	insn[i++] = INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0);
+	insn[i++] = INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0,
+			 ETH_HLEN + 4 + 1);
+	insn[i] = INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, PROG_PASS - i - 1, 0);
+	i++;
+	insn[i++] = INSN(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 12, 0);
+	insn[i++] = INSN(BPF_JMP | BPF_JEQ | BPF_K, 5, 0, 4,
+			 htons(ETH_P_1588));
+	insn[i] = INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PROG_PASS - i - 1,
+		       htons(ETH_P_8021Q));
+	i++;
+	insn[i++] = INSN(BPF_LDX | BPF_MEM | BPF_H, 5, 2, 16, 0);
+	insn[i] = INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, PROG_PASS - i - 1,
+		       htons(ETH_P_1588));
+	i++;
+	insn[i++] = INSN(BPF_ALU64 | BPF_ADD | BPF_K, 2, 0, 0, 4);
+	/* Event messages need the time stamps of the regular path. */
+	insn[i++] = INSN(BPF_LDX | BPF_MEM | BPF_B, 5, 2, ETH_HLEN, 0);
+	insn[i++] = INSN(BPF_ALU64 | BPF_AND | BPF_K, 5, 0, 0, PTP_GEN_BIT);
+	insn[i] = INSN(BPF_JMP | BPF_JEQ | BPF_K, 5, 0, PROG_PASS - i - 1, 0);
+	i++;
+	/* return bpf_redirect_map(map, ctx->rx_queue_index, XDP_PASS) */
+	insn[i++] = INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 6,
+			 offsetof(struct xdp_md, rx_queue_index), 0);
+	insn[i++] = INSN(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0,
+			 map_fd);
+	insn[i++] = INSN(0, 0, 0, 0, 0);
+	insn[i++] = INSN(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS);
+	insn[i++] = INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+	insn[i++] = INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+	/* PROG_PASS */
+	insn[i++] = INSN(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS);
+	insn[i++] = INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+}
+
+static int prog_load(int map_fd)
+{
+	struct bpf_insn insn[PROG_LEN];
+	char log[VERIFIER_LOG];
+	union bpf_attr attr;
+	int fd;
+
+	prog_build(insn, map_fd);
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (uintptr_t) insn;
+	attr.insn_cnt = PROG_LEN;
+	attr.license = (uintptr_t) "GPL";
+	fd = sys_bpf(BPF_PROG_LOAD, &attr);
+	if (fd >= 0) {
+		return fd;
+	}
+	/* Load it again, only to get the verifier's opinion. */
+	log[0] = 0;
+	attr.log_buf = (uintptr_t) log;
+	attr.log_size = sizeof(log);
+	attr.log_level = 1;
+	fd = sys_bpf(BPF_PROG_LOAD, &attr);
+	if (fd >= 0) {
+		return fd;
+	}
+	pr_err("xdp: loading program failed: %m");
+	pr_debug("xdp: %s", log);
+	return -1;
+}
+
+static int map_create(int queue, int xsk)
+{
+	union bpf_attr attr;
+	__u32 key = queue, value = xsk;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(key);
+	attr.value_size = sizeof(value);
+	attr.max_entries = queue + 1;
+	fd = sys_bpf(BPF_MAP_CREATE, &attr);
+	if (fd < 0) {
+		pr_err("xdp: creating socket map failed: %m");
+		return -1;
+	}
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = fd;
+	attr.key = (uintptr_t) &key;
+	attr.value = (uintptr_t) &value;
+	if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr)) {
+		pr_err("xdp: adding socket to map failed: %m");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int prog_attach(int prog_fd, int ifindex, enum xdp_mode mode)
+{
+	union bpf_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = prog_fd;
+	attr.link_create.target_ifindex = ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+	attr.link_create.flags = mode == XDP_MODE_GENERIC ?
+		XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+	fd = sys_bpf(BPF_LINK_CREATE, &attr);
+	if (fd < 0) {
+		pr_err("xdp: attaching program failed: %m");
+	}
+	return fd;
+}
+
+static int ring_map(int fd, struct xdp_ring *r, struct xdp_ring_offset *off,
+		    size_t desc_size, off_t pgoff)
+{
+	r->map_len = off->desc + NUM_FRAMES * desc_size;
+	r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (r->map == MAP_FAILED) {
+		pr_err("xdp: mmap ring failed: %m");
+		r->map = NULL;
+		return -1;
+	}
+	r->producer = (uint32_t *) ((char *) r->map + off->producer);
+	r->consumer = (uint32_t *) ((char *) r->map + off->consumer);
+	r->desc = (char *) r->map + off->desc;
+	return 0;
+}
+
+static int xsk_open(struct xdp_rx *x, int ifindex, int queue)
+{
+	struct xdp_mmap_offsets off;
+	struct xdp_umem_reg reg;
+	struct sockaddr_xdp sxdp;
+	struct ptp_message *m;
+	int i, size = NUM_FRAMES;
+	socklen_t len;
+	size_t area;
+
+	x->umem = msg_slab_area(&area);
+	if (!x->umem) {
+		pr_err("xdp: no preallocated messages, see msg_pool_size");
+		return -1;
+	}
+	x->fd = socket(AF_XDP, SOCK_RAW, 0);
+	if (x->fd < 0) {
+		pr_err("xdp: socket failed: %m");
+		return -1;
+	}
+	memset(&reg, 0, sizeof(reg));
+	reg.addr = (uintptr_t) x->umem;
+	reg.len = area;
+	reg.chunk_size = FRAME_SIZE;
+	reg.headroom = FRAME_HEADROOM;
+	reg.flags = XDP_UMEM_UNALIGNED_CHUNK_FLAG;
+	if (setsockopt(x->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) ||
+	    setsockopt(x->fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) ||
+	    setsockopt(x->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size,
+		       sizeof(size)) ||
+	    setsockopt(x->fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size))) {
+		pr_err("xdp: setsockopt failed: %m");
+		return -1;
+	}
+	len = sizeof(off);
+	if (getsockopt(x->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len)) {
+		pr_err("xdp: getsockopt XDP_MMAP_OFFSETS failed: %m");
+		return -1;
+	}
+	if (ring_map(x->fd, &x->fill, &off.fr, sizeof(__u64),
+		     XDP_UMEM_PGOFF_FILL_RING) ||
+	    ring_map(x->fd, &x->comp, &off.cr, sizeof(__u64),
+		     XDP_UMEM_PGOFF_COMPLETION_RING) ||
+	    ring_map(x->fd, &x->rx, &off.rx, sizeof(struct xdp_desc),
+		     XDP_PGOFF_RX_RING)) {
+		return -1;
+	}
+
+	for (i = 0; i < NUM_FRAMES; i++) {
+		m = msg_allocate();
+		if (m && !msg_lendable(m)) {
+			msg_put(m);
+			m = NULL;
+		}
+		if (!m) {
+			pr_err("xdp: not enough preallocated messages to lend");
+			return -1;
+		}
+		xdp_rx_lend(x, m);
+	}
+
+	/*
+	 * Frames spanning two pages of the UMEM are only accepted when
+	 * the kernel copies them, so zero copy mode is not used.
+	 */
+	memset(&sxdp, 0, sizeof(sxdp));
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = ifindex;
+	sxdp.sxdp_queue_id = queue;
+	sxdp.sxdp_flags = XDP_COPY;
+	if (bind(x->fd, (struct sockaddr *) &sxdp, sizeof(sxdp))) {
+		pr_err("xdp: bind failed: %m");
+		return -1;
+	}
+	return 0;
+}
+
+struct xdp_rx *xdp_rx_create(const char *name, int queue, enum xdp_mode mode)
+{
+	struct xdp_rx *x;
+	int ifindex;
+
+	ifindex = if_nametoindex(name);
+	if (!ifindex) {
+		pr_err("xdp: unknown interface %s", name);
+		return NULL;
+	}
+	x = calloc(1, sizeof(*x));
+	if (!x) {
+		return NULL;
+	}
+	x->fd = -1;
+	x->map_fd = -1;
+	x->prog_fd = -1;
+	x->link_fd = -1;
+	TAILQ_INIT(&x->lent);
+
+	if (xsk_open(x, ifindex, queue)) {
+		goto failed;
+	}
+	x->map_fd = map_create(queue, x->fd);
+	if (x->map_fd < 0) {
+		goto failed;
+	}
+	x->prog_fd = prog_load(x->map_fd);
+	if (x->prog_fd < 0) {
+		goto failed;
+	}
+	x->link_fd = prog_attach(x->prog_fd, ifindex, mode);
+	if (x->link_fd < 0) {
+		goto failed;
+	}
+	pr_info("xdp: receiving general messages on %s queue %d", name, queue);
+	return x;
+failed:
+	xdp_rx_destroy(x);
+	return NULL;
+}
+
+void xdp_rx_destroy(struct xdp_rx *x)
+{
+	struct ptp_message *m;
+
+	if (x->link_fd >= 0) {
+		close(x->link_fd);
+	}
+	if (x->prog_fd >= 0) {
+		close(x->prog_fd);
+	}
+	if (x->map_fd >= 0) {
+		close(x->map_fd);
+	}
+	if (x->rx.map) {
+		munmap(x->rx.map, x->rx.map_len);
+	}
+	if (x->comp.map) {
+		munmap(x->comp.map, x->comp.map_len);
+	}
+	if (x->fill.map) {
+		munmap(x->fill.map, x->fill.map_len);
+	}
+	if (x->fd >= 0) {
+		close(x->fd);
+	}
+	/* With the socket gone, the kernel no longer writes into them. */
+	while ((m = TAILQ_FIRST(&x->lent)) != NULL) {
+		TAILQ_REMOVE(&x->lent, m, list);
+		msg_put(m);
+	}
+	free(x);
+}
+
+int xdp_rx_fd(struct xdp_rx *x)
+{
+	return x->fd;
+}
+
+int xdp_rx_recv(struct xdp_rx *x, struct xdp_frame *frame, int n)
+{
+	uint32_t cons, prod;
+	struct xdp_desc *d;
+	unsigned char *chunk;
+	int i;
+
+	cons = *x->rx.consumer;
+	prod = __atomic_load_n(x->rx.producer, __ATOMIC_ACQUIRE);
+	if (prod - cons < (uint32_t) n) {
+		n = prod - cons;
+	}
+	for (i = 0; i < n; i++) {
+		d = (struct xdp_desc *) x->rx.desc + ((cons + i) & RING_MASK);
+		chunk = x->umem + (d->addr & XSK_UNALIGNED_BUF_ADDR_MASK);
+		frame[i].msg = (struct ptp_message *) (chunk + FRAME_LEAD);
+		frame[i].data = chunk +
+			(d->addr >> XSK_UNALIGNED_BUF_OFFSET_SHIFT);
+		frame[i].len = d->len;
+		TAILQ_REMOVE(&x->lent, frame[i].msg, list);
+	}
+	__atomic_store_n(x->rx.consumer, cons + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+void xdp_rx_lend(struct xdp_rx *x, struct ptp_message *m)
+{
+	uint32_t prod = *x->fill.producer;
+	__u64 *fill = x->fill.desc;
+
+	fill[prod & RING_MASK] = (unsigned char *) m - FRAME_LEAD - x->umem;
+	TAILQ_INSERT_TAIL(&x->lent, m, list);
+	__atomic_store_n(x->fill.producer, prod + 1, __ATOMIC_RELEASE);
+}
+
+#else /* HAVE_AF_XDP */
+
+struct xdp_rx *xdp_rx_create(const char *name, int queue, enum xdp_mode mode)
+{
+	pr_err("xdp: AF_XDP is not supported by the kernel headers");
+	return NULL;
+}
+
+void xdp_rx_destroy(struct xdp_rx *x)
+{
+}
+
+int xdp_rx_fd(struct xdp_rx *x)
+{
+	return -1;
+}
+
+int xdp_rx_recv(struct xdp_rx *x, struct xdp_frame *frame, int n)
+{
+	return 0;
+}
+
+void xdp_rx_lend(struct xdp_rx *x, struct ptp_message *m)
+{
+}
+
+#endif /* HAVE_AF_XDP */
@@ -0,0 +1,93 @@
+/**
+ * @file xdp.h
+ * @brief Receives Ethernet frames through an AF_XDP socket.
+ * @note Copyright (C) 2026 The linuxptp contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_XDP_H
+#define HAVE_XDP_H
+
+#include "msg.h"
+
+/*
+ * An XDP program on the interface redirects the PTP general messages
+ * arriving on one receive queue into a ring shared with user space.
+ * All other frames, including the event messages, which need the time
+ * stamps of the regular socket path, continue up the stack.
+ *
+ * The memory of the preallocated messages serves as the UMEM, and the
+ * frames are received into messages lent to the kernel, with the
+ * Ethernet header in front of the message.
+ */
+
+enum xdp_mode {
+	XDP_MODE_OFF,
+	XDP_MODE_GENERIC,
+	XDP_MODE_NATIVE,
+};
+
+struct xdp_rx;
+
+/**
+ * A received frame, held by a message which was lent to the kernel.
+ */
+struct xdp_frame {
+	struct ptp_message *msg;
+	unsigned char *data;
+	int len;
+};
+
+/**
+ * Creates an AF_XDP socket and attaches the redirecting XDP program.
+ * @param name   The name of the network interface.
+ * @param queue  The receive queue to take the frames from.
+ * @param mode   XDP_MODE_GENERIC or XDP_MODE_NATIVE.
+ * @return       A pointer to a new instance on success, NULL otherwise.
+ */
+struct xdp_rx *xdp_rx_create(const char *name, int queue, enum xdp_mode mode);
+
+/**
+ * Detaches the XDP program, frees the resources of an instance and
+ * releases the messages lent to the kernel.
+ * @param x  Pointer obtained via xdp_rx_create().
+ */
+void xdp_rx_destroy(struct xdp_rx *x);
+
+/**
+ * Returns the descriptor which becomes readable when frames arrive.
+ * @param x  Pointer obtained via xdp_rx_create().
+ */
+int xdp_rx_fd(struct xdp_rx *x);
+
+/**
+ * Takes frames from the receive ring. The messages holding them now
+ * belong to the caller, who must lend a message in return for each
+ * frame, using xdp_rx_lend().
+ * @param x      Pointer obtained via xdp_rx_create().
+ * @param frame  Array to fill with the frames.
+ * @param n      Maximum number of frames to take.
+ * @return       The number of frames taken, possibly zero.
+ */
+int xdp_rx_recv(struct xdp_rx *x, struct xdp_frame *frame, int n);
+
+/**
+ * Lends a message to the kernel, to receive a frame into.
+ * @param x  Pointer obtained via xdp_rx_create().
+ * @param m  A message for which msg_lendable() holds.
+ */
+void xdp_rx_lend(struct xdp_rx *x, struct ptp_message *m);
+
+#endif